@@ -138,13 +138,12 @@ struct all_attrs_item {
 };
 
 /*
- * Reallocate and reinitialize the array of all attributes (which is used in
- * the attribute collection process) in 'check' based on the global dictionary
- * of attributes.
+ * Reallocate the array of all attributes (which is used in the attribute
+ * collection process) in 'check' based on the global dictionary of
+ * attributes. The entries are not reinitialized.
  */
 static void all_attrs_init(struct attr_hashmap *map, struct attr_check *check)
 {
-	int i;
 	unsigned int size;
 
 	hashmap_lock(map);
@@ -174,16 +173,6 @@ static void all_attrs_init(struct attr_hashmap *map, struct attr_check *check)
 	}
 
 	hashmap_unlock(map);
-
-	/*
-	 * Re-initialize every entry in check->all_attrs.
-	 * This re-initialization can live outside of the locked region since
-	 * the attribute dictionary is no longer being accessed.
-	 */
-	for (i = 0; i < check->all_attrs_nr; i++) {
-		check->all_attrs[i].value = ATTR__UNKNOWN;
-		check->all_attrs[i].macro = NULL;
-	}
 }
 
 static int attr_name_valid(const char *name, size_t namelen)
@@ -487,6 +476,47 @@ static void drop_attr_stack(struct attr_stack **stack)
 	}
 }
 
+/*
+ * The rules of an attribute stack that may apply to paths directly
+ * inside one directory, compiled when a lookup enters that directory
+ * so that further lookups in the same directory neither have to walk
+ * the stack nor take any lock.
+ */
+struct attr_rule {
+	const struct match_attr *a;
+	const char *base;
+	int baselen;
+};
+
+struct attr_dir_rules {
+	/* the directory these rules were compiled for */
+	struct strbuf dir;
+
+	/* non-macro rules that may match, in the order fill() tries them */
+	struct attr_rule *rules;
+	int nr, alloc;
+
+	/*
+	 * The macro definition in effect for each attribute number, and
+	 * whether any of the rules can set it (directly or through a
+	 * macro); both arrays have "attr_nr" elements.
+	 */
+	const struct match_attr **macros;
+	char *settable;
+	int attr_nr;
+};
+
+static void attr_dir_rules_free(struct attr_dir_rules *r)
+{
+	if (!r)
+		return;
+	strbuf_release(&r->dir);
+	free(r->rules);
+	free(r->macros);
+	free(r->settable);
+	free(r);
+}
+
 /* List of all attr_check structs; access should be surrounded by mutex */
 static struct check_vector {
 	size_t nr;
@@ -549,6 +579,8 @@ static void drop_all_attr_stacks(void)
 
 	for (i = 0; i < check_vector.nr; i++) {
 		drop_attr_stack(&check_vector.checks[i]->stack);
+		attr_dir_rules_free(check_vector.checks[i]->rules);
+		check_vector.checks[i]->rules = NULL;
 	}
 
 	vector_unlock();
@@ -641,6 +673,8 @@ void attr_check_clear(struct attr_check *check)
 	check->all_attrs_nr = 0;
 
 	drop_attr_stack(&check->stack);
+	attr_dir_rules_free(check->rules);
+	check->rules = NULL;
 }
 
 void attr_check_free(struct attr_check *check)
@@ -838,6 +872,49 @@ static int git_attr_system(void)
 
 static GIT_PATH_FUNC(git_path_info_attributes, INFOATTRIBUTES_FILE)
 
+int have_attr_files(const struct index_state *istate)
+{
+	struct strbuf path = STRBUF_INIT;
+	const char *prev = "";
+	int i, found = 0;
+
+	if ((git_attr_system() && file_exists(git_etc_gitattributes())) ||
+	    (get_home_gitattributes() && file_exists(get_home_gitattributes())) ||
+	    (startup_info->have_repository &&
+	     file_exists(git_path_info_attributes())))
+		return 1;
+
+	if (!is_bare_repository() && file_exists(GITATTRIBUTES_FILE))
+		return 1;
+	for (i = 0; !found && i < istate->cache_nr; i++) {
+		const char *name = istate->cache[i]->name;
+		const char *slash, *base = strrchr(name, '/');
+
+		if (!strcmp(base ? base + 1 : name, GITATTRIBUTES_FILE))
+			found = 1;
+		if (found || is_bare_repository())
+			continue;
+		/*
+		 * The index is sorted, so the files of a directory are
+		 * next to each other; look at each directory once.
+		 */
+		for (slash = strchr(name, '/'); slash && !found;
+		     slash = strchr(slash + 1, '/')) {
+			size_t len = slash - name + 1;
+
+			if (!strncmp(prev, name, len))
+				continue;
+			strbuf_reset(&path);
+			strbuf_add(&path, name, len);
+			strbuf_addstr(&path, GITATTRIBUTES_FILE);
+			found = file_exists(path.buf);
+		}
+		prev = name;
+	}
+	strbuf_release(&path);
+	return found;
+}
+
 static void push_stack(struct attr_stack **attr_stack_p,
 		       struct attr_stack *elem, char *origin, size_t originlen)
 {
@@ -1031,21 +1108,17 @@ static int fill_one(const char *what, struct all_attrs_item *all_attrs,
 }
 
 static int fill(const char *path, int pathlen, int basename_offset,
-		const struct attr_stack *stack,
+		const struct attr_dir_rules *r,
 		struct all_attrs_item *all_attrs, int rem)
 {
-	for (; rem > 0 && stack; stack = stack->prev) {
-		int i;
-		const char *base = stack->origin ? stack->origin : "";
+	int i;
 
-		for (i = stack->num_matches - 1; 0 < rem && 0 <= i; i--) {
-			const struct match_attr *a = stack->attrs[i];
-			if (a->is_macro)
-				continue;
-			if (path_matches(path, pathlen, basename_offset,
-					 &a->u.pat, base, stack->originlen))
-				rem = fill_one("fill", all_attrs, a, rem);
-		}
+	for (i = 0; 0 < rem && i < r->nr; i++) {
+		const struct attr_rule *rule = &r->rules[i];
+
+		if (path_matches(path, pathlen, basename_offset,
+				 &rule->a->u.pat, rule->base, rule->baselen))
+			rem = fill_one("fill", all_attrs, rule->a, rem);
 	}
 
 	return rem;
@@ -1066,7 +1139,7 @@ static int macroexpand_one(struct all_attrs_item *all_attrs, int nr, int rem)
  * This prevents having to search through the attribute stack each time
  * a macro needs to be expanded during the fill stage.
  */
-static void determine_macros(struct all_attrs_item *all_attrs,
+static void determine_macros(const struct match_attr **macros,
 			     const struct attr_stack *stack)
 {
 	for (; stack; stack = stack->prev) {
@@ -1075,14 +1148,154 @@ static void determine_macros(struct all_attrs_item *all_attrs,
 			const struct match_attr *ma = stack->attrs[i];
 			if (ma->is_macro) {
 				int n = ma->u.attr->attr_nr;
-				if (!all_attrs[n].macro) {
-					all_attrs[n].macro = ma;
+				if (!macros[n]) {
+					macros[n] = ma;
 				}
 			}
 		}
 	}
 }
 
+/*
+ * Can a pattern from the attributes file in "base" match any path
+ * directly inside "dir" (which is "base" or below it)? This is a cheap
+ * and conservative check, looking only at the literal leading part of
+ * the pattern and, when there is no "**" or bracket expression, at the
+ * number of path components.
+ */
+static int rule_may_match_in_dir(const struct pattern *pat,
+				 const char *base, int baselen,
+				 const char *dir, int dirlen)
+{
+	const char *pattern = pat->pattern;
+	int patternlen = pat->patternlen;
+	int prefix = pat->nowildcardlen;
+	const char *rel;
+	int rellen, i, slashes;
+
+	if (pat->flags & EXC_FLAG_NODIR)
+		return 1;
+
+	/* see match_pathname(); paths inside "dir" are "base/rel/..." */
+	if (*pattern == '/') {
+		pattern++;
+		patternlen--;
+		prefix--;
+	}
+	rel = dir + baselen;
+	if (baselen && baselen < dirlen)
+		rel++;
+	rellen = dirlen - (rel - dir);
+
+	if (fspathncmp(pattern, rel, prefix < rellen ? prefix : rellen))
+		return 0;
+	if (rellen && prefix > rellen && pattern[rellen] != '/')
+		return 0;
+
+	for (i = 0; i < patternlen; i++)
+		if (pattern[i] == '[' ||
+		    (pattern[i] == '*' && i + 1 < patternlen &&
+		     pattern[i + 1] == '*'))
+			return 1;
+	for (i = slashes = 0; i < patternlen; i++)
+		if (pattern[i] == '/')
+			slashes++;
+	for (i = 0; i < rellen; i++)
+		if (rel[i] == '/')
+			slashes--;
+	return slashes == !!rellen;
+}
+
+static void mark_settable(struct attr_dir_rules *r,
+			  const struct match_attr *a)
+{
+	int i;
+
+	for (i = 0; i < a->num_attr; i++) {
+		int n = a->state[i].attr->attr_nr;
+
+		if (r->settable[n])
+			continue;
+		r->settable[n] = 1;
+		if (r->macros[n])
+			mark_settable(r, r->macros[n]);
+	}
+}
+
+/*
+ * Collect the rules of check->stack, which has just been prepared for
+ * "dir", into check->rules.
+ */
+static void compile_attr_rules(struct attr_check *check,
+			       const char *dir, int dirlen)
+{
+	struct attr_dir_rules *r = check->rules;
+	const struct attr_stack *stack;
+	int i;
+
+	if (!r) {
+		r = xcalloc(1, sizeof(*r));
+		strbuf_init(&r->dir, 0);
+		check->rules = r;
+	}
+	strbuf_reset(&r->dir);
+	strbuf_add(&r->dir, dir, dirlen);
+	r->nr = 0;
+
+	/* every attribute in the stack is known by now */
+	all_attrs_init(&g_attr_hashmap, check);
+	r->attr_nr = check->all_attrs_nr;
+	FREE_AND_NULL(r->macros);
+	FREE_AND_NULL(r->settable);
+	r->macros = xcalloc(r->attr_nr, sizeof(*r->macros));
+	r->settable = xcalloc(r->attr_nr, sizeof(*r->settable));
+	determine_macros(r->macros, check->stack);
+
+	for (stack = check->stack; stack; stack = stack->prev) {
+		const char *base = stack->origin ? stack->origin : "";
+
+		for (i = stack->num_matches - 1; 0 <= i; i--) {
+			const struct match_attr *a = stack->attrs[i];
+			struct attr_rule *rule;
+
+			if (a->is_macro ||
+			    !rule_may_match_in_dir(&a->u.pat, base,
+						   stack->originlen,
+						   dir, dirlen))
+				continue;
+			ALLOC_GROW(r->rules, r->nr + 1, r->alloc);
+			rule = &r->rules[r->nr++];
+			rule->a = a;
+			rule->base = base;
+			rule->baselen = stack->originlen;
+			mark_settable(r, a);
+		}
+	}
+}
+
+/*
+ * Make check->all_attrs large enough for every attribute that can be
+ * involved in a lookup, and reinitialize it. The global dictionary
+ * (and its lock) is only consulted when the check asks about
+ * attributes that were interned after the rules were compiled.
+ */
+static void reset_all_attrs(struct attr_check *check)
+{
+	const struct attr_dir_rules *r = check->rules;
+	int i;
+
+	for (i = 0; i < check->nr; i++)
+		if (check->items[i].attr->attr_nr >= check->all_attrs_nr) {
+			all_attrs_init(&g_attr_hashmap, check);
+			break;
+		}
+
+	for (i = 0; i < check->all_attrs_nr; i++) {
+		check->all_attrs[i].value = ATTR__UNKNOWN;
+		check->all_attrs[i].macro = i < r->attr_nr ? r->macros[i] : NULL;
+	}
+}
+
 /*
  * Collect attributes for path into the array pointed to by check->all_attrs.
  * If check->check_nr is non-zero, only attributes in check[] are collected.
@@ -1109,11 +1322,16 @@ static void collect_some_attrs(const struct index_state *istate,
 		dirlen = 0;
 	}
 
-	prepare_attr_stack(istate, path, dirlen, &check->stack);
-	all_attrs_init(&g_attr_hashmap, check);
-	determine_macros(check->all_attrs, check->stack);
+	if (!check->rules || check->rules->dir.len != dirlen ||
+	    memcmp(check->rules->dir.buf, path, dirlen)) {
+		prepare_attr_stack(istate, path, dirlen, &check->stack);
+		compile_attr_rules(check, path, dirlen);
+	}
+	reset_all_attrs(check);
 
 	if (check->nr) {
+		int settable = 0;
+
 		rem = 0;
 		for (i = 0; i < check->nr; i++) {
 			int n = check->items[i].attr->attr_nr;
@@ -1121,14 +1339,18 @@ static void collect_some_attrs(const struct index_state *istate,
 			if (item->macro) {
 				item->value = ATTR__UNSET;
 				rem++;
+			} else if (n < check->rules->attr_nr &&
+				   check->rules->settable[n]) {
+				settable = 1;
 			}
 		}
-		if (rem == check->nr)
+		/* no rule in effect here can change the answer */
+		if (rem == check->nr || !settable)
 			return;
 	}
 
 	rem = check->all_attrs_nr;
-	fill(path, pathlen, basename_offset, check->stack, check->all_attrs, rem);
+	fill(path, pathlen, basename_offset, check->rules, check->all_attrs, rem);
 }
 
 void git_check_attr(const struct index_state *istate,
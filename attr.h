@@ -9,6 +9,7 @@ struct git_attr;
 /* opaque structures used internally for attribute collection */
 struct all_attrs_item;
 struct attr_stack;
+struct attr_dir_rules;
 struct index_state;
 
 /*
@@ -43,6 +44,7 @@ struct attr_check {
 	int all_attrs_nr;
 	struct all_attrs_item *all_attrs;
 	struct attr_stack *stack;
+	struct attr_dir_rules *rules;
 };
 
 struct attr_check *attr_check_alloc(void);
@@ -80,6 +82,14 @@ enum git_attr_direction {
 };
 void git_attr_set_direction(enum git_attr_direction new_direction);
 
+/*
+ * Return 1 if any of the files attributes are read from exists: the
+ * system-wide and global ones, $GIT_DIR/info/attributes, and the
+ * .gitattributes files in the index or in the directories of the work
+ * tree that hold tracked files.
+ */
+int have_attr_files(const struct index_state *istate);
+
 void attr_start(void);
 
 #endif /* ATTR_H */
@@ -9,6 +9,12 @@
 #include "blame.h"
 #include "alloc.h"
 #include "commit-slab.h"
+#include "lockfile.h"
+#include "replace-object.h"
+#include "thread-utils.h"
+#include "userdiff.h"
+#include "dir.h"
+#include "packfile.h"
 
 define_commit_slab(blame_suspects, struct blame_origin *);
 static struct blame_suspects blame_suspects;
@@ -27,10 +33,13 @@ static void set_blame_suspects(struct commit *commit, struct blame_origin *origi
 	*blame_suspects_at(&blame_suspects, commit) = origin;
 }
 
+static void release_blame_diffs(struct blame_origin *o);
+
 void blame_origin_decref(struct blame_origin *o)
 {
 	if (o && --o->refcnt <= 0) {
 		struct blame_origin *p, *l = NULL;
+		release_blame_diffs(o);
 		if (o->previous)
 			blame_origin_decref(o->previous);
 		free(o->file.ptr);
@@ -292,7 +301,8 @@ static struct commit *fake_working_tree_commit(struct repository *r,
 
 
 
-static int diff_hunks(mmfile_t *file_a, mmfile_t *file_b,
+static int diff_hunks(mmfile_t *file_a, const struct object_id *oid_a,
+		      mmfile_t *file_b, const struct object_id *oid_b,
 		      xdl_emit_hunk_consume_func_t hunk_func, void *cb_data, int xdl_opts)
 {
 	xpparam_t xpp = {0};
@@ -302,7 +312,7 @@ static int diff_hunks(mmfile_t *file_a, mmfile_t *file_b,
 	xpp.flags = xdl_opts;
 	xecfg.hunk_func = hunk_func;
 	ecb.priv = cb_data;
-	return xdi_diff(file_a, file_b, &xpp, &xecfg, &ecb);
+	return xdi_diff_blobs(file_a, oid_a, file_b, oid_b, &xpp, &xecfg, &ecb);
 }
 
 /*
@@ -321,9 +331,11 @@ static void fill_origin_blob(struct diff_options *opt,
 		    textconv_object(opt->repo, o->path, o->mode,
 				    &o->blob_oid, 1, &file->ptr, &file_size))
 			;
-		else
+		else {
 			file->ptr = read_object_file(&o->blob_oid, &type,
 						     &file_size);
+			o->file_is_blob = 1;
+		}
 		file->size = file_size;
 
 		if (!file->ptr)
@@ -336,8 +348,224 @@ static void fill_origin_blob(struct diff_options *opt,
 		*file = o->file;
 }
 
+/*
+ * The diffs of an origin against its parents do not depend on which of
+ * its lines are still suspects, so with more than one thread they are
+ * computed ahead, from worker threads, for the commit being blamed and
+ * the commits waiting in the queue.  Only the diffing happens in the
+ * workers; finding the parent origins and reading their blobs stays on
+ * the main thread, and the hunks are handed to blame_chunk_cb() there
+ * in the same order as without threads, so the result is the same.
+ */
+struct blame_diff_hunk {
+	long start_a, count_a, start_b, count_b;
+};
+
+struct blame_diff {
+	/* in the target's list of diffs */
+	struct blame_diff *next;
+	/* in the queue of diffs waiting for a worker */
+	struct blame_diff *next_queued;
+	struct blame_origin *parent, *target;
+	mmfile_t file_p, file_o;
+	int xdl_opts;
+	struct blame_diff_hunk *hunk;
+	int nr, alloc;
+	int ret, done;
+};
+
+static struct blame_diff_pool {
+	pthread_mutex_t mutex;
+	pthread_cond_t work_cond;
+	pthread_cond_t done_cond;
+	struct blame_diff *queue, **queue_tail;
+	pthread_t *threads;
+	int nr_threads;
+	int stop;
+	pthread_t main_thread;
+	try_to_free_t old_try_to_free_routine;
+} diff_pool;
+
+/*
+ * The main thread reads objects without taking any lock while the
+ * workers diff, so only it may release pack memory when an allocation
+ * fails; a worker has to do without.
+ */
+static void try_to_free_from_main_thread(size_t size)
+{
+#ifndef NO_PTHREADS
+	if (!pthread_equal(pthread_self(), diff_pool.main_thread))
+		return;
+#endif
+	release_pack_memory(size);
+}
+
+static int record_hunk(long start_a, long count_a,
+		       long start_b, long count_b, void *data)
+{
+	struct blame_diff *diff = data;
+	struct blame_diff_hunk *h;
+
+	ALLOC_GROW(diff->hunk, diff->nr + 1, diff->alloc);
+	h = &diff->hunk[diff->nr++];
+	h->start_a = start_a;
+	h->count_a = count_a;
+	h->start_b = start_b;
+	h->count_b = count_b;
+	return 0;
+}
+
+static void *blame_diff_worker(void *unused)
+{
+	pthread_mutex_lock(&diff_pool.mutex);
+	for (;;) {
+		struct blame_diff *diff;
+
+		while (!diff_pool.queue && !diff_pool.stop)
+			pthread_cond_wait(&diff_pool.work_cond, &diff_pool.mutex);
+		diff = diff_pool.queue;
+		if (!diff)
+			break;
+		diff_pool.queue = diff->next_queued;
+		if (!diff_pool.queue)
+			diff_pool.queue_tail = &diff_pool.queue;
+		pthread_mutex_unlock(&diff_pool.mutex);
+
+		/* no blob ids: the line hash cache is not thread-safe */
+		diff->ret = diff_hunks(&diff->file_p, NULL, &diff->file_o, NULL,
+				       record_hunk, diff, diff->xdl_opts);
+
+		pthread_mutex_lock(&diff_pool.mutex);
+		diff->done = 1;
+		diff->parent->diffs_in_flight--;
+		diff->target->diffs_in_flight--;
+		pthread_cond_broadcast(&diff_pool.done_cond);
+	}
+	pthread_mutex_unlock(&diff_pool.mutex);
+	return NULL;
+}
+
+static void start_blame_diff_workers(int nr_threads)
+{
+	int i;
+
+	pthread_mutex_init(&diff_pool.mutex, NULL);
+	pthread_cond_init(&diff_pool.work_cond, NULL);
+	pthread_cond_init(&diff_pool.done_cond, NULL);
+	diff_pool.queue = NULL;
+	diff_pool.queue_tail = &diff_pool.queue;
+	diff_pool.stop = 0;
+#ifndef NO_PTHREADS
+	diff_pool.main_thread = pthread_self();
+#endif
+	diff_pool.old_try_to_free_routine =
+		set_try_to_free_routine(try_to_free_from_main_thread);
+	ALLOC_ARRAY(diff_pool.threads, nr_threads);
+	for (i = 0; i < nr_threads; i++) {
+		if (pthread_create(&diff_pool.threads[i], NULL,
+				   blame_diff_worker, NULL)) {
+			warning(_("unable to create blame thread"));
+			break;
+		}
+	}
+	diff_pool.nr_threads = i;
+	if (!diff_pool.nr_threads) {
+		set_try_to_free_routine(diff_pool.old_try_to_free_routine);
+		pthread_cond_destroy(&diff_pool.work_cond);
+		pthread_cond_destroy(&diff_pool.done_cond);
+		pthread_mutex_destroy(&diff_pool.mutex);
+		FREE_AND_NULL(diff_pool.threads);
+	}
+}
+
+static void stop_blame_diff_workers(void)
+{
+	int i;
+
+	if (!diff_pool.nr_threads)
+		return;
+	pthread_mutex_lock(&diff_pool.mutex);
+	diff_pool.stop = 1;
+	pthread_cond_broadcast(&diff_pool.work_cond);
+	pthread_mutex_unlock(&diff_pool.mutex);
+	for (i = 0; i < diff_pool.nr_threads; i++)
+		pthread_join(diff_pool.threads[i], NULL);
+	set_try_to_free_routine(diff_pool.old_try_to_free_routine);
+	pthread_cond_destroy(&diff_pool.work_cond);
+	pthread_cond_destroy(&diff_pool.done_cond);
+	pthread_mutex_destroy(&diff_pool.mutex);
+	FREE_AND_NULL(diff_pool.threads);
+	diff_pool.nr_threads = 0;
+}
+
+static void wait_for_blame_diff(struct blame_diff *diff)
+{
+	if (!diff_pool.nr_threads)
+		return;
+	pthread_mutex_lock(&diff_pool.mutex);
+	while (!diff->done)
+		pthread_cond_wait(&diff_pool.done_cond, &diff_pool.mutex);
+	pthread_mutex_unlock(&diff_pool.mutex);
+}
+
+static void free_blame_diff(struct blame_diff *diff)
+{
+	wait_for_blame_diff(diff);
+	blame_origin_decref(diff->parent);
+	free(diff->hunk);
+	free(diff);
+}
+
+static void release_blame_diffs(struct blame_origin *o)
+{
+	while (o->diffs) {
+		struct blame_diff *diff = o->diffs;
+		o->diffs = diff->next;
+		free_blame_diff(diff);
+	}
+}
+
+/*
+ * Take the diff of target against parent computed by a worker, if
+ * there is one, off the target's list once it is done.
+ */
+static struct blame_diff *take_blame_diff(struct blame_origin *target,
+					  struct blame_origin *parent)
+{
+	struct blame_diff **pp;
+
+	for (pp = &target->diffs; *pp; pp = &(*pp)->next) {
+		struct blame_diff *diff = *pp;
+		if (diff->parent == parent) {
+			*pp = diff->next;
+			wait_for_blame_diff(diff);
+			return diff;
+		}
+	}
+	return NULL;
+}
+
+static int origin_blob_in_use(struct blame_origin *o)
+{
+	int in_use;
+
+	if (!diff_pool.nr_threads)
+		return 0;
+	pthread_mutex_lock(&diff_pool.mutex);
+	in_use = o->diffs_in_flight;
+	pthread_mutex_unlock(&diff_pool.mutex);
+	return in_use;
+}
+
 static void drop_origin_blob(struct blame_origin *o)
 {
+	if (diff_pool.nr_threads) {
+		/* a worker may still be diffing it */
+		pthread_mutex_lock(&diff_pool.mutex);
+		while (o->diffs_in_flight)
+			pthread_cond_wait(&diff_pool.done_cond, &diff_pool.mutex);
+		pthread_mutex_unlock(&diff_pool.mutex);
+	}
 	FREE_AND_NULL(o->file.ptr);
 }
 
@@ -967,6 +1195,8 @@ static void pass_blame_to_parent(struct blame_scoreboard *sb,
 	mmfile_t file_p, file_o;
 	struct blame_chunk_cb_data d;
 	struct blame_entry *newdest = NULL;
+	struct blame_diff *diff;
+	int ret;
 
 	if (!target->suspects)
 		return; /* nothing remains for this target */
@@ -979,7 +1209,21 @@ static void pass_blame_to_parent(struct blame_scoreboard *sb,
 	fill_origin_blob(&sb->revs->diffopt, target, &file_o, &sb->num_read_blob);
 	sb->num_get_patch++;
 
-	if (diff_hunks(&file_p, &file_o, blame_chunk_cb, &d, sb->xdl_opts))
+	diff = take_blame_diff(target, parent);
+	if (diff) {
+		int i;
+
+		ret = diff->ret;
+		for (i = 0; !ret && i < diff->nr; i++)
+			ret = blame_chunk_cb(diff->hunk[i].start_a, diff->hunk[i].count_a,
+					     diff->hunk[i].start_b, diff->hunk[i].count_b,
+					     &d);
+		free_blame_diff(diff);
+	} else
+		ret = diff_hunks(&file_p, parent->file_is_blob ? &parent->blob_oid : NULL,
+				 &file_o, target->file_is_blob ? &target->blob_oid : NULL,
+				 blame_chunk_cb, &d, sb->xdl_opts);
+	if (ret)
 		die("unable to generate diff (%s -> %s)",
 		    oid_to_hex(&parent->commit->object.oid),
 		    oid_to_hex(&target->commit->object.oid));
@@ -1129,7 +1373,8 @@ static void find_copy_in_blob(struct blame_scoreboard *sb,
 	 * file_p partially may match that image.
 	 */
 	memset(split, 0, sizeof(struct blame_entry [3]));
-	if (diff_hunks(file_p, &file_o, handle_split_cb, &d, sb->xdl_opts))
+	if (diff_hunks(file_p, parent->file_is_blob ? &parent->blob_oid : NULL,
+		       &file_o, NULL, handle_split_cb, &d, sb->xdl_opts))
 		die("unable to generate diff (%s)",
 		    oid_to_hex(&parent->commit->object.oid));
 	/* remainder, if any, all match the preimage */
@@ -1355,9 +1600,11 @@ static void pass_whole_blame(struct blame_scoreboard *sb,
 {
 	struct blame_entry *e, *suspects;
 
-	if (!porigin->file.ptr && origin->file.ptr) {
+	if (!porigin->file.ptr && origin->file.ptr &&
+	    !origin_blob_in_use(origin)) {
 		/* Steal its file */
 		porigin->file = origin->file;
+		porigin->file_is_blob = origin->file_is_blob;
 		origin->file.ptr = NULL;
 	}
 	suspects = origin->suspects;
@@ -1420,6 +1667,93 @@ static void distribute_blame(struct blame_scoreboard *sb, struct blame_entry *bl
 
 #define MAXSG 16
 
+/*
+ * Hand the diffs of origin against the parents pass_blame() is going
+ * to diff it against over to the worker threads.
+ */
+static void queue_blame_diffs(struct blame_scoreboard *sb,
+			      struct blame_origin *origin)
+{
+	struct rev_info *revs = sb->revs;
+	struct commit *commit = origin->commit;
+	struct commit_list *sg;
+	int i, num_sg;
+
+	if (origin->diffs_queued)
+		return;
+	origin->diffs_queued = 1;
+
+	num_sg = num_scapegoats(revs, commit, sb->reverse);
+	for (i = 0, sg = first_scapegoat(revs, commit, sb->reverse);
+	     i < num_sg && sg;
+	     sg = sg->next, i++) {
+		struct blame_origin *porigin;
+		struct blame_diff *diff;
+
+		if (parse_commit(sg->item))
+			continue;
+		porigin = find_origin(sb->repo, sg->item, origin);
+		if (!porigin)
+			continue;
+		if (oideq(&porigin->blob_oid, &origin->blob_oid)) {
+			/* pass_blame() will not diff at all */
+			blame_origin_decref(porigin);
+			break;
+		}
+		for (diff = origin->diffs; diff; diff = diff->next)
+			if (oideq(&diff->parent->blob_oid, &porigin->blob_oid))
+				break;
+		if (diff) {
+			blame_origin_decref(porigin);
+			continue;
+		}
+
+		diff = xcalloc(1, sizeof(*diff));
+		diff->parent = porigin;
+		diff->target = origin;
+		diff->xdl_opts = sb->xdl_opts;
+		fill_origin_blob(&revs->diffopt, porigin, &diff->file_p,
+				 &sb->num_read_blob);
+		fill_origin_blob(&revs->diffopt, origin, &diff->file_o,
+				 &sb->num_read_blob);
+		diff->next = origin->diffs;
+		origin->diffs = diff;
+
+		pthread_mutex_lock(&diff_pool.mutex);
+		porigin->diffs_in_flight++;
+		origin->diffs_in_flight++;
+		*diff_pool.queue_tail = diff;
+		diff_pool.queue_tail = &diff->next_queued;
+		pthread_cond_signal(&diff_pool.work_cond);
+		pthread_mutex_unlock(&diff_pool.mutex);
+	}
+}
+
+/*
+ * Queue the diffs for the origins that the commit about to be blamed
+ * and the next few commits waiting in the queue will need.
+ */
+static void queue_upcoming_blame_diffs(struct blame_scoreboard *sb,
+				       struct commit *commit)
+{
+	struct rev_info *revs = sb->revs;
+	int i, limit = 2 * diff_pool.nr_threads;
+
+	for (i = -1; i < sb->commits.nr && i < limit; i++) {
+		struct commit *c = i < 0 ? commit : sb->commits.array[i].data;
+		struct blame_origin *o;
+
+		if (!sb->reverse &&
+		    (parse_commit(c) ||
+		     (c->object.flags & UNINTERESTING) ||
+		     (revs->max_age != -1 && c->date < revs->max_age)))
+			continue;
+		for (o = get_blame_suspects(c); o; o = o->next)
+			if (o->suspects)
+				queue_blame_diffs(sb, o);
+	}
+}
+
 static void pass_blame(struct blame_scoreboard *sb, struct blame_origin *origin, int opt)
 {
 	struct rev_info *revs = sb->revs;
@@ -1565,6 +1899,326 @@ static void pass_blame(struct blame_scoreboard *sb, struct blame_origin *origin,
 		free(sg_origin);
 }
 
+/*
+ * The blame cache records the final blame of a whole file at a commit
+ * as a series of records, one per blame_entry in line order:
+ *
+ *   <lno> SP <num_lines> SP <s_lno> SP <commit> SP <path> NUL
+ *
+ * each optionally followed by the previous origin of its suspect:
+ *
+ *   "previous" SP <commit> SP <path> NUL
+ *
+ * Files are named after a hash of the commit, the path and the options
+ * that affect which lines get blamed on which commits, including the
+ * textconv driver the attributes select for the path.  What a commit
+ * id stands for can also change when replace refs, grafts or shallow
+ * boundaries come and go, so the cache is not used with any of them.
+ * Reading a file freshens its mtime, and "git gc" removes the files
+ * that were not used for a while; see prune_blame_cache().
+ */
+struct blame_cache_record {
+	int lno, num_lines, s_lno;
+	struct blame_origin *origin;
+};
+
+static char *blame_cache_path(struct blame_scoreboard *sb,
+			      struct commit *commit, const char *path)
+{
+	struct strbuf key = STRBUF_INIT;
+	struct object_id oid;
+	git_hash_ctx ctx;
+
+	strbuf_addf(&key, "%s %s%c%x %d %d %d %ld",
+		    oid_to_hex(&commit->object.oid), path, '\0',
+		    sb->xdl_opts, sb->no_whole_file_rename,
+		    sb->revs->first_parent_only,
+		    sb->revs->diffopt.flags.allow_textconv,
+		    git_xdiff_max_cost);
+	if (sb->revs->diffopt.flags.allow_textconv) {
+		struct userdiff_driver *drv;
+
+		drv = userdiff_find_by_path(sb->repo->index, path);
+		if (drv)
+			drv = userdiff_get_textconv(drv);
+		if (drv && drv->textconv)
+			strbuf_addf(&key, " %s %s", drv->name, drv->textconv);
+	}
+	the_hash_algo->init_fn(&ctx);
+	the_hash_algo->update_fn(&ctx, key.buf, key.len);
+	the_hash_algo->final_fn(oid.hash, &ctx);
+	strbuf_release(&key);
+
+	return git_pathdup("blame-cache/%s", oid_to_hex(&oid));
+}
+
+/*
+ * The history that a commit id stands for, and with it the blame of
+ * its files, depends on the replace refs, grafts and shallow
+ * boundaries of the repository; see commit_graph_compatible().
+ */
+static int blame_cache_compatible(struct repository *r)
+{
+	if (read_replace_refs) {
+		prepare_replace_object(r);
+		if (hashmap_get_size(&r->objects->replace_map->map))
+			return 0;
+	}
+
+	prepare_commit_graft(r);
+	if (r->parsed_objects && r->parsed_objects->grafts_nr)
+		return 0;
+	if (is_repository_shallow(r))
+		return 0;
+
+	return 1;
+}
+
+/*
+ * Parse "<commit> SP <path>" at *p into an origin, and move *p past
+ * the terminating NUL.
+ */
+static struct blame_origin *parse_cached_origin(struct blame_scoreboard *sb,
+						const char **p, const char *end)
+{
+	struct object_id oid;
+	struct commit *commit;
+	struct blame_origin *o;
+	const char *path;
+
+	if (parse_oid_hex(*p, &oid, &path) || *path++ != ' ')
+		return NULL;
+	*p = path + strlen(path) + 1;
+	if (*p > end)
+		return NULL;
+
+	commit = lookup_commit(sb->repo, &oid);
+	if (!commit || parse_commit(commit))
+		return NULL;
+	/* treat root commit as boundary, as assign_blame() does */
+	if (!commit->parents && !sb->show_root)
+		commit->object.flags |= UNINTERESTING;
+
+	o = get_origin(commit, path);
+	if (fill_blob_sha1_and_mode(sb->repo, o)) {
+		blame_origin_decref(o);
+		return NULL;
+	}
+	return o;
+}
+
+static void release_blame_cache_records(struct blame_cache_record *rec, int nr)
+{
+	int i;
+
+	for (i = 0; i < nr; i++)
+		blame_origin_decref(rec[i].origin);
+	free(rec);
+}
+
+static int read_blame_cache(struct blame_scoreboard *sb,
+			    struct blame_origin *origin,
+			    struct blame_cache_record **rec_out, int *nr_out)
+{
+	struct strbuf buf = STRBUF_INIT;
+	struct blame_cache_record *rec = NULL;
+	int nr = 0, alloc = 0, lno = 0;
+	const char *p, *end;
+	char *path;
+
+	path = blame_cache_path(sb, origin->commit, origin->path);
+	if (strbuf_read_file(&buf, path, 0) < 0) {
+		free(path);
+		return -1;
+	}
+	/* keep it from being pruned while it is in use */
+	utime(path, NULL);
+	free(path);
+
+	p = buf.buf;
+	end = buf.buf + buf.len;
+	while (p < end) {
+		struct blame_cache_record *r;
+		char *q;
+
+		ALLOC_GROW(rec, nr + 1, alloc);
+		r = &rec[nr];
+		r->lno = strtol(p, &q, 10);
+		if (*q != ' ')
+			goto corrupt;
+		r->num_lines = strtol(q + 1, &q, 10);
+		if (*q != ' ')
+			goto corrupt;
+		r->s_lno = strtol(q + 1, &q, 10);
+		if (*q != ' ' || r->lno != lno || r->num_lines <= 0 ||
+		    r->s_lno < 0)
+			goto corrupt;
+		p = q + 1;
+		r->origin = parse_cached_origin(sb, &p, end);
+		if (!r->origin)
+			goto corrupt;
+		nr++;
+		lno += r->num_lines;
+
+		if (skip_prefix(p, "previous ", &p)) {
+			struct blame_origin *previous;
+
+			previous = parse_cached_origin(sb, &p, end);
+			if (!previous)
+				goto corrupt;
+			if (!r->origin->previous)
+				r->origin->previous = previous;
+			else
+				blame_origin_decref(previous);
+		}
+	}
+	strbuf_release(&buf);
+	*rec_out = rec;
+	*nr_out = nr;
+	return 0;
+
+corrupt:
+	strbuf_release(&buf);
+	release_blame_cache_records(rec, nr);
+	return -1;
+}
+
+/*
+ * If the final blame of the whole of origin's file is in the blame
+ * cache, use it to blame all of origin's suspects at once and return
+ * 1; otherwise leave them alone and return 0.
+ */
+static int blame_from_cache(struct blame_scoreboard *sb,
+			    struct blame_origin *origin)
+{
+	struct blame_cache_record *rec;
+	struct blame_entry *e, *next;
+	int nr, total, i;
+
+	if (is_null_oid(&origin->commit->object.oid) ||
+	    read_blame_cache(sb, origin, &rec, &nr))
+		return 0;
+
+	total = nr ? rec[nr - 1].lno + rec[nr - 1].num_lines : 0;
+	for (e = origin->suspects; e; e = e->next) {
+		if (e->s_lno + e->num_lines > total) {
+			release_blame_cache_records(rec, nr);
+			return 0;
+		}
+	}
+
+	for (e = origin->suspects; e; e = next) {
+		int pos = e->s_lno, end = e->s_lno + e->num_lines;
+		int lo = 0, hi = nr;
+
+		/* find the record containing pos */
+		while (hi - lo > 1) {
+			int mi = lo + (hi - lo) / 2;
+			if (rec[mi].lno <= pos)
+				lo = mi;
+			else
+				hi = mi;
+		}
+		for (i = lo; pos < end; i++) {
+			struct blame_cache_record *r = &rec[i];
+			struct blame_entry *ent = xcalloc(1, sizeof(*ent));
+			int n = (r->lno + r->num_lines < end ?
+				 r->lno + r->num_lines : end) - pos;
+
+			ent->lno = e->lno + pos - e->s_lno;
+			ent->num_lines = n;
+			ent->s_lno = r->s_lno + pos - r->lno;
+			ent->suspect = blame_origin_incref(r->origin);
+			r->origin->guilty = 1;
+			if (sb->found_guilty_entry)
+				sb->found_guilty_entry(ent, sb->found_guilty_entry_data);
+			ent->next = sb->ent;
+			sb->ent = ent;
+			pos += n;
+		}
+		next = e->next;
+		blame_origin_decref(e->suspect);
+		free(e);
+	}
+	origin->suspects = NULL;
+
+	release_blame_cache_records(rec, nr);
+	return 1;
+}
+
+void blame_cache_write(struct blame_scoreboard *sb)
+{
+	struct lock_file lock = LOCK_INIT;
+	struct strbuf buf = STRBUF_INIT;
+	struct blame_entry *ent;
+	char *path = NULL;
+	int lno = 0;
+
+	if (!sb->use_cache || is_null_oid(&sb->final->object.oid))
+		return;
+
+	for (ent = sb->ent; ent; ent = ent->next) {
+		struct blame_origin *suspect = ent->suspect;
+
+		if (ent->lno != lno)
+			goto out;
+		strbuf_addf(&buf, "%d %d %d %s %s%c",
+			    ent->lno, ent->num_lines, ent->s_lno,
+			    oid_to_hex(&suspect->commit->object.oid),
+			    suspect->path, '\0');
+		if (suspect->previous)
+			strbuf_addf(&buf, "previous %s %s%c",
+				    oid_to_hex(&suspect->previous->commit->object.oid),
+				    suspect->previous->path, '\0');
+		lno += ent->num_lines;
+	}
+	if (lno != sb->num_lines)
+		goto out;
+
+	path = blame_cache_path(sb, sb->final, sb->path);
+	if (!access(path, F_OK) ||
+	    safe_create_leading_directories(path) ||
+	    hold_lock_file_for_update(&lock, path, 0) < 0)
+		goto out;
+	if (write_in_full(get_lock_file_fd(&lock), buf.buf, buf.len) < 0)
+		rollback_lock_file(&lock);
+	else
+		commit_lock_file(&lock);
+out:
+	free(path);
+	strbuf_release(&buf);
+}
+
+void prune_blame_cache(timestamp_t expire)
+{
+	struct strbuf path = STRBUF_INIT;
+	struct dirent *de;
+	size_t baselen;
+	DIR *dir;
+
+	strbuf_addstr(&path, git_path("blame-cache"));
+	dir = opendir(path.buf);
+	if (!dir)
+		goto out;
+	strbuf_addch(&path, '/');
+	baselen = path.len;
+	while ((de = readdir(dir)) != NULL) {
+		struct stat st;
+
+		if (is_dot_or_dotdot(de->d_name))
+			continue;
+		strbuf_setlen(&path, baselen);
+		strbuf_addstr(&path, de->d_name);
+		if (!stat(path.buf, &st) && st.st_mtime <= expire)
+			unlink_or_warn(path.buf);
+	}
+	closedir(dir);
+	strbuf_setlen(&path, baselen - 1);
+	rmdir(path.buf);
+out:
+	strbuf_release(&path);
+}
+
 /*
  * The main loop -- while we have blobs with lines whose true origin
  * is still unknown, pick one blob, and allow its lines to pass blames
@@ -1574,6 +2228,9 @@ void assign_blame(struct blame_scoreboard *sb, int opt)
 	struct rev_info *revs = sb->revs;
 	struct commit *commit = prio_queue_get(&sb->commits);
 
+	if (HAVE_THREADS && sb->num_threads > 1)
+		start_blame_diff_workers(sb->num_threads);
+
 	while (commit) {
 		struct blame_entry *ent;
 		struct blame_origin *suspect = get_blame_suspects(commit);
@@ -1595,7 +2252,13 @@ void assign_blame(struct blame_scoreboard *sb, int opt)
 		 */
 		blame_origin_incref(suspect);
 		parse_commit(commit);
-		if (sb->reverse ||
+		if (diff_pool.nr_threads)
+			queue_upcoming_blame_diffs(sb, commit);
+		if (sb->use_cache &&
+		    !(commit->object.flags & UNINTERESTING) &&
+		    blame_from_cache(sb, suspect))
+			; /* all of its suspects have been blamed */
+		else if (sb->reverse ||
 		    (!(commit->object.flags & UNINTERESTING) &&
 		     !(revs->max_age != -1 && commit->date < revs->max_age)))
 			pass_blame(sb, suspect, opt);
@@ -1631,6 +2294,8 @@ void assign_blame(struct blame_scoreboard *sb, int opt)
 		if (sb->debug) /* sanity */
 			sanity_check_refcnt(sb);
 	}
+
+	stop_blame_diff_workers();
 }
 
 static const char *get_next_line(const char *start, const char *end)
@@ -1783,6 +2448,9 @@ void setup_scoreboard(struct blame_scoreboard *sb,
 
 	init_blame_suspects(&blame_suspects);
 
+	if (sb->use_cache && !blame_cache_compatible(sb->repo))
+		sb->use_cache = 0;
+
 	if (sb->reverse && sb->contents_from)
 		die(_("--contents and --reverse do not blend well."));
 
@@ -57,6 +57,15 @@ struct blame_origin {
 	 * blame list instead of other commits
 	 */
 	char guilty;
+	/* file holds the blob_oid blob as is, not a textconv of it */
+	char file_is_blob;
+	/*
+	 * diffs against its parents computed ahead by worker threads,
+	 * and how many of those workers are using its file
+	 */
+	struct blame_diff *diffs;
+	int diffs_in_flight;
+	char diffs_queued;
 	char path[FLEX_ARRAY];
 };
 
@@ -142,6 +151,13 @@ struct blame_scoreboard {
 	int xdl_opts;
 	int no_whole_file_rename;
 	int debug;
+	/*
+	 * read and write the blame cache; only valid when blaming
+	 * without a range, --reverse, or move and copy detection
+	 */
+	int use_cache;
+	/* number of threads diffing origins against their parents */
+	int num_threads;
 
 	/* callbacks */
 	void(*on_sanity_fail)(struct blame_scoreboard *, int);
@@ -166,6 +182,9 @@ void blame_coalesce(struct blame_scoreboard *sb);
 void blame_sort_final(struct blame_scoreboard *sb);
 unsigned blame_entry_score(struct blame_scoreboard *sb, struct blame_entry *e);
 void assign_blame(struct blame_scoreboard *sb, int opt);
+void blame_cache_write(struct blame_scoreboard *sb);
+/* Remove the cached blames last used at or before "expire". */
+void prune_blame_cache(timestamp_t expire);
 const char *blame_nth_line(struct blame_scoreboard *sb, long lno);
 
 void init_scoreboard(struct blame_scoreboard *sb);
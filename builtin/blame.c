@@ -26,6 +26,7 @@
 #include "progress.h"
 #include "object-store.h"
 #include "blame.h"
+#include "thread-utils.h"
 #include "string-list.h"
 
 static char blame_usage[] = N_("git blame [<options>] [<rev-opts>] [<rev>] [--] <file>");
@@ -49,6 +50,8 @@ static int incremental;
 static int xdl_opts;
 static int abbrev = -1;
 static int no_whole_file_rename;
+static int use_blame_cache;
+static int blame_threads = 1;
 static int show_progress;
 static char repeated_meta_color[COLOR_MAXLEN];
 static int coloring_mode;
@@ -689,6 +692,19 @@ static int git_blame_config(const char *var, const char *value, void *cb)
 			*output_option &= ~OUTPUT_SHOW_EMAIL;
 		return 0;
 	}
+	if (!strcmp(var, "blame.cache")) {
+		use_blame_cache = git_config_bool(var, value);
+		return 0;
+	}
+	if (!strcmp(var, "blame.threads")) {
+		blame_threads = git_config_int(var, value);
+		if (blame_threads < 0)
+			die(_("invalid number of threads specified (%d) for %s"),
+			    blame_threads, var);
+		if (!blame_threads)
+			blame_threads = online_cpus();
+		return 0;
+	}
 	if (!strcmp(var, "blame.date")) {
 		if (!value)
 			return config_error_nonbool(var);
@@ -720,6 +736,11 @@ static int git_blame_config(const char *var, const char *value, void *cb)
 		}
 	}
 
+	if (!strcmp(var, "diff.linehashcache")) {
+		git_xdiff_line_cache_size = git_config_int(var, value);
+		return 0;
+	}
+
 	if (git_diff_heuristic_config(var, value, cb) < 0)
 		return -1;
 	if (userdiff_config(var, value) < 0)
@@ -728,6 +749,20 @@ static int git_blame_config(const char *var, const char *value, void *cb)
 	return git_default_config(var, value, cb);
 }
 
+/*
+ * Does the range of commits to dig through have a bottom, whose commits
+ * would be shown as boundaries instead of being blamed for lines?
+ */
+static int has_bottom(struct rev_info *revs)
+{
+	int i;
+
+	for (i = 0; i < revs->pending.nr; i++)
+		if (revs->pending.objects[i].item->flags & UNINTERESTING)
+			return 1;
+	return 0;
+}
+
 static int blame_copy_callback(const struct option *option, const char *arg, int unset)
 {
 	int *opt = option->value;
@@ -782,6 +817,7 @@ int cmd_blame(int argc, const char **argv, const char *prefix)
 	struct blame_origin *o;
 	struct blame_entry *ent = NULL;
 	long dashdash_pos, lno;
+	int whole_file;
 	struct progress_info pi = { NULL, 0 };
 
 	struct string_list range_list = STRING_LIST_INIT_NODUP;
@@ -993,9 +1029,13 @@ int cmd_blame(int argc, const char **argv, const char *prefix)
 	sb.contents_from = contents_from;
 	sb.reverse = reverse;
 	sb.repo = the_repository;
+	sb.use_cache = use_blame_cache && !reverse && !revs_file &&
+		!(opt & (PICKAXE_BLAME_MOVE | PICKAXE_BLAME_COPY)) &&
+		revs.max_age == -1 && !has_bottom(&revs);
 	setup_scoreboard(&sb, path, &o);
 	lno = sb.num_lines;
 
+	whole_file = !range_list.nr;
 	if (lno && !range_list.nr)
 		string_list_append(&range_list, "1");
 
@@ -1048,6 +1088,7 @@ int cmd_blame(int argc, const char **argv, const char *prefix)
 	sb.show_root = show_root;
 	sb.xdl_opts = xdl_opts;
 	sb.no_whole_file_rename = no_whole_file_rename;
+	sb.num_threads = blame_threads;
 
 	read_mailmap(&mailmap, NULL);
 
@@ -1069,6 +1110,9 @@ int cmd_blame(int argc, const char **argv, const char *prefix)
 
 	blame_coalesce(&sb);
 
+	if (whole_file)
+		blame_cache_write(&sb);
+
 	if (!(output_option & (OUTPUT_COLOR_LINE | OUTPUT_SHOW_AGE_WITH_COLOR)))
 		output_option |= coloring_mode;
 
@@ -17,6 +17,7 @@
 #include "revision.h"
 #include "list-objects.h"
 #include "commit-slab.h"
+#include "oidmap.h"
 
 #define MAX_TAGS	(FLAG_BITS - 1)
 
@@ -42,6 +43,7 @@ static struct string_list exclude_patterns = STRING_LIST_INIT_NODUP;
 static int always;
 static const char *suffix, *dirty, *broken;
 static struct commit_names commit_names;
+static int use_cache;
 
 /* diff-index command arguments to check if working tree is dirty. */
 static const char *diff_index_args[] = {
@@ -62,6 +64,22 @@ static const char *prio_names[] = {
 	N_("head"), N_("lightweight"), N_("annotated"),
 };
 
+/*
+ * The result of a previous search, keyed by the described commit:
+ * the peeled object name of the best candidate and its depth.
+ */
+struct cached_description {
+	struct oidmap_entry entry;
+	struct object_id name;
+	int depth;
+};
+
+#define DESCRIBE_CACHE_SIGNATURE "# describe-cache v1"
+
+static struct oidmap describe_cache = OIDMAP_INIT;
+static git_hash_ctx fingerprint_ctx;
+static int describe_cache_dirty;
+
 static int commit_name_neq(const void *unused_cmp_data,
 			   const void *entry,
 			   const void *entry_or_key,
@@ -210,9 +228,130 @@ static int get_name(const char *path, const struct object_id *oid, int flag, voi
 		prio = 0;
 
 	add_to_known_names(all ? path + 5 : path + 10, &peeled, prio, oid);
+
+	if (use_cache) {
+		the_hash_algo->update_fn(&fingerprint_ctx, path, strlen(path) + 1);
+		the_hash_algo->update_fn(&fingerprint_ctx, oid->hash,
+					 the_hash_algo->rawsz);
+		the_hash_algo->update_fn(&fingerprint_ctx, peeled.hash,
+					 the_hash_algo->rawsz);
+	}
 	return 0;
 }
 
+/*
+ * The outcome of a search depends only on the history, which never
+ * changes, and on the candidate names and the options that select the
+ * best one. The cache is tagged with a fingerprint of the latter and
+ * is thrown away when it no longer matches; otherwise new results are
+ * added to it as they are computed.
+ */
+static void finish_cache_fingerprint(struct strbuf *fingerprint)
+{
+	struct object_id hash;
+	struct strbuf options = STRBUF_INIT;
+
+	strbuf_addf(&options, "all=%d tags=%d first-parent=%d candidates=%d",
+		    all, tags, first_parent, max_candidates);
+	the_hash_algo->update_fn(&fingerprint_ctx, options.buf, options.len);
+	the_hash_algo->final_fn(hash.hash, &fingerprint_ctx);
+	strbuf_addstr(fingerprint, oid_to_hex(&hash));
+	strbuf_release(&options);
+}
+
+static void read_describe_cache(const char *path, const char *fingerprint)
+{
+	struct strbuf line = STRBUF_INIT;
+	FILE *fp;
+	const char *p;
+
+	oidmap_init(&describe_cache, 0);
+
+	fp = fopen_or_warn(path, "r");
+	if (!fp)
+		return;
+
+	if (strbuf_getline(&line, fp) ||
+	    !skip_prefix(line.buf, DESCRIBE_CACHE_SIGNATURE " ", &p) ||
+	    strcmp(p, fingerprint)) {
+		/* stale or unreadable; rebuild it from scratch */
+		describe_cache_dirty = 1;
+		goto done;
+	}
+
+	while (!strbuf_getline(&line, fp)) {
+		struct cached_description *e = xcalloc(1, sizeof(*e));
+
+		if (parse_oid_hex(line.buf, &e->entry.oid, &p) || *p++ != ' ' ||
+		    parse_oid_hex(p, &e->name, &p) || *p++ != ' ' ||
+		    strtol_i(p, 10, &e->depth) || e->depth < 0) {
+			warning(_("ignoring malformed describe cache entry '%s'"),
+				line.buf);
+			free(e);
+			describe_cache_dirty = 1;
+			continue;
+		}
+		free(oidmap_put(&describe_cache, e));
+	}
+
+done:
+	strbuf_release(&line);
+	fclose(fp);
+}
+
+static int cmp_cached_description(const void *a_, const void *b_)
+{
+	const struct cached_description *a = *(const struct cached_description **)a_;
+	const struct cached_description *b = *(const struct cached_description **)b_;
+
+	return oidcmp(&a->entry.oid, &b->entry.oid);
+}
+
+static void write_describe_cache(const char *path, const char *fingerprint)
+{
+	struct lock_file lk = LOCK_INIT;
+	struct cached_description **entries, *e;
+	struct oidmap_iter iter;
+	size_t i, nr = 0;
+	FILE *fp;
+
+	/* The cache is only an optimization; skip it if we cannot lock. */
+	if (hold_lock_file_for_update(&lk, path, 0) < 0)
+		return;
+
+	ALLOC_ARRAY(entries, hashmap_get_size(&describe_cache.map));
+	oidmap_iter_init(&describe_cache, &iter);
+	while ((e = oidmap_iter_next(&iter)))
+		entries[nr++] = e;
+	QSORT(entries, nr, cmp_cached_description);
+
+	fp = fdopen_lock_file(&lk, "w");
+	fprintf(fp, "%s %s\n", DESCRIBE_CACHE_SIGNATURE, fingerprint);
+	for (i = 0; i < nr; i++)
+		fprintf(fp, "%s %s %d\n", oid_to_hex(&entries[i]->entry.oid),
+			oid_to_hex(&entries[i]->name), entries[i]->depth);
+	if (commit_lock_file(&lk))
+		warning_errno(_("could not write describe cache '%s'"), path);
+
+	free(entries);
+}
+
+static void remember_description(struct commit *cmit,
+				 struct commit_name *name, int depth)
+{
+	struct cached_description *e;
+
+	if (!use_cache)
+		return;
+
+	e = xcalloc(1, sizeof(*e));
+	oidcpy(&e->entry.oid, &cmit->object.oid);
+	oidcpy(&e->name, &name->peeled);
+	e->depth = depth;
+	free(oidmap_put(&describe_cache, e));
+	describe_cache_dirty = 1;
+}
+
 struct possible_tag {
 	struct commit_name *name;
 	int depth;
@@ -320,6 +459,23 @@ static void describe_commit(struct object_id *oid, struct strbuf *dst)
 
 	if (!max_candidates)
 		die(_("no tag exactly matches '%s'"), oid_to_hex(&cmit->object.oid));
+	if (use_cache) {
+		struct cached_description *e;
+
+		e = oidmap_get(&describe_cache, &cmit->object.oid);
+		n = e ? find_commit_name(&e->name) : NULL;
+		if (n) {
+			if (debug)
+				fprintf(stderr, _("using cached description\n"));
+			append_name(n, dst);
+			if (abbrev)
+				append_suffix(e->depth, &cmit->object.oid, dst);
+			if (suffix)
+				strbuf_addstr(dst, suffix);
+			return;
+		}
+	}
+
 	if (debug)
 		fprintf(stderr, _("No exact match on refs or tags, searching to describe\n"));
 
@@ -445,6 +601,8 @@ static void describe_commit(struct object_id *oid, struct strbuf *dst)
 		}
 	}
 
+	remember_description(cmit, all_matches[0].name, all_matches[0].depth);
+
 	append_name(all_matches[0].name, dst);
 	if (abbrev)
 		append_suffix(all_matches[0].depth, &cmit->object.oid, dst);
@@ -527,9 +685,20 @@ static void describe(const char *arg, int last_one)
 	strbuf_release(&sb);
 }
 
+static int git_describe_config(const char *var, const char *value, void *cb)
+{
+	if (!strcmp(var, "describe.cache")) {
+		use_cache = git_config_bool(var, value);
+		return 0;
+	}
+	return git_default_config(var, value, cb);
+}
+
 int cmd_describe(int argc, const char **argv, const char *prefix)
 {
 	int contains = 0;
+	struct strbuf cache_path = STRBUF_INIT;
+	struct strbuf fingerprint = STRBUF_INIT;
 	struct option options[] = {
 		OPT_BOOL(0, "contains",   &contains, N_("find the tag that comes after the commit")),
 		OPT_BOOL(0, "debug",      &debug, N_("debug search strategy on stderr")),
@@ -557,7 +726,7 @@ int cmd_describe(int argc, const char **argv, const char *prefix)
 		OPT_END(),
 	};
 
-	git_config(git_default_config, NULL);
+	git_config(git_describe_config, NULL);
 	argc = parse_options(argc, argv, prefix, options, describe_usage, 0);
 	if (abbrev < 0)
 		abbrev = DEFAULT_ABBREV;
@@ -596,11 +765,21 @@ int cmd_describe(int argc, const char **argv, const char *prefix)
 		return cmd_name_rev(args.argc, args.argv, prefix);
 	}
 
+	if (use_cache)
+		the_hash_algo->init_fn(&fingerprint_ctx);
+
 	hashmap_init(&names, commit_name_neq, NULL, 0);
 	for_each_rawref(get_name, NULL);
 	if (!hashmap_get_size(&names) && !always)
 		die(_("No names found, cannot describe anything."));
 
+	if (use_cache) {
+		finish_cache_fingerprint(&fingerprint);
+		strbuf_git_common_path(&cache_path, the_repository,
+				       "describe-cache");
+		read_describe_cache(cache_path.buf, fingerprint.buf);
+	}
+
 	if (argc == 0) {
 		if (broken) {
 			struct child_process cp = CHILD_PROCESS_INIT;
@@ -656,5 +835,10 @@ int cmd_describe(int argc, const char **argv, const char *prefix)
 		while (argc-- > 0)
 			describe(*argv++, argc == 0);
 	}
+
+	if (use_cache && describe_cache_dirty)
+		write_describe_cache(cache_path.buf, fingerprint.buf);
+	strbuf_release(&cache_path);
+	strbuf_release(&fingerprint);
 	return 0;
 }
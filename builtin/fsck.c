@@ -20,6 +20,8 @@
 #include "object-store.h"
 #include "run-command.h"
 #include "worktree.h"
+#include "thread-utils.h"
+#include "connected.h"
 
 #define REACHABLE 0x0001
 #define SEEN      0x0002
@@ -43,6 +45,10 @@ static int verbose;
 static int show_progress = -1;
 static int show_dangling = 1;
 static int name_objects;
+static int nr_threads = -1;
+/* some object, reachable or not, points to an object we do not have */
+static int missing_links;
+static int config_threads = -1;
 #define ERROR_OBJECT 01
 #define ERROR_REACHABLE 02
 #define ERROR_PACK 04
@@ -96,6 +102,14 @@ static int fsck_config(const char *var, const char *value, void *cb)
 		return 0;
 	}
 
+	if (strcmp(var, "fsck.threads") == 0) {
+		config_threads = git_config_int(var, value);
+		if (config_threads < 0)
+			die(_("invalid number of threads specified (%d)"),
+			    config_threads);
+		return 0;
+	}
+
 	if (skip_prefix(var, "fsck.", &var)) {
 		fsck_set_msg_type(&fsck_obj_options, var, value);
 		return 0;
@@ -249,8 +263,11 @@ static void check_unreachable_object(struct object *obj)
 	 * to complain about it being unreachable (since it does
 	 * not exist).
 	 */
-	if (!(obj->flags & HAS_OBJ))
+	if (!(obj->flags & HAS_OBJ)) {
+		if (obj->flags & USED)
+			missing_links = 1;
 		return;
+	}
 
 	/*
 	 * Unreachable object that exists? Show it if asked to,
@@ -709,6 +726,7 @@ static struct option fsck_opts[] = {
 				N_("write dangling objects in .git/lost-found")),
 	OPT_BOOL(0, "progress", &show_progress, N_("show progress")),
 	OPT_BOOL(0, "name-objects", &name_objects, N_("show verbose names for reachable objects")),
+	OPT_INTEGER(0, "threads", &nr_threads, N_("use <n> threads to check packed objects")),
 	OPT_END(),
 };
 
@@ -747,6 +765,15 @@ int cmd_fsck(int argc, const char **argv, const char *prefix)
 
 	git_config(fsck_config, NULL);
 
+	if (nr_threads < 0)
+		nr_threads = config_threads;
+	if (!HAVE_THREADS && nr_threads > 1) {
+		warning(_("no threads support, ignoring --threads"));
+		nr_threads = 1;
+	}
+	if (nr_threads <= 0)
+		nr_threads = HAVE_THREADS ? online_cpus() : 1;
+
 	if (connectivity_only) {
 		for_each_loose_object(mark_loose_for_connectivity, NULL, 0);
 		for_each_packed_object(mark_packed_for_connectivity, NULL, 0);
@@ -779,7 +806,7 @@ int cmd_fsck(int argc, const char **argv, const char *prefix)
 			     p = p->next) {
 				/* verify gives error messages itself */
 				if (verify_pack(p, fsck_obj_buffer,
-						progress, count))
+						progress, count, nr_threads))
 					errors_found |= ERROR_PACK;
 				count += p->num_objects;
 			}
@@ -856,6 +883,19 @@ int cmd_fsck(int argc, const char **argv, const char *prefix)
 
 	check_connectivity();
 
+	if (connectivity_journal_enabled() && check_full && !connectivity_only) {
+		/*
+		 * We have looked at the links of every object we have, so
+		 * unless something is missing, every local pack is known
+		 * to be connected.
+		 */
+		if (errors_found & (ERROR_OBJECT | ERROR_REACHABLE | ERROR_PACK) ||
+		    missing_links)
+			clear_connectivity_journal();
+		else if (write_connectivity_journal())
+			error(_("unable to write connectivity journal"));
+	}
+
 	if (!git_config_get_bool("core.commitgraph", &i) && i) {
 		struct child_process commit_graph_verify = CHILD_PROCESS_INIT;
 		const char *verify_argv[] = { "commit-graph", "verify", NULL, NULL, NULL };
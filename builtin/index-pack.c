@@ -14,6 +14,7 @@
 #include "thread-utils.h"
 #include "packfile.h"
 #include "object-store.h"
+#include "connected.h"
 
 static const char index_pack_usage[] =
 "git index-pack [-v] [-o <index-file>] [--keep | --keep=<msg>] [--verify] [--strict] (<pack-file> | --stdin [--fix-thin] [<pack-file>])";
@@ -82,6 +83,13 @@ static int verbose;
 static int show_resolving_progress;
 static int show_stat;
 static int check_self_contained_and_connected;
+/*
+ * Walk the links of received objects, as with --strict, so that the
+ * pack can be added to the connectivity journal if all of them lead
+ * into packs already in the journal.
+ */
+static int record_connected;
+static int edges_connected = 1;
 
 static struct progress *progress;
 
@@ -200,6 +208,11 @@ static unsigned check_object(struct object *obj)
 	if (!(obj->flags & FLAG_CHECKED)) {
 		unsigned long size;
 		int type = oid_object_info(the_repository, &obj->oid, &size);
+		if (type <= 0 && !strict) {
+			/* e.g. the parents of a shallow commit */
+			edges_connected = 0;
+			return 1;
+		}
 		if (type <= 0)
 			die(_("did not receive expected object %s"),
 			      oid_to_hex(&obj->oid));
@@ -207,6 +220,9 @@ static unsigned check_object(struct object *obj)
 			die(_("object %s: expected type %s, found %s"),
 			    oid_to_hex(&obj->oid),
 			    type_name(obj->type), type_name(type));
+		if (record_connected && edges_connected &&
+		    !object_in_connectivity_journal(&obj->oid))
+			edges_connected = 0;
 		obj->flags |= FLAG_CHECKED;
 		return 1;
 	}
@@ -804,7 +820,7 @@ static void sha1_object(const void *data, struct object_entry *obj_entry,
 		free(has_data);
 	}
 
-	if (strict || do_fsck_object) {
+	if (strict || do_fsck_object || record_connected) {
 		read_lock();
 		if (type == OBJ_BLOB) {
 			struct blob *blob = lookup_blob(the_repository, oid);
@@ -834,7 +850,8 @@ static void sha1_object(const void *data, struct object_entry *obj_entry,
 			if (do_fsck_object &&
 			    fsck_object(obj, buf, size, &fsck_options))
 				die(_("fsck error in packed object"));
-			if (strict && fsck_walk(obj, NULL, &fsck_options))
+			if ((strict || record_connected) &&
+			    fsck_walk(obj, NULL, &fsck_options))
 				die(_("Not all child objects of %s are reachable"), oid_to_hex(&obj->oid));
 
 			if (obj->type == OBJ_TREE) {
@@ -1358,6 +1375,13 @@ static void fix_unresolved_deltas(struct hashfile *f)
 		if (check_object_signature(&d->oid, base_obj->data,
 				base_obj->size, type_name(type)))
 			die(_("local object %s is corrupt"), oid_to_hex(&d->oid));
+		/*
+		 * We do not look at the links of the bases we append, so
+		 * whatever they need must already be known to be there.
+		 */
+		if (record_connected && edges_connected &&
+		    !object_in_connectivity_journal(&d->oid))
+			edges_connected = 0;
 		base_obj->obj = append_obj_to_pack(f, d->oid.hash,
 					base_obj->data, base_obj->size, type);
 		find_unresolved_deltas(base_obj);
@@ -1758,6 +1782,8 @@ int cmd_index_pack(int argc, const char **argv, const char *prefix)
 	}
 	if (strict)
 		opts.flags |= WRITE_IDX_STRICT;
+	if (from_stdin && !verify && connectivity_journal_enabled())
+		record_connected = 1;
 
 	if (HAVE_THREADS && !nr_threads) {
 		nr_threads = online_cpus();
@@ -1779,7 +1805,7 @@ int cmd_index_pack(int argc, const char **argv, const char *prefix)
 	conclude_pack(fix_thin_pack, curr_pack, pack_hash);
 	free(ofs_deltas);
 	free(ref_deltas);
-	if (strict)
+	if (strict || record_connected)
 		foreign_nr = check_objects();
 
 	if (show_stat)
@@ -1802,6 +1828,9 @@ int cmd_index_pack(int argc, const char **argv, const char *prefix)
 	if (do_fsck_object && fsck_finish(&fsck_options))
 		die(_("fsck error in pack objects"));
 
+	if (record_connected && edges_connected)
+		add_to_connectivity_journal(pack_hash);
+
 	free(objects);
 	strbuf_release(&index_name_buf);
 	if (pack_name == NULL)
@@ -34,6 +34,8 @@
 #include "commit-reach.h"
 #include "interdiff.h"
 #include "range-diff.h"
+#include "xdiff-interface.h"
+#include "thread-utils.h"
 
 #define MAIL_DEFAULT_WRAP 72
 
@@ -47,6 +49,7 @@ static int default_show_signature;
 static int decoration_style;
 static int decoration_given;
 static int use_mailmap_config;
+static int log_threads = 1;
 static const char *fmt_patch_subject_prefix = "PATCH";
 static const char *fmt_pretty;
 
@@ -364,9 +367,89 @@ static void finish_early_output(struct rev_info *rev)
 	show_early_header(rev, "done", n);
 }
 
+/*
+ * With log.threads, the walk runs up to "size" commits ahead of the
+ * commit being shown, and the diffs of the commits in between are
+ * computed by worker threads in the meantime.  The commits are still
+ * shown one at a time, in order, by log_tree_commit().
+ */
+struct log_window {
+	struct log_window_entry {
+		struct commit *commit;
+		struct diff_prefetch prefetch;
+	} *entry;
+	int nr, size;
+	int walk_done;
+};
+
+static void setup_log_window(struct rev_info *rev, struct log_window *w)
+{
+	int nr_threads;
+
+	memset(w, 0, sizeof(*w));
+	/*
+	 * The graph, reflog selectors, linear breaks and boundary
+	 * commits depend on the state of the walk when each commit is
+	 * shown.
+	 */
+	if (log_threads < 2 || rev->graph || rev->reflog_info ||
+	    rev->track_linear || (rev->boundary && rev->max_count >= 0))
+		return;
+	nr_threads = xdi_start_prefetch(log_threads);
+	if (!nr_threads)
+		return;
+	w->size = 4 * nr_threads;
+	ALLOC_ARRAY(w->entry, w->size);
+	/* the walk ends while the commits in the window are still shown */
+	rev->keep_saved_parents = 1;
+}
+
+static struct commit *next_log_commit(struct rev_info *rev, struct log_window *w)
+{
+	if (!w->size)
+		return get_revision(rev);
+
+	while (w->nr < w->size && !w->walk_done) {
+		struct log_window_entry *e = &w->entry[w->nr];
+
+		e->commit = get_revision(rev);
+		if (!e->commit) {
+			w->walk_done = 1;
+			break;
+		}
+		memset(&e->prefetch, 0, sizeof(e->prefetch));
+		log_tree_prefetch(rev, e->commit, &e->prefetch);
+		w->nr++;
+	}
+	return w->nr ? w->entry[0].commit : NULL;
+}
+
+static void shown_log_commit(struct log_window *w, int revived)
+{
+	if (!w->size)
+		return;
+	diff_prefetch_release(&w->entry[0].prefetch);
+	w->nr--;
+	MOVE_ARRAY(w->entry, w->entry + 1, w->nr);
+	/* get_revision() may have stopped short of max_count */
+	if (revived)
+		w->walk_done = 0;
+}
+
+static void finish_log_window(struct rev_info *rev, struct log_window *w)
+{
+	if (!w->size)
+		return;
+	free_saved_parents(rev);
+	rev->keep_saved_parents = 0;
+	xdi_stop_prefetch();
+	free(w->entry);
+}
+
 static int cmd_log_walk(struct rev_info *rev)
 {
 	struct commit *commit;
+	struct log_window window;
 	int saved_nrl = 0;
 	int saved_dcctc = 0, close_file = rev->diffopt.close_file;
 
@@ -385,13 +468,18 @@ static int cmd_log_walk(struct rev_info *rev)
 	 * retain that state information if replacing rev->diffopt in this loop
 	 */
 	rev->diffopt.close_file = 0;
-	while ((commit = get_revision(rev)) != NULL) {
-		if (!log_tree_commit(rev, commit) && rev->max_count >= 0)
+	setup_log_window(rev, &window);
+	while ((commit = next_log_commit(rev, &window)) != NULL) {
+		int revived = 0;
+
+		if (!log_tree_commit(rev, commit) && rev->max_count >= 0) {
 			/*
 			 * We decremented max_count in get_revision,
 			 * but we didn't actually show the commit.
 			 */
 			rev->max_count++;
+			revived = 1;
+		}
 		if (!rev->reflog_info) {
 			/*
 			 * We may show a given commit multiple times when
@@ -405,7 +493,9 @@ static int cmd_log_walk(struct rev_info *rev)
 			saved_nrl = rev->diffopt.needed_rename_limit;
 		if (rev->diffopt.degraded_cc_to_c)
 			saved_dcctc = 1;
+		shown_log_commit(&window, revived);
 	}
+	finish_log_window(rev, &window);
 	rev->diffopt.degraded_cc_to_c = saved_dcctc;
 	rev->diffopt.needed_rename_limit = saved_nrl;
 	if (close_file)
@@ -426,6 +516,15 @@ static int git_log_config(const char *var, const char *value, void *cb)
 		return git_config_string(&fmt_pretty, var, value);
 	if (!strcmp(var, "format.subjectprefix"))
 		return git_config_string(&fmt_patch_subject_prefix, var, value);
+	if (!strcmp(var, "log.threads")) {
+		log_threads = git_config_int(var, value);
+		if (log_threads < 0)
+			die(_("invalid number of threads specified (%d) for %s"),
+			    log_threads, var);
+		if (!log_threads)
+			log_threads = online_cpus();
+		return 0;
+	}
 	if (!strcmp(var, "log.abbrevcommit")) {
 		default_abbrev_commit = git_config_bool(var, value);
 		return 0;
@@ -1798,13 +1897,22 @@ int cmd_format_patch(int argc, const char **argv, const char *prefix)
 			continue;
 		}
 
-		if (ignore_if_in_upstream && has_commit_patch_id(commit, &ids))
-			continue;
-
 		nr++;
 		REALLOC_ARRAY(list, nr);
 		list[nr - 1] = commit;
 	}
+	if (ignore_if_in_upstream && nr) {
+		struct patch_id **found;
+		int kept = 0;
+
+		ALLOC_ARRAY(found, nr);
+		has_commit_patch_ids(list, nr, &ids, found);
+		for (i = 0; i < nr; i++)
+			if (!found[i])
+				list[kept++] = list[i];
+		nr = kept;
+		free(found);
+	}
 	if (nr == 0)
 		/* nothing to do */
 		goto done;
@@ -2020,7 +2128,10 @@ int cmd_cherry(int argc, const char **argv, const char *prefix)
 	struct rev_info revs;
 	struct patch_ids ids;
 	struct commit *commit;
-	struct commit_list *list = NULL;
+	struct commit_list *list = NULL, *l;
+	struct commit **commits;
+	struct patch_id **found;
+	int i, nr = 0;
 	struct branch *current_branch;
 	const char *upstream;
 	const char *head = "HEAD";
@@ -2083,16 +2194,20 @@ int cmd_cherry(int argc, const char **argv, const char *prefix)
 		commit_list_insert(commit, &list);
 	}
 
-	while (list) {
-		char sign = '+';
+	for (l = list; l; l = l->next)
+		nr++;
+	ALLOC_ARRAY(commits, nr);
+	ALLOC_ARRAY(found, nr);
+	for (i = 0, l = list; l; l = l->next)
+		commits[i++] = l->item;
+	has_commit_patch_ids(commits, nr, &ids, found);
 
-		commit = list->item;
-		if (has_commit_patch_id(commit, &ids))
-			sign = '-';
-		print_commit(sign, commit, verbose, abbrev, revs.diffopt.file);
-		list = list->next;
-	}
+	for (i = 0; i < nr; i++)
+		print_commit(found[i] ? '-' : '+', commits[i], verbose, abbrev,
+			     revs.diffopt.file);
 
+	free(commits);
+	free(found);
 	free_patch_ids(&ids);
 	return 0;
 }
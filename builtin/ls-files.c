@@ -295,6 +295,67 @@ static void construct_fullname(struct strbuf *out, const struct repository *repo
 	strbuf_addstr(out, ce->name);
 }
 
+static void show_cached_ce(struct repository *repo, struct dir_struct *dir,
+			   const struct cache_entry *ce, struct strbuf *fullname)
+{
+	construct_fullname(fullname, repo, ce);
+
+	if ((dir->flags & DIR_SHOW_IGNORED) &&
+	    !ce_excluded(dir, repo->index, fullname->buf, ce))
+		return;
+	if (show_unmerged && !ce_stage(ce))
+		return;
+	if (ce->ce_flags & CE_UPDATE)
+		return;
+	show_ce(repo, dir, ce, fullname->buf,
+		ce_stage(ce) ? tag_unmerged :
+		(ce_skip_worktree(ce) ? tag_skip_worktree :
+		 tag_cached));
+}
+
+struct show_in_place_data {
+	struct repository *repo;
+	struct dir_struct *dir;
+	struct strbuf fullname;
+};
+
+static int show_in_place(const struct cache_entry *ce, void *cb_data)
+{
+	struct show_in_place_data *data = cb_data;
+
+	show_cached_ce(data->repo, data->dir, ce, &data->fullname);
+	return 0;
+}
+
+/*
+ * Showing only the cached entries under the common prefix needs
+ * neither the rest of the index nor its extensions, so they can be
+ * shown as they are decoded from the index file (see
+ * index.scanInPlace). Returns 0 if that cannot be done.
+ */
+static int show_files_in_place(struct repository *repo, struct dir_struct *dir,
+			       const char *max_prefix)
+{
+	struct show_in_place_data data;
+	int ret;
+
+	if (show_others || show_killed || show_deleted || show_modified ||
+	    show_resolve_undo || with_tree || show_fsmonitor_bit ||
+	    show_eol || recurse_submodules ||
+	    (dir->flags & DIR_SHOW_IGNORED) ||
+	    (pathspec.magic & PATHSPEC_ATTR))
+		return 0;
+
+	data.repo = repo;
+	data.dir = dir;
+	strbuf_init(&data.fullname, 0);
+	ret = for_each_index_file_entry(repo->index_file,
+					max_prefix, max_prefix_len,
+					show_in_place, &data);
+	strbuf_release(&data.fullname);
+	return ret >= 0;
+}
+
 static void show_files(struct repository *repo, struct dir_struct *dir)
 {
 	int i;
@@ -311,23 +372,9 @@ static void show_files(struct repository *repo, struct dir_struct *dir)
 			show_killed_files(repo->index, dir);
 	}
 	if (show_cached || show_stage) {
-		for (i = 0; i < repo->index->cache_nr; i++) {
-			const struct cache_entry *ce = repo->index->cache[i];
-
-			construct_fullname(&fullname, repo, ce);
-
-			if ((dir->flags & DIR_SHOW_IGNORED) &&
-			    !ce_excluded(dir, repo->index, fullname.buf, ce))
-				continue;
-			if (show_unmerged && !ce_stage(ce))
-				continue;
-			if (ce->ce_flags & CE_UPDATE)
-				continue;
-			show_ce(repo, dir, ce, fullname.buf,
-				ce_stage(ce) ? tag_unmerged :
-				(ce_skip_worktree(ce) ? tag_skip_worktree :
-				 tag_cached));
-		}
+		for (i = 0; i < repo->index->cache_nr; i++)
+			show_cached_ce(repo, dir, repo->index->cache[i],
+				       &fullname);
 	}
 	if (show_deleted || show_modified) {
 		for (i = 0; i < repo->index->cache_nr; i++) {
@@ -588,9 +635,6 @@ int cmd_ls_files(int argc, const char **argv, const char *cmd_prefix)
 		prefix_len = strlen(prefix);
 	git_config(git_default_config, NULL);
 
-	if (repo_read_index(the_repository) < 0)
-		die("index file corrupt");
-
 	argc = parse_options(argc, argv, prefix, builtin_ls_files_options,
 			ls_files_usage, 0);
 	el = add_exclude_list(&dir, EXC_CMDL, "--exclude option");
@@ -648,8 +692,6 @@ int cmd_ls_files(int argc, const char **argv, const char *cmd_prefix)
 		max_prefix = common_prefix(&pathspec);
 	max_prefix_len = get_common_prefix_len(max_prefix);
 
-	prune_index(the_repository->index, max_prefix, max_prefix_len);
-
 	/* Treat unmatching pathspec elements as errors */
 	if (pathspec.nr && error_unmatch)
 		ps_matched = xcalloc(pathspec.nr, 1);
@@ -662,20 +704,44 @@ int cmd_ls_files(int argc, const char **argv, const char *cmd_prefix)
 	      show_killed || show_modified || show_resolve_undo))
 		show_cached = 1;
 
-	if (with_tree) {
+	if (!show_files_in_place(the_repository, &dir, max_prefix)) {
 		/*
-		 * Basic sanity check; show-stages and show-unmerged
-		 * would not make any sense with this option.
+		 * Only the entries under the common prefix are shown, so
+		 * unless we need extensions or paths outside of it (to
+		 * look for untracked files or attributes), that is all we
+		 * need to read.
 		 */
-		if (show_stage || show_unmerged)
-			die("ls-files --with-tree is incompatible with -s or -u");
-		overlay_tree_on_index(the_repository->index, with_tree, max_prefix);
-	}
+		if (show_others || show_killed || show_resolve_undo ||
+		    with_tree || show_fsmonitor_bit ||
+		    show_eol || recurse_submodules ||
+		    (dir.flags & DIR_SHOW_IGNORED) ||
+		    (pathspec.magic & PATHSPEC_ATTR)) {
+			if (repo_read_index(the_repository) < 0)
+				die("index file corrupt");
+		} else if (read_index_partial(the_repository->index,
+					      the_repository->index_file,
+					      the_repository->gitdir,
+					      max_prefix, max_prefix_len) < 0) {
+			die("index file corrupt");
+		}
 
-	show_files(the_repository, &dir);
+		prune_index(the_repository->index, max_prefix, max_prefix_len);
 
-	if (show_resolve_undo)
-		show_ru_info(the_repository->index);
+		if (with_tree) {
+			/*
+			 * Basic sanity check; show-stages and show-unmerged
+			 * would not make any sense with this option.
+			 */
+			if (show_stage || show_unmerged)
+				die("ls-files --with-tree is incompatible with -s or -u");
+			overlay_tree_on_index(the_repository->index, with_tree, max_prefix);
+		}
+
+		show_files(the_repository, &dir);
+
+		if (show_resolve_undo)
+			show_ru_info(the_repository->index);
+	}
 
 	if (ps_matched) {
 		int bad;
@@ -8,6 +8,8 @@
 #include "parse-options.h"
 #include "sha1-lookup.h"
 #include "commit-slab.h"
+#include "commit-graph.h"
+#include "prio-queue.h"
 
 #define CUTOFF_DATE_SLOP 86400 /* one day */
 
@@ -22,6 +24,7 @@ typedef struct rev_name {
 define_commit_slab(commit_rev_name, struct rev_name *);
 
 static timestamp_t cutoff = TIME_MAX;
+static timestamp_t generation_cutoff = GENERATION_NUMBER_INFINITY;
 static struct commit_rev_name rev_names;
 
 /* How many generations are maximally preferred over _one_ merge traversal? */
@@ -77,69 +80,139 @@ static int is_better_name(struct rev_name *name,
 	return 0;
 }
 
-static void name_rev(struct commit *commit,
-		const char *tip_name, timestamp_t taggerdate,
-		int generation, int distance, int from_tag,
-		int deref)
+/*
+ * A commit below the cutoff cannot be on a path from any tip to one of
+ * the commits we were asked to name. Generation numbers give an exact
+ * cut when both sides come from the commit-graph; otherwise we fall back
+ * to the commit date with some slop for clock skew.
+ */
+static int commit_is_before_cutoff(struct commit *commit)
+{
+	if (generation_cutoff != GENERATION_NUMBER_ZERO &&
+	    generation_cutoff != GENERATION_NUMBER_INFINITY)
+		return commit->generation < generation_cutoff;
+	return commit->date < cutoff;
+}
+
+static struct rev_name *create_or_update_name(struct commit *commit,
+					      const char *tip_name,
+					      timestamp_t taggerdate,
+					      int generation, int distance,
+					      int from_tag)
 {
 	struct rev_name *name = get_commit_rev_name(commit);
-	struct commit_list *parents;
-	int parent_number = 1;
-	char *to_free = NULL;
 
-	parse_commit(commit);
+	if (name == NULL) {
+		name = xmalloc(sizeof(rev_name));
+		set_commit_rev_name(commit, name);
+	} else if (!is_better_name(name, tip_name, taggerdate,
+				   generation, distance, from_tag)) {
+		return NULL;
+	}
+
+	name->tip_name = tip_name;
+	name->taggerdate = taggerdate;
+	name->generation = generation;
+	name->distance = distance;
+	name->from_tag = from_tag;
+
+	return name;
+}
+
+static char *get_parent_name(const struct rev_name *name, int parent_number)
+{
+	size_t len;
+
+	strip_suffix(name->tip_name, "^0", &len);
+	if (name->generation > 0)
+		return xstrfmt("%.*s~%d^%d", (int)len, name->tip_name,
+			       name->generation, parent_number);
+	else
+		return xstrfmt("%.*s^%d", (int)len, name->tip_name,
+			       parent_number);
+}
+
+/*
+ * Propagate the name of 'start_commit' to its ancestors. This used to
+ * recurse once per commit, which overflowed the stack on deep histories;
+ * instead keep the commits still to visit on an explicit stack, pushing
+ * the parents of a commit so that its first parent is visited first.
+ */
+static void name_rev(struct commit *start_commit,
+		const char *tip_name, timestamp_t taggerdate,
+		int from_tag, int deref)
+{
+	struct prio_queue queue = { NULL };
+	struct commit *commit;
+	struct commit **parents_to_queue = NULL;
+	size_t parents_to_queue_nr, parents_to_queue_alloc = 0;
+	char *to_free = NULL;
 
-	if (commit->date < cutoff)
+	parse_commit(start_commit);
+	if (commit_is_before_cutoff(start_commit))
 		return;
 
-	if (deref) {
+	if (deref)
 		tip_name = to_free = xstrfmt("%s^0", tip_name);
 
-		if (generation)
-			die("generation: %d, but deref?", generation);
-	}
-
-	if (name == NULL) {
-		name = xmalloc(sizeof(rev_name));
-		set_commit_rev_name(commit, name);
-		goto copy_data;
-	} else if (is_better_name(name, tip_name, taggerdate,
-				  generation, distance, from_tag)) {
-copy_data:
-		name->tip_name = tip_name;
-		name->taggerdate = taggerdate;
-		name->generation = generation;
-		name->distance = distance;
-		name->from_tag = from_tag;
-	} else {
+	if (!create_or_update_name(start_commit, tip_name, taggerdate, 0, 0,
+				   from_tag)) {
 		free(to_free);
 		return;
 	}
 
-	for (parents = commit->parents;
-			parents;
-			parents = parents->next, parent_number++) {
-		if (parent_number > 1) {
-			size_t len;
-			char *new_name;
-
-			strip_suffix(tip_name, "^0", &len);
-			if (generation > 0)
-				new_name = xstrfmt("%.*s~%d^%d", (int)len, tip_name,
-						   generation, parent_number);
-			else
-				new_name = xstrfmt("%.*s^%d", (int)len, tip_name,
-						   parent_number);
-
-			name_rev(parents->item, new_name, taggerdate, 0,
-				 distance + MERGE_TRAVERSAL_WEIGHT,
-				 from_tag, 0);
-		} else {
-			name_rev(parents->item, tip_name, taggerdate,
-				 generation + 1, distance + 1,
-				 from_tag, 0);
+	prio_queue_put(&queue, start_commit);
+
+	while ((commit = prio_queue_get(&queue))) {
+		struct rev_name *name = get_commit_rev_name(commit);
+		struct commit_list *parents;
+		int parent_number = 1;
+
+		parents_to_queue_nr = 0;
+
+		for (parents = commit->parents;
+				parents;
+				parents = parents->next, parent_number++) {
+			struct commit *parent = parents->item;
+			struct rev_name *parent_name;
+			int generation, distance;
+
+			parse_commit(parent);
+			if (commit_is_before_cutoff(parent))
+				continue;
+
+			if (parent_number > 1) {
+				generation = 0;
+				distance = name->distance + MERGE_TRAVERSAL_WEIGHT;
+			} else {
+				generation = name->generation + 1;
+				distance = name->distance + 1;
+			}
+
+			parent_name = create_or_update_name(parent, name->tip_name,
+							    taggerdate,
+							    generation, distance,
+							    from_tag);
+			if (!parent_name)
+				continue;
+
+			if (parent_number > 1)
+				parent_name->tip_name =
+					get_parent_name(name, parent_number);
+
+			ALLOC_GROW(parents_to_queue, parents_to_queue_nr + 1,
+				   parents_to_queue_alloc);
+			parents_to_queue[parents_to_queue_nr++] = parent;
 		}
+
+		/* The first parent must come out first from the stack */
+		while (parents_to_queue_nr)
+			prio_queue_put(&queue,
+				       parents_to_queue[--parents_to_queue_nr]);
 	}
+
+	clear_prio_queue(&queue);
+	free(parents_to_queue);
 }
 
 static int subpath_matches(const char *path, const char *filter)
@@ -273,8 +346,7 @@ static int name_ref(const char *path, const struct object_id *oid, int flags, vo
 		if (taggerdate == TIME_MAX)
 			taggerdate = ((struct commit *)o)->date;
 		path = name_ref_abbrev(path, can_abbreviate_output);
-		name_rev(commit, xstrdup(path), taggerdate, 0, 0,
-			 from_tag, deref);
+		name_rev(commit, xstrdup(path), taggerdate, from_tag, deref);
 	}
 	return 0;
 }
@@ -470,6 +542,8 @@ int cmd_name_rev(int argc, const char **argv, const char *prefix)
 		if (commit) {
 			if (cutoff > commit->date)
 				cutoff = commit->date;
+			if (generation_cutoff > commit->generation)
+				generation_cutoff = commit->generation;
 		}
 
 		if (peel_tag) {
@@ -483,8 +557,15 @@ int cmd_name_rev(int argc, const char **argv, const char *prefix)
 		add_object_array(object, *argv, &revs);
 	}
 
-	if (cutoff)
-		cutoff = cutoff - CUTOFF_DATE_SLOP;
+	if (cutoff) {
+		/* check for underflow */
+		if (cutoff > CUTOFF_DATE_SLOP)
+			cutoff = cutoff - CUTOFF_DATE_SLOP;
+		else
+			cutoff = 0;
+	}
+	if (all || transform_stdin || !generation_numbers_enabled(the_repository))
+		generation_cutoff = GENERATION_NUMBER_INFINITY;
 	for_each_ref(name_ref, &data);
 
 	if (transform_stdin) {
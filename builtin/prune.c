@@ -7,6 +7,7 @@
 #include "parse-options.h"
 #include "progress.h"
 #include "object-store.h"
+#include "connected.h"
 
 static const char * const prune_usage[] = {
 	N_("git prune [-n] [-v] [--progress] [--expire <time>] [--] [<head>...]"),
@@ -16,6 +17,7 @@ static int show_only;
 static int verbose;
 static timestamp_t expire;
 static int show_progress = -1;
+static int pruned_objects;
 
 static int prune_tmp_file(const char *fullpath)
 {
@@ -56,8 +58,8 @@ static int prune_object(const struct object_id *oid, const char *fullpath,
 		printf("%s %s\n", oid_to_hex(oid),
 		       (type > 0) ? type_name(type) : "unknown");
 	}
-	if (!show_only)
-		unlink_or_warn(fullpath);
+	if (!show_only && !unlink_or_warn(fullpath))
+		pruned_objects++;
 	return 0;
 }
 
@@ -155,6 +157,13 @@ int cmd_prune(int argc, const char **argv, const char *prefix)
 	for_each_loose_file_in_objdir(get_object_directory(), prune_object,
 				      prune_cruft, prune_subdir, NULL);
 
+	/*
+	 * An unreachable object in a pack may point to what we just
+	 * deleted, so the journal can no longer vouch for any pack.
+	 */
+	if (pruned_objects && connectivity_journal_enabled())
+		clear_connectivity_journal();
+
 	prune_packed_objects(show_only ? PRUNE_PACKED_DRY_RUN : 0);
 	remove_temporary_files(get_object_directory());
 	s = mkpathdup("%s/pack", get_object_directory());
@@ -10,6 +10,7 @@
 #include "argv-array.h"
 #include "midx.h"
 #include "packfile.h"
+#include "connected.h"
 #include "object-store.h"
 
 static int delta_base_offset = 1;
@@ -284,6 +285,7 @@ int cmd_repack(int argc, const char **argv, const char *prefix)
 	int delete_redundant = 0;
 	const char *unpack_unreachable = NULL;
 	int keep_unreachable = 0;
+	int removed_packs = 0;
 	struct string_list keep_pack_list = STRING_LIST_INIT_NODUP;
 	int no_update_server_info = 0;
 	int midx_cleared = 0;
@@ -543,9 +545,18 @@ int cmd_repack(int argc, const char **argv, const char *prefix)
 			if (len < hexsz)
 				continue;
 			sha1 = item->string + len - hexsz;
-			if (!string_list_has_string(&names, sha1))
+			if (!string_list_has_string(&names, sha1)) {
 				remove_redundant_pack(packdir, item->string);
+				removed_packs = 1;
+			}
 		}
+		/*
+		 * The unreachable objects of the removed packs are now
+		 * gone or loose, to be pruned later, while kept packs
+		 * may point to them.
+		 */
+		if (removed_packs && connectivity_journal_enabled())
+			clear_connectivity_journal();
 		if (!po_args.quiet && isatty(2))
 			opts |= PRUNE_PACKED_VERBOSE;
 		prune_packed_objects(opts);
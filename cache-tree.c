@@ -246,6 +246,7 @@ static int update_one(struct cache_tree *it,
 	int missing_ok = flags & WRITE_TREE_MISSING_OK;
 	int dryrun = flags & WRITE_TREE_DRY_RUN;
 	int repair = flags & WRITE_TREE_REPAIR;
+	int silent = flags & WRITE_TREE_SILENT;
 	int to_invalidate = 0;
 	int i;
 
@@ -362,7 +363,7 @@ static int update_one(struct cache_tree *it,
 		if (is_null_oid(oid) ||
 		    (!ce_missing_ok && !has_object_file(oid))) {
 			strbuf_release(&buffer);
-			if (expected_missing)
+			if (expected_missing || silent)
 				return -1;
 			return error("invalid object %06o %s for '%.*s'",
 				mode, oid_to_hex(oid), entlen+baselen, path);
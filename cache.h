@@ -328,7 +328,8 @@ struct index_state {
 	struct cache_time timestamp;
 	unsigned name_hash_initialized : 1,
 		 initialized : 1,
-		 drop_cache_tree : 1;
+		 drop_cache_tree : 1,
+		 partially_read : 1;
 	struct hashmap name_hash;
 	struct hashmap dir_hash;
 	struct object_id oid;
@@ -336,15 +337,30 @@ struct index_state {
 	uint64_t fsmonitor_last_update;
 	struct ewah_bitmap *fsmonitor_dirty;
 	struct mem_pool *ce_mem_pool;
+	struct stored_name_hash *stored_name_hash;
 };
 
 extern struct index_state the_index;
 
 /* Name hashing */
 extern int test_lazy_init_name_hash(struct index_state *istate, int try_threaded);
+/*
+ * Build the name hash now rather than on first lookup, e.g. before
+ * starting threads that will look up names concurrently.
+ */
+extern void lazy_init_name_hash(struct index_state *istate);
 extern void add_name_hash(struct index_state *istate, struct cache_entry *ce);
 extern void remove_name_hash(struct index_state *istate, struct cache_entry *ce);
 extern void free_name_hash(struct index_state *istate);
+/*
+ * The name hash can be saved in the index file (the "NHSH" extension)
+ * so that case-insensitive lookups do not have to rehash every path.
+ */
+extern void read_name_hash_extension(struct index_state *istate,
+				     const char *data, unsigned long sz);
+extern int write_name_hash_extension(struct strbuf *sb,
+				     struct index_state *istate);
+extern void discard_stored_name_hash(struct index_state *istate);
 
 
 /* Cache entry creation and cleanup */
@@ -671,6 +687,29 @@ extern int do_read_index(struct index_state *istate, const char *path,
 			 int must_exist); /* for testting only! */
 extern int read_index_from(struct index_state *, const char *path,
 			   const char *gitdir);
+/*
+ * Read only the entries under "prefix" if the index records the
+ * offsets to do so (see index.partialRead), or the whole index
+ * otherwise. Extensions are not read in the former case, and the
+ * result cannot be written out.
+ */
+extern int read_index_partial(struct index_state *, const char *path,
+			      const char *gitdir,
+			      const char *prefix, size_t prefixlen);
+
+typedef int (*each_index_entry_fn)(const struct cache_entry *ce, void *data);
+/*
+ * When index.scanInPlace is set, call "fn" on the entries of the index
+ * file at "path" whose names start with "prefix", in order, decoding
+ * them one at a time from the mapped file instead of loading the index.
+ * The entry passed to "fn" is only valid during the call. Stops at and
+ * returns the first non-zero value returned by "fn". Returns -1, before
+ * calling "fn", if the index cannot be scanned that way (e.g. it is a
+ * split index).
+ */
+extern int for_each_index_file_entry(const char *path,
+				     const char *prefix, size_t prefixlen,
+				     each_index_entry_fn fn, void *data);
 extern int is_index_unborn(struct index_state *);
 extern int read_index_unmerged(struct index_state *);
 
@@ -861,6 +900,7 @@ extern int pack_compression_level;
 extern size_t packed_git_window_size;
 extern size_t packed_git_limit;
 extern size_t delta_base_cache_limit;
+extern size_t tree_cache_limit;
 extern unsigned long big_file_threshold;
 extern unsigned long pack_size_limit_cfg;
 
@@ -1530,6 +1570,7 @@ struct checkout {
 	const char *base_dir;
 	int base_dir_len;
 	struct delayed_checkout *delayed_checkout;
+	struct async_checkout *async_checkout;
 	unsigned force:1,
 		 quiet:1,
 		 not_new:1,
@@ -1542,6 +1583,13 @@ struct checkout {
 extern int checkout_entry(struct cache_entry *ce, const struct checkout *state, char *topath);
 extern void enable_delayed_checkout(struct checkout *state);
 extern int finish_delayed_checkout(struct checkout *state);
+/*
+ * With checkout.workers, let checkout_entry() hand the writing of
+ * regular files over to worker threads; finish_async_checkout() waits
+ * for all of them and reports the errors.
+ */
+extern void enable_async_checkout(struct checkout *state);
+extern int finish_async_checkout(struct checkout *state);
 
 struct cache_def {
 	struct strbuf path;
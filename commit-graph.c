@@ -21,6 +21,8 @@
 #define GRAPH_CHUNKID_OIDFANOUT 0x4f494446 /* "OIDF" */
 #define GRAPH_CHUNKID_OIDLOOKUP 0x4f49444c /* "OIDL" */
 #define GRAPH_CHUNKID_DATA 0x43444154 /* "CDAT" */
+#define GRAPH_CHUNKID_GENERATION_DATA 0x47444154 /* "GDAT" */
+#define GRAPH_CHUNKID_GENERATION_DATA_OVERFLOW 0x47444f56 /* "GDOV" */
 #define GRAPH_CHUNKID_LARGEEDGES 0x45444745 /* "EDGE" */
 
 #define GRAPH_DATA_WIDTH 36
@@ -40,6 +42,8 @@
 
 #define GRAPH_LAST_EDGE 0x80000000
 
+#define CORRECTED_COMMIT_DATE_OFFSET_OVERFLOW 0x80000000
+
 #define GRAPH_HEADER_SIZE 8
 #define GRAPH_FANOUT_SIZE (4 * 256)
 #define GRAPH_CHUNKLOOKUP_WIDTH 12
@@ -51,6 +55,26 @@ char *get_commit_graph_filename(const char *obj_dir)
 	return xstrfmt("%s/info/commit-graph", obj_dir);
 }
 
+/*
+ * Per-commit generation numbers computed while writing a graph. Both
+ * are stored so that older clients can keep using the topological
+ * levels from the Commit Data chunk.
+ */
+struct graph_generation {
+	uint32_t topo_level;
+	timestamp_t corrected_date;
+};
+define_commit_slab(graph_generation_slab, struct graph_generation);
+
+static int generation_data_enabled(void)
+{
+	int version = 2;
+
+	repo_config_get_int(the_repository, "commitgraph.generationversion",
+			    &version);
+	return version >= 2;
+}
+
 static struct commit_graph *alloc_commit_graph(void)
 {
 	struct commit_graph *g = xcalloc(1, sizeof(*g));
@@ -177,6 +201,20 @@ struct commit_graph *load_commit_graph_one(const char *graph_file)
 				graph->chunk_commit_data = data + chunk_offset;
 			break;
 
+		case GRAPH_CHUNKID_GENERATION_DATA:
+			if (graph->chunk_generation_data)
+				chunk_repeated = 1;
+			else
+				graph->chunk_generation_data = data + chunk_offset;
+			break;
+
+		case GRAPH_CHUNKID_GENERATION_DATA_OVERFLOW:
+			if (graph->chunk_generation_data_overflow)
+				chunk_repeated = 1;
+			else
+				graph->chunk_generation_data_overflow = data + chunk_offset;
+			break;
+
 		case GRAPH_CHUNKID_LARGEEDGES:
 			if (graph->chunk_large_edges)
 				chunk_repeated = 1;
@@ -200,6 +238,9 @@ struct commit_graph *load_commit_graph_one(const char *graph_file)
 		last_chunk_offset = chunk_offset;
 	}
 
+	if (graph->chunk_generation_data && generation_data_enabled())
+		graph->read_generation_data = 1;
+
 	return graph;
 
 cleanup_fail:
@@ -280,6 +321,12 @@ int generation_numbers_enabled(struct repository *r)
 	return !!first_generation;
 }
 
+int corrected_commit_dates_enabled(struct repository *r)
+{
+	return generation_numbers_enabled(r) &&
+	       r->objects->commit_graph->read_generation_data;
+}
+
 void close_commit_graph(struct repository *r)
 {
 	free_commit_graph(r->objects->commit_graph);
@@ -310,18 +357,56 @@ static struct commit_list **insert_parent_or_die(struct commit_graph *g,
 	return &commit_list_insert(c, pptr)->next;
 }
 
+static timestamp_t read_commit_date(struct commit_graph *g,
+				    const unsigned char *commit_data)
+{
+	uint64_t date_high, date_low;
+
+	date_high = get_be32(commit_data + g->hash_len + 8) & 0x3;
+	date_low = get_be32(commit_data + g->hash_len + 12);
+	return (timestamp_t)((date_high << 32) | date_low);
+}
+
+static uint32_t read_topo_level(struct commit_graph *g, uint32_t pos)
+{
+	const unsigned char *commit_data = g->chunk_commit_data + GRAPH_DATA_WIDTH * pos;
+	return get_be32(commit_data + g->hash_len + 8) >> 2;
+}
+
+/*
+ * The generation number of the commit at position 'pos': its
+ * corrected commit date if the graph has a Generation Data chunk
+ * that we are allowed to use, and its topological level otherwise.
+ */
+static timestamp_t read_generation(struct commit_graph *g, uint32_t pos,
+				   timestamp_t date)
+{
+	uint64_t offset;
+
+	if (!g->read_generation_data)
+		return read_topo_level(g, pos);
+
+	offset = get_be32(g->chunk_generation_data + sizeof(uint32_t) * pos);
+	if (offset & CORRECTED_COMMIT_DATE_OFFSET_OVERFLOW) {
+		offset ^= CORRECTED_COMMIT_DATE_OFFSET_OVERFLOW;
+		if (!g->chunk_generation_data_overflow)
+			die(_("commit-graph requires overflow generation data but has none"));
+		offset = get_be64(g->chunk_generation_data_overflow + 8 * offset);
+	}
+	return date + offset;
+}
+
 static void fill_commit_graph_info(struct commit *item, struct commit_graph *g, uint32_t pos)
 {
 	const unsigned char *commit_data = g->chunk_commit_data + GRAPH_DATA_WIDTH * pos;
 	item->graph_pos = pos;
-	item->generation = get_be32(commit_data + g->hash_len + 8) >> 2;
+	item->generation = read_generation(g, pos, read_commit_date(g, commit_data));
 }
 
 static int fill_commit_in_graph(struct commit *item, struct commit_graph *g, uint32_t pos)
 {
 	uint32_t edge_value;
 	uint32_t *parent_data_ptr;
-	uint64_t date_low, date_high;
 	struct commit_list **pptr;
 	const unsigned char *commit_data = g->chunk_commit_data + (g->hash_len + 16) * pos;
 
@@ -330,11 +415,8 @@ static int fill_commit_in_graph(struct commit *item, struct commit_graph *g, uin
 
 	item->maybe_tree = NULL;
 
-	date_high = get_be32(commit_data + g->hash_len + 8) & 0x3;
-	date_low = get_be32(commit_data + g->hash_len + 12);
-	item->date = (timestamp_t)((date_high << 32) | date_low);
-
-	item->generation = get_be32(commit_data + g->hash_len + 8) >> 2;
+	item->date = read_commit_date(g, commit_data);
+	item->generation = read_generation(g, pos, item->date);
 
 	pptr = &item->parents;
 
@@ -471,7 +553,8 @@ static const unsigned char *commit_to_sha1(size_t index, void *table)
 }
 
 static void write_graph_chunk_data(struct hashfile *f, int hash_len,
-				   struct commit **commits, int nr_commits)
+				   struct commit **commits, int nr_commits,
+				   struct graph_generation_slab *generations)
 {
 	struct commit **list = commits;
 	struct commit **last = commits + nr_commits;
@@ -531,7 +614,7 @@ static void write_graph_chunk_data(struct hashfile *f, int hash_len,
 		else
 			packedDate[0] = 0;
 
-		packedDate[0] |= htonl((*list)->generation << 2);
+		packedDate[0] |= htonl(graph_generation_slab_at(generations, *list)->topo_level << 2);
 
 		packedDate[1] = htonl((*list)->date);
 		hashwrite(f, packedDate, 8);
@@ -540,6 +623,44 @@ static void write_graph_chunk_data(struct hashfile *f, int hash_len,
 	}
 }
 
+static void write_graph_chunk_generation_data(struct hashfile *f,
+					      struct commit **commits,
+					      int nr_commits,
+					      struct graph_generation_slab *generations)
+{
+	int i, num_overflows = 0;
+
+	for (i = 0; i < nr_commits; i++) {
+		struct commit *c = commits[i];
+		timestamp_t offset;
+
+		offset = graph_generation_slab_at(generations, c)->corrected_date - c->date;
+		if (offset > GENERATION_NUMBER_V2_OFFSET_MAX)
+			offset = CORRECTED_COMMIT_DATE_OFFSET_OVERFLOW | num_overflows++;
+
+		hashwrite_be32(f, offset);
+	}
+}
+
+static void write_graph_chunk_generation_data_overflow(struct hashfile *f,
+						       struct commit **commits,
+						       int nr_commits,
+						       struct graph_generation_slab *generations)
+{
+	int i;
+
+	for (i = 0; i < nr_commits; i++) {
+		struct commit *c = commits[i];
+		timestamp_t offset;
+
+		offset = graph_generation_slab_at(generations, c)->corrected_date - c->date;
+		if (offset > GENERATION_NUMBER_V2_OFFSET_MAX) {
+			hashwrite_be32(f, offset >> 32);
+			hashwrite_be32(f, (uint32_t)offset);
+		}
+	}
+}
+
 static void write_graph_chunk_large_edges(struct hashfile *f,
 					  struct commit **commits,
 					  int nr_commits)
@@ -679,10 +800,22 @@ static void close_reachable(struct packed_oid_list *oids, int report_progress)
 	stop_progress(&progress);
 }
 
-static void compute_generation_numbers(struct packed_commit_list* commits,
-				       int report_progress)
+/*
+ * Compute both the topological level and the corrected commit date of
+ * every commit in the list. The corrected commit date of a commit is
+ * the larger of its commit date and one more than the corrected commit
+ * dates of its parents; unlike the topological level it stays close to
+ * the commit date, and therefore cuts walks across long-lived parallel
+ * branches much earlier.
+ *
+ * Returns the number of corrected commit dates whose offset from the
+ * commit date does not fit into the Generation Data chunk.
+ */
+static int compute_generation_numbers(struct packed_commit_list* commits,
+				      struct graph_generation_slab *generations,
+				      int report_progress)
 {
-	int i;
+	int i, num_overflows = 0;
 	struct commit_list *list = NULL;
 	struct progress *progress = NULL;
 
@@ -692,38 +825,53 @@ static void compute_generation_numbers(struct packed_commit_list* commits,
 			commits->nr);
 	for (i = 0; i < commits->nr; i++) {
 		display_progress(progress, i + 1);
-		if (commits->list[i]->generation != GENERATION_NUMBER_INFINITY &&
-		    commits->list[i]->generation != GENERATION_NUMBER_ZERO)
+		if (graph_generation_slab_at(generations, commits->list[i])->topo_level)
 			continue;
 
 		commit_list_insert(commits->list[i], &list);
 		while (list) {
 			struct commit *current = list->item;
 			struct commit_list *parent;
+			struct graph_generation *gen;
 			int all_parents_computed = 1;
-			uint32_t max_generation = 0;
+			uint32_t max_level = 0;
+			timestamp_t max_corrected_date = 0;
 
 			for (parent = current->parents; parent; parent = parent->next) {
-				if (parent->item->generation == GENERATION_NUMBER_INFINITY ||
-				    parent->item->generation == GENERATION_NUMBER_ZERO) {
+				struct graph_generation *pgen =
+					graph_generation_slab_at(generations, parent->item);
+
+				if (!pgen->topo_level) {
 					all_parents_computed = 0;
 					commit_list_insert(parent->item, &list);
 					break;
-				} else if (parent->item->generation > max_generation) {
-					max_generation = parent->item->generation;
 				}
+				if (pgen->topo_level > max_level)
+					max_level = pgen->topo_level;
+				if (pgen->corrected_date > max_corrected_date)
+					max_corrected_date = pgen->corrected_date;
 			}
 
-			if (all_parents_computed) {
-				current->generation = max_generation + 1;
-				pop_commit(&list);
+			if (!all_parents_computed)
+				continue;
 
-				if (current->generation > GENERATION_NUMBER_MAX)
-					current->generation = GENERATION_NUMBER_MAX;
-			}
+			pop_commit(&list);
+			gen = graph_generation_slab_at(generations, current);
+
+			gen->topo_level = max_level + 1;
+			if (gen->topo_level > GENERATION_NUMBER_V1_MAX)
+				gen->topo_level = GENERATION_NUMBER_V1_MAX;
+
+			if (current->date && current->date > max_corrected_date)
+				max_corrected_date = current->date - 1;
+			gen->corrected_date = max_corrected_date + 1;
+			if (gen->corrected_date - current->date > GENERATION_NUMBER_V2_OFFSET_MAX)
+				num_overflows++;
 		}
 	}
 	stop_progress(&progress);
+
+	return num_overflows;
 }
 
 static int add_ref_to_list(const char *refname,
@@ -758,12 +906,15 @@ void write_commit_graph(const char *obj_dir,
 	uint32_t i, count_distinct = 0;
 	char *graph_name;
 	struct lock_file lk = LOCK_INIT;
-	uint32_t chunk_ids[5];
-	uint64_t chunk_offsets[5];
+	uint32_t chunk_ids[7];
+	uint64_t chunk_offsets[7];
 	int num_chunks;
 	int num_extra_edges;
+	int write_generation_data;
+	int num_generation_overflows;
 	struct commit_list *parent;
 	struct progress *progress = NULL;
+	struct graph_generation_slab generations;
 
 	if (!commit_graph_compatible(the_repository))
 		return;
@@ -889,12 +1040,26 @@ void write_commit_graph(const char *obj_dir,
 
 		commits.nr++;
 	}
-	num_chunks = num_extra_edges ? 4 : 3;
 
 	if (commits.nr >= GRAPH_PARENT_MISSING)
 		die(_("too many commits to write graph"));
 
-	compute_generation_numbers(&commits, report_progress);
+	init_graph_generation_slab(&generations);
+	num_generation_overflows = compute_generation_numbers(&commits, &generations,
+							      report_progress);
+
+	write_generation_data = generation_data_enabled() &&
+				!git_env_bool(GIT_TEST_COMMIT_GRAPH_NO_GDAT, 0);
+	if (!write_generation_data)
+		num_generation_overflows = 0;
+
+	num_chunks = 3;
+	if (write_generation_data)
+		num_chunks++;
+	if (num_generation_overflows)
+		num_chunks++;
+	if (num_extra_edges)
+		num_chunks++;
 
 	graph_name = get_commit_graph_filename(obj_dir);
 	if (safe_create_leading_directories(graph_name)) {
@@ -916,17 +1081,28 @@ void write_commit_graph(const char *obj_dir,
 	chunk_ids[0] = GRAPH_CHUNKID_OIDFANOUT;
 	chunk_ids[1] = GRAPH_CHUNKID_OIDLOOKUP;
 	chunk_ids[2] = GRAPH_CHUNKID_DATA;
-	if (num_extra_edges)
-		chunk_ids[3] = GRAPH_CHUNKID_LARGEEDGES;
-	else
-		chunk_ids[3] = 0;
-	chunk_ids[4] = 0;
-
 	chunk_offsets[0] = 8 + (num_chunks + 1) * GRAPH_CHUNKLOOKUP_WIDTH;
 	chunk_offsets[1] = chunk_offsets[0] + GRAPH_FANOUT_SIZE;
 	chunk_offsets[2] = chunk_offsets[1] + GRAPH_OID_LEN * commits.nr;
 	chunk_offsets[3] = chunk_offsets[2] + (GRAPH_OID_LEN + 16) * commits.nr;
-	chunk_offsets[4] = chunk_offsets[3] + 4 * num_extra_edges;
+
+	i = 3;
+	if (write_generation_data) {
+		chunk_ids[i] = GRAPH_CHUNKID_GENERATION_DATA;
+		chunk_offsets[i + 1] = chunk_offsets[i] + sizeof(uint32_t) * commits.nr;
+		i++;
+	}
+	if (num_generation_overflows) {
+		chunk_ids[i] = GRAPH_CHUNKID_GENERATION_DATA_OVERFLOW;
+		chunk_offsets[i + 1] = chunk_offsets[i] + sizeof(uint64_t) * num_generation_overflows;
+		i++;
+	}
+	if (num_extra_edges) {
+		chunk_ids[i] = GRAPH_CHUNKID_LARGEEDGES;
+		chunk_offsets[i + 1] = chunk_offsets[i] + 4 * num_extra_edges;
+		i++;
+	}
+	chunk_ids[i] = 0;
 
 	for (i = 0; i <= num_chunks; i++) {
 		uint32_t chunk_write[3];
@@ -939,13 +1115,22 @@ void write_commit_graph(const char *obj_dir,
 
 	write_graph_chunk_fanout(f, commits.list, commits.nr);
 	write_graph_chunk_oids(f, GRAPH_OID_LEN, commits.list, commits.nr);
-	write_graph_chunk_data(f, GRAPH_OID_LEN, commits.list, commits.nr);
+	write_graph_chunk_data(f, GRAPH_OID_LEN, commits.list, commits.nr,
+			       &generations);
+	if (write_generation_data)
+		write_graph_chunk_generation_data(f, commits.list, commits.nr,
+						  &generations);
+	if (num_generation_overflows)
+		write_graph_chunk_generation_data_overflow(f, commits.list,
+							   commits.nr,
+							   &generations);
 	write_graph_chunk_large_edges(f, commits.list, commits.nr);
 
 	close_commit_graph(the_repository);
 	finalize_hashfile(f, NULL, CSUM_HASH_IN_STREAM | CSUM_FSYNC);
 	commit_lock_file(&lk);
 
+	clear_graph_generation_slab(&generations);
 	free(graph_name);
 	free(commits.list);
 	free(oids.list);
@@ -1048,7 +1233,8 @@ int verify_commit_graph(struct repository *r, struct commit_graph *g)
 	for (i = 0; i < g->num_commits; i++) {
 		struct commit *graph_commit, *odb_commit;
 		struct commit_list *graph_parents, *odb_parents;
-		uint32_t max_generation = 0;
+		uint32_t topo_level, max_level = 0;
+		timestamp_t max_corrected_date = 0;
 
 		display_progress(progress, i + 1);
 		hashcpy(cur_oid.hash, g->chunk_oid_lookup + g->hash_len * i);
@@ -1084,8 +1270,10 @@ int verify_commit_graph(struct repository *r, struct commit_graph *g)
 					     oid_to_hex(&graph_parents->item->object.oid),
 					     oid_to_hex(&odb_parents->item->object.oid));
 
-			if (graph_parents->item->generation > max_generation)
-				max_generation = graph_parents->item->generation;
+			if (read_topo_level(g, graph_parents->item->graph_pos) > max_level)
+				max_level = read_topo_level(g, graph_parents->item->graph_pos);
+			if (graph_parents->item->generation > max_corrected_date)
+				max_corrected_date = graph_parents->item->generation;
 
 			graph_parents = graph_parents->next;
 			odb_parents = odb_parents->next;
@@ -1095,7 +1283,8 @@ int verify_commit_graph(struct repository *r, struct commit_graph *g)
 			graph_report("commit-graph parent list for commit %s terminates early",
 				     oid_to_hex(&cur_oid));
 
-		if (!graph_commit->generation) {
+		topo_level = read_topo_level(g, i);
+		if (!topo_level) {
 			if (generation_zero == GENERATION_NUMBER_EXISTS)
 				graph_report("commit-graph has generation number zero for commit %s, but non-zero elsewhere",
 					     oid_to_hex(&cur_oid));
@@ -1108,18 +1297,28 @@ int verify_commit_graph(struct repository *r, struct commit_graph *g)
 			continue;
 
 		/*
-		 * If one of our parents has generation GENERATION_NUMBER_MAX, then
-		 * our generation is also GENERATION_NUMBER_MAX. Decrement to avoid
-		 * extra logic in the following condition.
+		 * If one of our parents has generation GENERATION_NUMBER_V1_MAX,
+		 * then our generation is also GENERATION_NUMBER_V1_MAX. Decrement
+		 * to avoid extra logic in the following condition.
 		 */
-		if (max_generation == GENERATION_NUMBER_MAX)
-			max_generation--;
+		if (max_level == GENERATION_NUMBER_V1_MAX)
+			max_level--;
 
-		if (graph_commit->generation != max_generation + 1)
+		if (topo_level != max_level + 1)
 			graph_report("commit-graph generation for commit %s is %u != %u",
 				     oid_to_hex(&cur_oid),
-				     graph_commit->generation,
-				     max_generation + 1);
+				     topo_level,
+				     max_level + 1);
+
+		if (g->read_generation_data) {
+			if (odb_commit->date && odb_commit->date > max_corrected_date)
+				max_corrected_date = odb_commit->date - 1;
+			if (graph_commit->generation != max_corrected_date + 1)
+				graph_report("commit-graph corrected commit date for commit %s is %"PRItime" != %"PRItime,
+					     oid_to_hex(&cur_oid),
+					     graph_commit->generation,
+					     max_corrected_date + 1);
+		}
 
 		if (graph_commit->date != odb_commit->date)
 			graph_report("commit date for commit %s in commit-graph is %"PRItime" != %"PRItime,
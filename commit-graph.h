@@ -7,6 +7,7 @@
 #include "cache.h"
 
 #define GIT_TEST_COMMIT_GRAPH "GIT_TEST_COMMIT_GRAPH"
+#define GIT_TEST_COMMIT_GRAPH_NO_GDAT "GIT_TEST_COMMIT_GRAPH_NO_GDAT"
 
 struct commit;
 
@@ -46,9 +47,18 @@ struct commit_graph {
 	uint32_t num_commits;
 	struct object_id oid;
 
+	/*
+	 * Set if the Generation Data chunk is present and allowed by
+	 * commitGraph.generationVersion; the commits then carry corrected
+	 * commit dates instead of topological levels.
+	 */
+	unsigned read_generation_data : 1;
+
 	const uint32_t *chunk_oid_fanout;
 	const unsigned char *chunk_oid_lookup;
 	const unsigned char *chunk_commit_data;
+	const unsigned char *chunk_generation_data;
+	const unsigned char *chunk_generation_data_overflow;
 	const unsigned char *chunk_large_edges;
 };
 
@@ -60,6 +70,12 @@ struct commit_graph *load_commit_graph_one(const char *graph_file);
  */
 int generation_numbers_enabled(struct repository *r);
 
+/*
+ * Return 1 if and only if generation numbers are enabled and the
+ * commits loaded from the commit-graph carry corrected commit dates.
+ */
+int corrected_commit_dates_enabled(struct repository *r);
+
 void write_commit_graph_reachable(const char *obj_dir, int append,
 				  int report_progress);
 void write_commit_graph(const char *obj_dir,
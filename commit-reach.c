@@ -8,6 +8,7 @@
 #include "revision.h"
 #include "tag.h"
 #include "commit-reach.h"
+#include "pack-bitmap.h"
 
 /* Remember to update object flag allocation in object.h */
 #define REACHABLE       (1u<<15)
@@ -32,14 +33,14 @@ static int queue_has_nonstale(struct prio_queue *queue)
 /* all input commits in one and twos[] must have been parsed! */
 static struct commit_list *paint_down_to_common(struct commit *one, int n,
 						struct commit **twos,
-						int min_generation)
+						timestamp_t min_generation)
 {
 	struct prio_queue queue = { compare_commits_by_gen_then_commit_date };
 	struct commit_list *result = NULL;
 	int i;
-	uint32_t last_gen = GENERATION_NUMBER_INFINITY;
+	timestamp_t last_gen = GENERATION_NUMBER_INFINITY;
 
-	if (!min_generation)
+	if (!min_generation && !corrected_commit_dates_enabled(the_repository))
 		queue.compare = compare_commits_by_commit_date;
 
 	one->object.flags |= PARENT1;
@@ -60,7 +61,7 @@ static struct commit_list *paint_down_to_common(struct commit *one, int n,
 		int flags;
 
 		if (min_generation && commit->generation > last_gen)
-			BUG("bad generation skip %8x > %8x at %s",
+			BUG("bad generation skip %"PRItime" > %"PRItime" at %s",
 			    commit->generation, last_gen,
 			    oid_to_hex(&commit->object.oid));
 		last_gen = commit->generation;
@@ -174,7 +175,7 @@ static int remove_redundant(struct commit **array, int cnt)
 		parse_commit(array[i]);
 	for (i = 0; i < cnt; i++) {
 		struct commit_list *common;
-		uint32_t min_generation = array[i]->generation;
+		timestamp_t min_generation = array[i]->generation;
 
 		if (redundant[i])
 			continue;
@@ -308,7 +309,7 @@ int in_merge_bases_many(struct commit *commit, int nr_reference, struct commit *
 {
 	struct commit_list *bases;
 	int ret = 0, i;
-	uint32_t min_generation = GENERATION_NUMBER_INFINITY;
+	timestamp_t min_generation = GENERATION_NUMBER_INFINITY;
 
 	if (parse_commit(commit))
 		return ret;
@@ -431,6 +432,30 @@ static int in_commit_list(const struct commit_list *want, struct commit *c)
 	return 0;
 }
 
+/*
+ * A commit with a stored reachability bitmap answers the question
+ * directly: it contains a wanted commit if and only if the bit of that
+ * commit is set. The bitmapped pack is closed under reachability, so
+ * wanted commits outside of it cannot be reached from inside it.
+ */
+static enum contains_result contains_test_bitmap(struct commit *candidate,
+						 const struct commit_list *want,
+						 struct bitmap_index *bitmap_git)
+{
+	struct ewah_bitmap *reachable = bitmap_for_commit(bitmap_git, candidate);
+
+	if (!reachable)
+		return CONTAINS_UNKNOWN;
+
+	for (; want; want = want->next) {
+		int pos = bitmap_object_position(bitmap_git,
+						 &want->item->object.oid);
+		if (pos >= 0 && ewah_get(reachable, pos))
+			return CONTAINS_YES;
+	}
+	return CONTAINS_NO;
+}
+
 /*
  * Test whether the candidate is contained in the list.
  * Do not recurse to find out, though, but return -1 if inconclusive.
@@ -438,7 +463,8 @@ static int in_commit_list(const struct commit_list *want, struct commit *c)
 static enum contains_result contains_test(struct commit *candidate,
 					  const struct commit_list *want,
 					  struct contains_cache *cache,
-					  uint32_t cutoff)
+					  timestamp_t cutoff,
+					  struct bitmap_index *bitmap_git)
 {
 	enum contains_result *cached = contains_cache_at(cache, candidate);
 
@@ -452,6 +478,17 @@ static enum contains_result contains_test(struct commit *candidate,
 		return CONTAINS_YES;
 	}
 
+	/* or does our bitmap tell? */
+	if (bitmap_git) {
+		enum contains_result result;
+
+		result = contains_test_bitmap(candidate, want, bitmap_git);
+		if (result != CONTAINS_UNKNOWN) {
+			*cached = result;
+			return result;
+		}
+	}
+
 	/* Otherwise, we don't know; prepare to recurse */
 	parse_commit_or_die(candidate);
 
@@ -470,11 +507,12 @@ static void push_to_contains_stack(struct commit *candidate, struct contains_sta
 
 static enum contains_result contains_tag_algo(struct commit *candidate,
 					      const struct commit_list *want,
-					      struct contains_cache *cache)
+					      struct contains_cache *cache,
+					      struct bitmap_index *bitmap_git)
 {
 	struct contains_stack contains_stack = { 0, 0, NULL };
 	enum contains_result result;
-	uint32_t cutoff = GENERATION_NUMBER_INFINITY;
+	timestamp_t cutoff = GENERATION_NUMBER_INFINITY;
 	const struct commit_list *p;
 
 	for (p = want; p; p = p->next) {
@@ -484,7 +522,7 @@ static enum contains_result contains_tag_algo(struct commit *candidate,
 			cutoff = c->generation;
 	}
 
-	result = contains_test(candidate, want, cache, cutoff);
+	result = contains_test(candidate, want, cache, cutoff, bitmap_git);
 	if (result != CONTAINS_UNKNOWN)
 		return result;
 
@@ -502,7 +540,7 @@ static enum contains_result contains_tag_algo(struct commit *candidate,
 		 * If we just popped the stack, parents->item has been marked,
 		 * therefore contains_test will return a meaningful yes/no.
 		 */
-		else switch (contains_test(parents->item, want, cache, cutoff)) {
+		else switch (contains_test(parents->item, want, cache, cutoff, bitmap_git)) {
 		case CONTAINS_YES:
 			*contains_cache_at(cache, commit) = CONTAINS_YES;
 			contains_stack.nr--;
@@ -516,14 +554,21 @@ static enum contains_result contains_tag_algo(struct commit *candidate,
 		}
 	}
 	free(contains_stack.contains_stack);
-	return contains_test(candidate, want, cache, cutoff);
+	return contains_test(candidate, want, cache, cutoff, bitmap_git);
 }
 
 int commit_contains(struct ref_filter *filter, struct commit *commit,
-		    struct commit_list *list, struct contains_cache *cache)
+		    struct commit_list *list, struct contains_cache *cache,
+		    struct bitmap_index *bitmap_git)
 {
-	if (filter->with_commit_tag_algo)
-		return contains_tag_algo(commit, list, cache) == CONTAINS_YES;
+	/*
+	 * With bitmaps the memoized walk of the tag algorithm stops at
+	 * the nearest bitmapped commits, so it is the better choice for
+	 * branches as well.
+	 */
+	if (filter->with_commit_tag_algo || bitmap_git)
+		return contains_tag_algo(commit, list, cache,
+					 bitmap_git) == CONTAINS_YES;
 	return is_descendant_of(commit, list);
 }
 
@@ -543,7 +588,7 @@ int can_all_from_reach_with_flag(struct object_array *from,
 				 unsigned int with_flag,
 				 unsigned int assign_flag,
 				 time_t min_commit_date,
-				 uint32_t min_generation)
+				 timestamp_t min_generation)
 {
 	struct commit **list = NULL;
 	int i;
@@ -644,7 +689,7 @@ int can_all_from_reach(struct commit_list *from, struct commit_list *to,
 	time_t min_commit_date = cutoff_by_min_date ? from->item->date : 0;
 	struct commit_list *from_iter = from, *to_iter = to;
 	int result;
-	uint32_t min_generation = GENERATION_NUMBER_INFINITY;
+	timestamp_t min_generation = GENERATION_NUMBER_INFINITY;
 
 	while (from_iter) {
 		add_object_array(&from_iter->item->object, NULL, &from_objs);
@@ -700,7 +745,7 @@ struct commit_list *get_reachable_subset(struct commit **from, int nr_from,
 	struct commit_list *found_commits = NULL;
 	struct commit **to_last = to + nr_to;
 	struct commit **from_last = from + nr_from;
-	uint32_t min_generation = GENERATION_NUMBER_INFINITY;
+	timestamp_t min_generation = GENERATION_NUMBER_INFINITY;
 	int num_to_find = 0;
 
 	struct prio_queue queue = { compare_commits_by_gen_then_commit_date };
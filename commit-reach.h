@@ -8,6 +8,7 @@ struct commit_list;
 struct ref_filter;
 struct object_id;
 struct object_array;
+struct bitmap_index;
 
 struct commit_list *get_merge_bases_many(struct commit *one,
 					 int n,
@@ -57,8 +58,14 @@ enum contains_result {
 
 define_commit_slab(contains_cache, enum contains_result);
 
+/*
+ * Return 1 if 'commit' can reach one of the commits in 'list'. Answers
+ * are memoized in 'cache' across calls. If 'bitmap_git' is not NULL,
+ * the reachability bitmaps in it are used to cut the walk short.
+ */
 int commit_contains(struct ref_filter *filter, struct commit *commit,
-		    struct commit_list *list, struct contains_cache *cache);
+		    struct commit_list *list, struct contains_cache *cache,
+		    struct bitmap_index *bitmap_git);
 
 /*
  * Determine if every commit in 'from' can reach at least one commit
@@ -71,7 +78,7 @@ int can_all_from_reach_with_flag(struct object_array *from,
 				 unsigned int with_flag,
 				 unsigned int assign_flag,
 				 time_t min_commit_date,
-				 uint32_t min_generation);
+				 timestamp_t min_generation);
 int can_all_from_reach(struct commit_list *from, struct commit_list *to,
 		       int commit_date_cutoff);
 
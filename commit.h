@@ -11,8 +11,9 @@
 #include "commit-slab.h"
 
 #define COMMIT_NOT_FROM_GRAPH 0xFFFFFFFF
-#define GENERATION_NUMBER_INFINITY 0xFFFFFFFF
-#define GENERATION_NUMBER_MAX 0x3FFFFFFF
+#define GENERATION_NUMBER_INFINITY ((1ULL << 63) - 1)
+#define GENERATION_NUMBER_V1_MAX 0x3FFFFFFF
+#define GENERATION_NUMBER_V2_OFFSET_MAX ((1ULL << 31) - 1)
 #define GENERATION_NUMBER_ZERO 0
 
 struct commit_list {
@@ -37,8 +38,13 @@ struct commit {
 	 */
 	struct tree *maybe_tree;
 	uint32_t graph_pos;
-	uint32_t generation;
 	unsigned int index;
+
+	/*
+	 * The corrected commit date if the commit-graph stores them,
+	 * otherwise the topological level of the commit.
+	 */
+	timestamp_t generation;
 };
 
 extern int save_commit_buffer;
@@ -1232,6 +1232,11 @@ static int git_default_core_config(const char *var, const char *value, void *cb)
 		return 0;
 	}
 
+	if (!strcmp(var, "core.treecachelimit")) {
+		tree_cache_limit = git_config_ulong(var, value);
+		return 0;
+	}
+
 	if (!strcmp(var, "core.autocrlf")) {
 		if (value && !strcasecmp(value, "input")) {
 			auto_crlf = AUTO_CRLF_INPUT;
@@ -2280,6 +2285,21 @@ int git_config_get_max_percent_split_change(void)
 	return -1; /* default value */
 }
 
+int git_config_get_max_shared_layers(void)
+{
+	int val;
+
+	if (!git_config_get_int("splitindex.maxsharedlayers", &val)) {
+		if (val > 0)
+			return val;
+
+		return error(_("splitIndex.maxSharedLayers value '%d' "
+			       "should be positive"), val);
+	}
+
+	return 1; /* default value */
+}
+
 int git_config_get_fsmonitor(void)
 {
 	if (git_config_get_pathname("core.fsmonitor", &core_fsmonitor))
@@ -0,0 +1 @@
+NO_GETTEXT=YesPlease
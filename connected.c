@@ -4,6 +4,177 @@
 #include "connected.h"
 #include "transport.h"
 #include "packfile.h"
+#include "config.h"
+#include "lockfile.h"
+#include "object-store.h"
+#include "oidset.h"
+
+static int connectivity_journal = -1;
+static struct oidset journal_packs = OIDSET_INIT;
+static int journal_loaded;
+
+int connectivity_journal_enabled(void)
+{
+	if (connectivity_journal < 0) {
+		/* a partial clone is never fully connected */
+		if (repository_format_partial_clone ||
+		    git_config_get_bool("core.connectivityjournal",
+					&connectivity_journal))
+			connectivity_journal = 0;
+	}
+	return connectivity_journal;
+}
+
+static void connectivity_journal_path(struct strbuf *sb)
+{
+	/*
+	 * Use the common directory rather than get_object_directory(),
+	 * so that index-pack running inside receive-pack's quarantine
+	 * records the pack in the repository it will be migrated to.
+	 */
+	strbuf_git_common_path(sb, the_repository,
+			       "objects/info/connected-packs");
+}
+
+static void load_connectivity_journal(void)
+{
+	struct strbuf path = STRBUF_INIT, line = STRBUF_INIT;
+	FILE *fp;
+
+	if (journal_loaded)
+		return;
+	journal_loaded = 1;
+
+	connectivity_journal_path(&path);
+	fp = fopen(path.buf, "r");
+	if (!fp) {
+		if (errno != ENOENT)
+			warning_errno(_("unable to open '%s'"), path.buf);
+		strbuf_release(&path);
+		return;
+	}
+	while (strbuf_getline(&line, fp) != EOF) {
+		struct object_id oid;
+
+		if (get_oid_hex(line.buf, &oid) || line.buf[GIT_SHA1_HEXSZ]) {
+			warning(_("ignoring malformed line in '%s': %s"),
+				path.buf, line.buf);
+			continue;
+		}
+		oidset_insert(&journal_packs, &oid);
+	}
+	fclose(fp);
+	strbuf_release(&line);
+	strbuf_release(&path);
+}
+
+void reprepare_connectivity_journal(void)
+{
+	oidset_clear(&journal_packs);
+	journal_loaded = 0;
+}
+
+int pack_in_connectivity_journal(struct packed_git *p)
+{
+	struct object_id oid;
+
+	if (!connectivity_journal_enabled())
+		return 0;
+	load_connectivity_journal();
+	hashcpy(oid.hash, p->sha1);
+	return oidset_contains(&journal_packs, &oid);
+}
+
+int object_in_connectivity_journal(const struct object_id *oid)
+{
+	struct packed_git *p;
+
+	if (!connectivity_journal_enabled())
+		return 0;
+	for (p = get_all_packs(the_repository); p; p = p->next) {
+		if (!pack_in_connectivity_journal(p))
+			continue;
+		if (find_pack_entry_one(oid->hash, p))
+			return 1;
+	}
+	return 0;
+}
+
+static int update_connectivity_journal(struct strbuf *contents, int append)
+{
+	struct lock_file lk = LOCK_INIT;
+	struct strbuf path = STRBUF_INIT;
+	int fd, ret = 0;
+
+	connectivity_journal_path(&path);
+	if (safe_create_leading_directories(path.buf)) {
+		strbuf_release(&path);
+		return -1;
+	}
+	/*
+	 * Writers only hold the lock briefly; missing an entry merely
+	 * costs a full walk later, so do not wait long.
+	 */
+	fd = hold_lock_file_for_update_timeout(&lk, path.buf, 0, 100);
+	if (fd < 0) {
+		strbuf_release(&path);
+		return -1;
+	}
+	if (append) {
+		struct strbuf old = STRBUF_INIT;
+
+		if (strbuf_read_file(&old, path.buf, 0) < 0 && errno != ENOENT)
+			ret = -1;
+		strbuf_insert(contents, 0, old.buf, old.len);
+		strbuf_release(&old);
+	}
+	if (!ret && write_in_full(fd, contents->buf, contents->len) < 0)
+		ret = -1;
+	if (ret)
+		rollback_lock_file(&lk);
+	else if (commit_lock_file(&lk))
+		ret = -1;
+	strbuf_release(&path);
+	reprepare_connectivity_journal();
+	return ret;
+}
+
+int add_to_connectivity_journal(const unsigned char *pack_hash)
+{
+	struct strbuf contents = STRBUF_INIT;
+	int ret;
+
+	strbuf_addf(&contents, "%s\n", sha1_to_hex(pack_hash));
+	ret = update_connectivity_journal(&contents, 1);
+	strbuf_release(&contents);
+	return ret;
+}
+
+int write_connectivity_journal(void)
+{
+	struct strbuf contents = STRBUF_INIT;
+	struct packed_git *p;
+	int ret;
+
+	for (p = get_all_packs(the_repository); p; p = p->next) {
+		if (!p->pack_local || is_null_sha1(p->sha1))
+			continue;
+		strbuf_addf(&contents, "%s\n", sha1_to_hex(p->sha1));
+	}
+	ret = update_connectivity_journal(&contents, 0);
+	strbuf_release(&contents);
+	return ret;
+}
+
+void clear_connectivity_journal(void)
+{
+	struct strbuf path = STRBUF_INIT;
+
+	connectivity_journal_path(&path);
+	unlink_or_warn(path.buf);
+	strbuf_release(&path);
+	reprepare_connectivity_journal();
+}
 
 /*
  * If we feed all the commits we want to verify to this command
@@ -27,6 +198,7 @@ int check_connected(oid_iterate_fn fn, void *cb_data,
 	struct packed_git *new_pack = NULL;
 	struct transport *transport;
 	size_t base_len;
+	int use_journal = connectivity_journal_enabled();
 
 	if (!opt)
 		opt = &defaults;
@@ -49,6 +221,21 @@ int check_connected(oid_iterate_fn fn, void *cb_data,
 		strbuf_release(&idx_file);
 	}
 
+	if (use_journal) {
+		/* pick up packs and journal entries written by index-pack */
+		reprepare_packed_git(the_repository);
+		reprepare_connectivity_journal();
+
+		/* do not even start rev-list if there is nothing to walk */
+		while (object_in_connectivity_journal(&oid)) {
+			if (fn(cb_data, &oid)) {
+				if (opt->err_fd)
+					close(opt->err_fd);
+				return err;
+			}
+		}
+	}
+
 	if (opt->shallow_file) {
 		argv_array_push(&rev_list.args, "--shallow-file");
 		argv_array_push(&rev_list.args, opt->shallow_file);
@@ -94,6 +281,13 @@ int check_connected(oid_iterate_fn fn, void *cb_data,
 		if (new_pack && find_pack_entry_one(oid.hash, new_pack))
 			continue;
 
+		/*
+		 * Likewise, everything reachable from an object in a pack
+		 * listed in the connectivity journal is known to exist.
+		 */
+		if (use_journal && object_in_connectivity_journal(&oid))
+			continue;
+
 		memcpy(commit, oid_to_hex(&oid), GIT_SHA1_HEXSZ);
 		if (write_in_full(rev_list.in, commit, GIT_SHA1_HEXSZ + 1) < 0) {
 			if (errno != EPIPE && errno != EINVAL)
@@ -2,6 +2,7 @@
 #define CONNECTED_H
 
 struct object_id;
+struct packed_git;
 struct transport;
 
 /*
@@ -62,4 +63,40 @@ struct check_connected_options {
 int check_connected(oid_iterate_fn fn, void *cb_data,
 		    struct check_connected_options *opt);
 
+/*
+ * The connectivity journal, enabled by core.connectivityJournal, is a
+ * list of packs in which every object is known to have all objects
+ * reachable from it present in the repository. index-pack adds
+ * received packs whose links all lead into the pack itself or into
+ * packs already in the journal, and "git fsck" rebuilds it from
+ * scratch. check_connected() does not walk from objects found in a
+ * pack listed in the journal.
+ *
+ * Anything that deletes objects which may be referenced from a listed
+ * pack (e.g. "git prune") must call clear_connectivity_journal().
+ */
+int connectivity_journal_enabled(void);
+
+/* Forget what we know about the journal; it is re-read on next use. */
+void reprepare_connectivity_journal(void);
+
+/* Is "p" listed in the journal? */
+int pack_in_connectivity_journal(struct packed_git *p);
+
+/* Is "oid" found in any pack listed in the journal? */
+int object_in_connectivity_journal(const struct object_id *oid);
+
+/*
+ * Add the pack with the given name hash to the journal. Returns 0 on
+ * success, and -1 if the journal could not be updated; the caller may
+ * treat the latter as a missed optimization.
+ */
+int add_to_connectivity_journal(const unsigned char *pack_hash);
+
+/* Replace the journal with the list of all local packs. */
+int write_connectivity_journal(void);
+
+/* Remove the journal. */
+void clear_connectivity_journal(void);
+
 #endif /* CONNECTED_H */
@@ -426,6 +426,17 @@ int git_diff_basic_config(const char *var, const char *value, void *cb)
 		return 0;
 	}
 
+	if (!strcmp(var, "diff.maxcost")) {
+		unsigned long max_cost = git_config_ulong(var, value);
+		git_xdiff_max_cost = max_cost > LONG_MAX ? LONG_MAX : max_cost;
+		return 0;
+	}
+
+	if (!strcmp(var, "diff.linehashcache")) {
+		git_xdiff_line_cache_size = git_config_int(var, value);
+		return 0;
+	}
+
 	if (userdiff_config(var, value) < 0)
 		return -1;
 
@@ -3527,8 +3538,11 @@ static void builtin_diff(const char *name_a,
 			xecfg.ctxlen = strtoul(v, NULL, 10);
 		if (o->word_diff)
 			init_diff_words_data(&ecbdata, o, one, two);
-		if (xdi_diff_outf(&mf1, &mf2, NULL, fn_out_consume,
-				  &ecbdata, &xpp, &xecfg))
+		if (xdi_diff_outf_blobs(&mf1,
+					!textconv_one && one->oid_valid ? &one->oid : NULL,
+					&mf2,
+					!textconv_two && two->oid_valid ? &two->oid : NULL,
+					NULL, fn_out_consume, &ecbdata, &xpp, &xecfg))
 			die("unable to generate diff for %s", one->path);
 		if (o->word_diff)
 			free_diff_words_data(&ecbdata);
@@ -3963,7 +3977,9 @@ int diff_populate_filespec(struct repository *r,
 				return 0;
 			}
 		}
-		s->data = read_object_file(&s->oid, &type, &s->size);
+		s->data = xdi_prefetched_blob(&s->oid, &s->size);
+		if (!s->data)
+			s->data = read_object_file(&s->oid, &type, &s->size);
 		if (!s->data)
 			die("unable to read %s", oid_to_hex(&s->oid));
 		s->should_free = 1;
@@ -3971,6 +3987,71 @@ int diff_populate_filespec(struct repository *r,
 	return 0;
 }
 
+void diff_tree_prefetch_blobs(const struct object_id *old_oid,
+			      const struct object_id *new_oid,
+			      struct diff_options *opt,
+			      unsigned long xdl_opts, int trim,
+			      struct diff_prefetch *prefetch)
+{
+	struct diff_options diffopt;
+	int i;
+
+	repo_diff_setup(opt->repo, &diffopt);
+	diffopt.flags.recursive = 1;
+	diffopt.flags.reverse_diff = opt->flags.reverse_diff;
+	diffopt.output_format = DIFF_FORMAT_NO_OUTPUT;
+	copy_pathspec(&diffopt.pathspec, &opt->pathspec);
+	diff_setup_done(&diffopt);
+
+	diff_tree_oid(old_oid, new_oid, "", &diffopt);
+	for (i = 0; i < diff_queued_diff.nr; i++) {
+		struct diff_filespec *one = diff_queued_diff.queue[i]->one;
+		struct diff_filespec *two = diff_queued_diff.queue[i]->two;
+		struct xdiff_prefetch *p;
+		mmfile_t mf1, mf2;
+		enum object_type type;
+		unsigned long size;
+
+		if (!S_ISREG(one->mode) || !S_ISREG(two->mode) ||
+		    oideq(&one->oid, &two->oid))
+			continue;
+
+		mf1.ptr = read_object_file(&one->oid, &type, &size);
+		mf1.size = size;
+		mf2.ptr = read_object_file(&two->oid, &type, &size);
+		mf2.size = size;
+		if (!mf1.ptr || !mf2.ptr ||
+		    (!opt->flags.text &&
+		     (mf1.size > big_file_threshold ||
+		      mf2.size > big_file_threshold ||
+		      buffer_is_binary(mf1.ptr, mf1.size) ||
+		      buffer_is_binary(mf2.ptr, mf2.size)))) {
+			free(mf1.ptr);
+			free(mf2.ptr);
+			continue;
+		}
+
+		p = xdi_prefetch_blobs(&mf1, &one->oid, &mf2, &two->oid,
+				       xdl_opts, trim);
+		if (p) {
+			ALLOC_GROW(prefetch->diff, prefetch->nr + 1, prefetch->alloc);
+			prefetch->diff[prefetch->nr++] = p;
+		}
+	}
+	diff_flush(&diffopt);
+	clear_pathspec(&diffopt.pathspec);
+}
+
+void diff_prefetch_release(struct diff_prefetch *prefetch)
+{
+	int i;
+
+	for (i = 0; i < prefetch->nr; i++)
+		xdi_release_prefetch(prefetch->diff[i]);
+	FREE_AND_NULL(prefetch->diff);
+	prefetch->nr = prefetch->alloc = 0;
+}
+
 void diff_free_filespec_blob(struct diff_filespec *s)
 {
 	if (s->should_free)
@@ -5769,8 +5850,12 @@ static int diff_get_patch_id(struct diff_options *options, struct object_id *oid
 		xpp.flags = 0;
 		xecfg.ctxlen = 3;
 		xecfg.flags = 0;
-		if (xdi_diff_outf(&mf1, &mf2, discard_hunk_line,
-				  patch_id_consume, &data, &xpp, &xecfg))
+		if (xdi_diff_outf_blobs(&mf1,
+					DIFF_FILE_VALID(p->one) ? &p->one->oid : NULL,
+					&mf2,
+					DIFF_FILE_VALID(p->two) ? &p->two->oid : NULL,
+					discard_hunk_line, patch_id_consume,
+					&data, &xpp, &xecfg))
 			return error("unable to generate patch-id diff for %s",
 				     p->one->path);
 	}
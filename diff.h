@@ -432,6 +432,27 @@ int run_diff_index(struct rev_info *revs, int cached);
 int do_diff_cache(const struct object_id *, struct diff_options *);
 int diff_flush_patch_id(struct diff_options *, struct object_id *, int);
 
+/*
+ * Diffs of blobs queued to the threads started by xdi_start_prefetch(),
+ * to be freed with diff_prefetch_release() once they are shown.
+ */
+struct diff_prefetch {
+	struct xdiff_prefetch **diff;
+	int nr, alloc;
+};
+
+/*
+ * Queue the diffs of the regular files that differ between the trees
+ * old_oid and new_oid (within the pathspec of "opt"), as shown with
+ * the xpparam_t flags xdl_opts and, if "trim", without context.
+ */
+void diff_tree_prefetch_blobs(const struct object_id *old_oid,
+			      const struct object_id *new_oid,
+			      struct diff_options *opt,
+			      unsigned long xdl_opts, int trim,
+			      struct diff_prefetch *prefetch);
+void diff_prefetch_release(struct diff_prefetch *prefetch);
+
 int diff_result_code(struct diff_options *, int);
 
 void diff_no_index(struct repository *, struct rev_info *, int, const char **);
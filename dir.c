@@ -21,6 +21,7 @@
 #include "ewah/ewok.h"
 #include "fsmonitor.h"
 #include "submodule-config.h"
+#include "thread-utils.h"
 
 /*
  * Tells read_directory_recursive how a file or directory should be treated.
@@ -49,6 +50,64 @@ struct cached_dir {
 	struct untracked_cache_dir *ucd;
 };
 
+/*
+ * A directory waiting to be scanned by read_directory_recursive() in
+ * a multi-threaded scan.
+ */
+struct dir_scan_job {
+	char *path;
+	int len;
+	struct untracked_cache_dir *untracked;
+};
+
+struct dir_scan_pool;
+
+/*
+ * Each thread scans with its own copy of the dir_struct, so that it
+ * has its own exclude stack and result lists, and its own copy of the
+ * untracked cache statistics. Jobs are kept in a deque: the owner
+ * takes the most recently queued directory (staying close to where it
+ * just was in the tree), while idle threads steal the oldest one,
+ * which tends to be the largest remaining subtree.
+ */
+struct dir_scan_worker {
+	pthread_t thread;
+	struct dir_scan_pool *pool;
+	struct dir_struct dir;
+	struct untracked_cache uc;
+	struct dir_scan_job *jobs;
+	int jobs_head, jobs_nr, jobs_alloc;
+};
+
+struct dir_scan_pool {
+	struct dir_scan_worker *workers;
+	int nr_workers;
+	struct index_state *istate;
+	const struct pathspec *pathspec;
+	/* protects the job deques and "pending" */
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	/* jobs queued or being scanned */
+	int pending;
+	/* serializes code that is not safe to run concurrently */
+	pthread_mutex_t serial_mutex;
+};
+
+static void scan_serial_lock(struct dir_struct *dir)
+{
+	if (dir->scan_worker)
+		pthread_mutex_lock(&dir->scan_worker->pool->serial_mutex);
+}
+
+static void scan_serial_unlock(struct dir_struct *dir)
+{
+	if (dir->scan_worker)
+		pthread_mutex_unlock(&dir->scan_worker->pool->serial_mutex);
+}
+
+static void queue_scan_jobs(struct dir_scan_worker *worker,
+			    struct dir_scan_job *jobs, int nr);
+
 static enum path_treatment read_directory_recursive(struct dir_struct *dir,
 	struct index_state *istate, const char *path, int len,
 	struct untracked_cache_dir *untracked,
@@ -681,6 +740,8 @@ static int read_skip_worktree_file_from_index(const struct index_state *istate,
 	return do_read_blob(&istate->cache[pos]->oid, oid_stat, size_out, data_out);
 }
 
+static void free_exclude_matcher(struct exclude_matcher *matcher);
+
 /*
  * Frees memory within el which was allocated for exclude patterns and
  * the file buffer.  Does not free el itself.
@@ -689,6 +750,7 @@ void clear_exclude_list(struct exclude_list *el)
 {
 	int i;
 
+	free_exclude_matcher(el->matcher);
 	for (i = 0; i < el->nr; i++)
 		free(el->excludes[i]);
 	free(el->excludes);
@@ -1054,6 +1116,285 @@ int match_pathname(const char *pathname, int pathlen,
 				 WM_PATHNAME) == 0;
 }
 
+static int exclude_dtype_matches(struct exclude *x, const char *pathname,
+				 int pathlen, int *dtype,
+				 struct index_state *istate)
+{
+	if (!(x->flags & EXC_FLAG_MUSTBEDIR))
+		return 1;
+	if (*dtype == DT_UNKNOWN)
+		*dtype = get_dtype(NULL, istate, pathname, pathlen);
+	return *dtype == DT_DIR;
+}
+
+static int exclude_matches(struct exclude *x, const char *pathname,
+			   int pathlen, const char *basename, int *dtype,
+			   struct index_state *istate)
+{
+	if (!exclude_dtype_matches(x, pathname, pathlen, dtype, istate))
+		return 0;
+
+	if (x->flags & EXC_FLAG_NODIR)
+		return match_basename(basename,
+				      pathlen - (basename - pathname),
+				      x->pattern, x->nowildcardlen,
+				      x->patternlen, x->flags);
+
+	assert(x->baselen == 0 || x->base[x->baselen - 1] == '/');
+	return match_pathname(pathname, pathlen,
+			      x->base, x->baselen ? x->baselen - 1 : 0,
+			      x->pattern, x->nowildcardlen, x->patternlen,
+			      x->flags);
+}
+
+/*
+ * Long exclude lists (e.g. generated .gitignore files) are mostly made
+ * of patterns that need no wildcard matching at all: literal basenames
+ * ("foo.o"), literal suffixes ("*.o") and literal paths ("/out/foo").
+ * These are indexed in hash tables keyed by the text they have to
+ * match, so that looking up a path costs a few hash lookups instead of
+ * a walk over the whole list. The remaining patterns are still tried
+ * one by one, but only those that come after the best hit from the
+ * tables, keeping the "last match wins" rule.
+ */
+#define EXCLUDE_MATCHER_MIN_PATTERNS 16
+
+struct exclude_literal {
+	struct hashmap_entry ent;
+	/* indices into exclude_list.excludes, in increasing order */
+	int *idx;
+	int nr, alloc;
+	int len;
+	char str[FLEX_ARRAY];
+};
+
+struct exclude_key {
+	const char *str;
+	int len;
+};
+
+struct exclude_matcher {
+	/* el->nr and ignore_case at the time the matcher was built */
+	int nr;
+	int icase;
+	struct hashmap basenames;
+	struct hashmap suffixes;
+	struct hashmap pathnames;
+	/* distinct lengths of the keys in "suffixes" */
+	int *suffix_len;
+	int suffix_len_nr, suffix_len_alloc;
+	/* indices of the patterns that need wildmatch() */
+	int *rest;
+	int rest_nr, rest_alloc;
+};
+
+static int exclude_literal_cmp(const void *unused_cmp_data,
+			       const void *entry,
+			       const void *entry_or_key,
+			       const void *keydata)
+{
+	const struct exclude_literal *a = entry;
+	const struct exclude_literal *b = entry_or_key;
+	const struct exclude_key *key = keydata;
+	const char *str = key ? key->str : b->str;
+	int len = key ? key->len : b->len;
+
+	return a->len != len || fspathncmp(a->str, str, len);
+}
+
+static unsigned int exclude_hash(const char *str, int len)
+{
+	return ignore_case ? memihash(str, len) : memhash(str, len);
+}
+
+static struct exclude_literal *find_exclude_literal(struct hashmap *map,
+						    const char *str, int len)
+{
+	struct exclude_key key;
+
+	key.str = str;
+	key.len = len;
+	return hashmap_get_from_hash(map, exclude_hash(str, len), &key);
+}
+
+static void add_exclude_literal(struct hashmap *map,
+				const char *str, int len, int idx)
+{
+	struct exclude_literal *e = find_exclude_literal(map, str, len);
+
+	if (!e) {
+		FLEX_ALLOC_MEM(e, str, str, len);
+		e->len = len;
+		hashmap_entry_init(e, exclude_hash(str, len));
+		hashmap_add(map, e);
+	}
+	ALLOC_GROW(e->idx, e->nr + 1, e->alloc);
+	e->idx[e->nr++] = idx;
+}
+
+static void free_exclude_literals(struct hashmap *map)
+{
+	struct hashmap_iter iter;
+	struct exclude_literal *e;
+
+	hashmap_iter_init(map, &iter);
+	while ((e = hashmap_iter_next(&iter)))
+		free(e->idx);
+	hashmap_free(map, 1);
+}
+
+static void free_exclude_matcher(struct exclude_matcher *matcher)
+{
+	if (!matcher)
+		return;
+	free_exclude_literals(&matcher->basenames);
+	free_exclude_literals(&matcher->suffixes);
+	free_exclude_literals(&matcher->pathnames);
+	free(matcher->suffix_len);
+	free(matcher->rest);
+	free(matcher);
+}
+
+static void add_suffix_len(struct exclude_matcher *matcher, int len)
+{
+	int i;
+
+	for (i = 0; i < matcher->suffix_len_nr; i++)
+		if (matcher->suffix_len[i] == len)
+			return;
+	ALLOC_GROW(matcher->suffix_len, matcher->suffix_len_nr + 1,
+		   matcher->suffix_len_alloc);
+	matcher->suffix_len[matcher->suffix_len_nr++] = len;
+}
+
+static struct exclude_matcher *build_exclude_matcher(struct exclude_list *el)
+{
+	struct exclude_matcher *matcher = xcalloc(1, sizeof(*matcher));
+	struct strbuf sb = STRBUF_INIT;
+	int i;
+
+	matcher->nr = el->nr;
+	matcher->icase = ignore_case;
+	hashmap_init(&matcher->basenames, exclude_literal_cmp, NULL, 0);
+	hashmap_init(&matcher->suffixes, exclude_literal_cmp, NULL, 0);
+	hashmap_init(&matcher->pathnames, exclude_literal_cmp, NULL, 0);
+
+	for (i = 0; i < el->nr; i++) {
+		struct exclude *x = el->excludes[i];
+		const char *pattern = x->pattern;
+		int patternlen = x->patternlen;
+		int literal = x->nowildcardlen == patternlen;
+
+		if (x->flags & EXC_FLAG_NODIR) {
+			if (literal) {
+				add_exclude_literal(&matcher->basenames,
+						    pattern, patternlen, i);
+				continue;
+			}
+			if (x->flags & EXC_FLAG_ENDSWITH) {
+				add_exclude_literal(&matcher->suffixes,
+						    pattern + 1, patternlen - 1, i);
+				add_suffix_len(matcher, patternlen - 1);
+				continue;
+			}
+		} else if (literal) {
+			if (*pattern == '/') {
+				pattern++;
+				patternlen--;
+			}
+			if (patternlen) {
+				/* x->base, if any, ends with a slash */
+				strbuf_reset(&sb);
+				strbuf_add(&sb, x->base, x->baselen);
+				strbuf_add(&sb, pattern, patternlen);
+				add_exclude_literal(&matcher->pathnames,
+						    sb.buf, sb.len, i);
+				continue;
+			}
+		}
+		ALLOC_GROW(matcher->rest, matcher->rest_nr + 1, matcher->rest_alloc);
+		matcher->rest[matcher->rest_nr++] = i;
+	}
+	strbuf_release(&sb);
+	return matcher;
+}
+
+/*
+ * Build or refresh the matcher of a long exclude list. Callers that
+ * share the list between threads must do this before starting them.
+ */
+static void prepare_exclude_matcher(struct exclude_list *el)
+{
+	if (el->nr < EXCLUDE_MATCHER_MIN_PATTERNS)
+		return;
+	if (el->matcher && el->matcher->nr == el->nr &&
+	    el->matcher->icase == ignore_case)
+		return;
+	free_exclude_matcher(el->matcher);
+	el->matcher = build_exclude_matcher(el);
+}
+
+/*
+ * Return the last index in "e" above "best" whose pattern applies to
+ * a path of the given type, or "best" if there is none.
+ */
+static int best_exclude_literal(struct exclude_literal *e, int best,
+				struct exclude_list *el,
+				const char *pathname, int pathlen, int *dtype,
+				struct index_state *istate)
+{
+	int i;
+
+	if (!e)
+		return best;
+	for (i = e->nr - 1; 0 <= i && best < e->idx[i]; i--)
+		if (exclude_dtype_matches(el->excludes[e->idx[i]],
+					  pathname, pathlen, dtype, istate))
+			return e->idx[i];
+	return best;
+}
+
+static struct exclude *last_exclude_matching_from_matcher(const char *pathname,
+							  int pathlen,
+							  const char *basename,
+							  int *dtype,
+							  struct exclude_list *el,
+							  struct index_state *istate)
+{
+	struct exclude_matcher *matcher = el->matcher;
+	int basenamelen = pathlen - (basename - pathname);
+	int best = -1;
+	int i;
+
+	best = best_exclude_literal(find_exclude_literal(&matcher->basenames,
+							 basename, basenamelen),
+				    best, el, pathname, pathlen, dtype, istate);
+	best = best_exclude_literal(find_exclude_literal(&matcher->pathnames,
+							 pathname, pathlen),
+				    best, el, pathname, pathlen, dtype, istate);
+	for (i = 0; i < matcher->suffix_len_nr; i++) {
+		int len = matcher->suffix_len[i];
+
+		if (len > basenamelen)
+			continue;
+		best = best_exclude_literal(
+			find_exclude_literal(&matcher->suffixes,
+					     basename + basenamelen - len, len),
+			best, el, pathname, pathlen, dtype, istate);
+	}
+
+	for (i = matcher->rest_nr - 1; 0 <= i && best < matcher->rest[i]; i--) {
+		struct exclude *x = el->excludes[matcher->rest[i]];
+
+		if (exclude_matches(x, pathname, pathlen, basename,
+				    dtype, istate)) {
+			best = matcher->rest[i];
+			break;
+		}
+	}
+	return best < 0 ? NULL : el->excludes[best];
+}
+
 /*
  * Scan the given exclude list in reverse to see whether pathname
  * should be ignored.  The first match (i.e. the last on the list), if
@@ -1067,44 +1408,25 @@ static struct exclude *last_exclude_matching_from_list(const char *pathname,
 						       struct exclude_list *el,
 						       struct index_state *istate)
 {
-	struct exclude *exc = NULL; /* undecided */
 	int i;
 
 	if (!el->nr)
 		return NULL;	/* undefined */
 
+	prepare_exclude_matcher(el);
+	if (el->matcher)
+		return last_exclude_matching_from_matcher(pathname, pathlen,
+							  basename, dtype,
+							  el, istate);
+
 	for (i = el->nr - 1; 0 <= i; i--) {
 		struct exclude *x = el->excludes[i];
-		const char *exclude = x->pattern;
-		int prefix = x->nowildcardlen;
-
-		if (x->flags & EXC_FLAG_MUSTBEDIR) {
-			if (*dtype == DT_UNKNOWN)
-				*dtype = get_dtype(NULL, istate, pathname, pathlen);
-			if (*dtype != DT_DIR)
-				continue;
-		}
-
-		if (x->flags & EXC_FLAG_NODIR) {
-			if (match_basename(basename,
-					   pathlen - (basename - pathname),
-					   exclude, prefix, x->patternlen,
-					   x->flags)) {
-				exc = x;
-				break;
-			}
-			continue;
-		}
 
-		assert(x->baselen == 0 || x->base[x->baselen - 1] == '/');
-		if (match_pathname(pathname, pathlen,
-				   x->base, x->baselen ? x->baselen - 1 : 0,
-				   exclude, prefix, x->patternlen, x->flags)) {
-			exc = x;
-			break;
-		}
+		if (exclude_matches(x, pathname, pathlen, basename,
+				    dtype, istate))
+			return x;
 	}
-	return exc;
+	return NULL;
 }
 
 /*
@@ -1271,8 +1593,11 @@ static void prep_exclude(struct dir_struct *dir,
 			strbuf_addbuf(&sb, &dir->basebuf);
 			strbuf_addstr(&sb, dir->exclude_per_dir);
 			el->src = strbuf_detach(&sb, NULL);
+			/* may read the object store and attributes */
+			scan_serial_lock(dir);
 			add_excludes(el->src, el->src, stk->baselen, el, istate,
 				     untracked ? &oid_stat : NULL);
+			scan_serial_unlock(dir);
 		}
 		/*
 		 * NEEDSWORK: when untracked cache is enabled, prep_exclude()
@@ -1506,7 +1831,12 @@ static enum path_treatment treat_directory(struct dir_struct *dir,
 		}
 		if (!(dir->flags & DIR_NO_GITLINKS)) {
 			struct object_id oid;
-			if (resolve_gitlink_ref(dirname, "HEAD", &oid) == 0)
+			int is_gitlink;
+
+			scan_serial_lock(dir);
+			is_gitlink = !resolve_gitlink_ref(dirname, "HEAD", &oid);
+			scan_serial_unlock(dir);
+			if (is_gitlink)
 				return exclude ? path_excluded : path_untracked;
 		}
 		return path_recurse;
@@ -1955,6 +2285,8 @@ static enum path_treatment read_directory_recursive(struct dir_struct *dir,
 	struct cached_dir cdir;
 	enum path_treatment state, subdir_state, dir_state = path_none;
 	struct strbuf path = STRBUF_INIT;
+	struct dir_scan_job *subdirs = NULL;
+	int subdirs_nr = 0, subdirs_alloc = 0;
 
 	strbuf_add(&path, base, baselen);
 
@@ -1981,12 +2313,25 @@ static enum path_treatment read_directory_recursive(struct dir_struct *dir,
 			ud = lookup_untracked(dir->untracked, untracked,
 					      path.buf + baselen,
 					      path.len - baselen);
-			subdir_state =
-				read_directory_recursive(dir, istate, path.buf,
-							 path.len, ud,
-							 check_only, stop_at_first_file, pathspec);
-			if (subdir_state > dir_state)
-				dir_state = subdir_state;
+			if (dir->scan_worker && !check_only) {
+				/*
+				 * Nobody looks at the state of a full
+				 * (not check_only) scan, so the subdirectory
+				 * can be handed to the thread pool.
+				 */
+				ALLOC_GROW(subdirs, subdirs_nr + 1, subdirs_alloc);
+				subdirs[subdirs_nr].path = xmemdupz(path.buf, path.len);
+				subdirs[subdirs_nr].len = path.len;
+				subdirs[subdirs_nr].untracked = ud;
+				subdirs_nr++;
+			} else {
+				subdir_state =
+					read_directory_recursive(dir, istate, path.buf,
+								 path.len, ud,
+								 check_only, stop_at_first_file, pathspec);
+				if (subdir_state > dir_state)
+					dir_state = subdir_state;
+			}
 		}
 
 		if (check_only) {
@@ -2047,6 +2392,14 @@ static enum path_treatment read_directory_recursive(struct dir_struct *dir,
 		}
 	}
 	close_cached_dir(&cdir);
+	/*
+	 * Only queue the subdirectories once we are done with this
+	 * one, as scanning them looks up (but must not race with the
+	 * creation of) their untracked cache entries in this directory.
+	 */
+	if (subdirs_nr)
+		queue_scan_jobs(dir->scan_worker, subdirs, subdirs_nr);
+	free(subdirs);
  out:
 	strbuf_release(&path);
 
@@ -2271,6 +2624,241 @@ static struct untracked_cache_dir *validate_untracked_cache(struct dir_struct *d
 	return root;
 }
 
+static void queue_scan_jobs(struct dir_scan_worker *worker,
+			    struct dir_scan_job *jobs, int nr)
+{
+	struct dir_scan_pool *pool = worker->pool;
+	int i;
+
+	pthread_mutex_lock(&pool->mutex);
+	if (worker->jobs_head && worker->jobs_nr + nr > worker->jobs_alloc) {
+		/* reclaim the slots of stolen jobs before growing */
+		worker->jobs_nr -= worker->jobs_head;
+		MOVE_ARRAY(worker->jobs, worker->jobs + worker->jobs_head,
+			   worker->jobs_nr);
+		worker->jobs_head = 0;
+	}
+	ALLOC_GROW(worker->jobs, worker->jobs_nr + nr, worker->jobs_alloc);
+	/* in reverse, so that the owner scans them in readdir() order */
+	for (i = nr - 1; i >= 0; i--)
+		worker->jobs[worker->jobs_nr++] = jobs[i];
+	pool->pending += nr;
+	pthread_cond_broadcast(&pool->cond);
+	pthread_mutex_unlock(&pool->mutex);
+}
+
+/* Called with pool->mutex held. */
+static int take_scan_job(struct dir_scan_worker *worker,
+			 struct dir_scan_job *job)
+{
+	struct dir_scan_pool *pool = worker->pool;
+	int i;
+
+	if (worker->jobs_head < worker->jobs_nr) {
+		*job = worker->jobs[--worker->jobs_nr];
+		if (worker->jobs_nr == worker->jobs_head)
+			worker->jobs_nr = worker->jobs_head = 0;
+		return 1;
+	}
+	for (i = 0; i < pool->nr_workers; i++) {
+		struct dir_scan_worker *victim = &pool->workers[i];
+
+		if (victim->jobs_head < victim->jobs_nr) {
+			*job = victim->jobs[victim->jobs_head++];
+			if (victim->jobs_nr == victim->jobs_head)
+				victim->jobs_nr = victim->jobs_head = 0;
+			return 1;
+		}
+	}
+	return 0;
+}
+
+static void *scan_worker_thread(void *data)
+{
+	struct dir_scan_worker *worker = data;
+	struct dir_scan_pool *pool = worker->pool;
+	struct dir_scan_job job;
+
+	pthread_mutex_lock(&pool->mutex);
+	for (;;) {
+		if (take_scan_job(worker, &job)) {
+			pthread_mutex_unlock(&pool->mutex);
+			read_directory_recursive(&worker->dir, pool->istate,
+						 job.path, job.len,
+						 job.untracked, 0, 0,
+						 pool->pathspec);
+			free(job.path);
+			pthread_mutex_lock(&pool->mutex);
+			if (!--pool->pending)
+				pthread_cond_broadcast(&pool->cond);
+			continue;
+		}
+		if (!pool->pending)
+			break;
+		pthread_cond_wait(&pool->cond, &pool->mutex);
+	}
+	pthread_mutex_unlock(&pool->mutex);
+	return NULL;
+}
+
+static void init_scan_worker(struct dir_scan_worker *worker,
+			     struct dir_scan_pool *pool,
+			     const struct dir_struct *dir)
+{
+	struct dir_struct *wdir = &worker->dir;
+
+	worker->pool = pool;
+
+	/* share the command line and global exclude lists... */
+	*wdir = *dir;
+	/* ...but keep our own results and per-directory state */
+	wdir->nr = wdir->alloc = 0;
+	wdir->entries = NULL;
+	wdir->ignored_nr = wdir->ignored_alloc = 0;
+	wdir->ignored = NULL;
+	memset(&wdir->exclude_list_group[EXC_DIRS], 0,
+	       sizeof(wdir->exclude_list_group[EXC_DIRS]));
+	wdir->exclude_stack = NULL;
+	wdir->exclude = NULL;
+	strbuf_init(&wdir->basebuf, 0);
+	wdir->scan_worker = worker;
+
+	if (dir->untracked) {
+		worker->uc = *dir->untracked;
+		worker->uc.dir_created = 0;
+		worker->uc.gitignore_invalidated = 0;
+		worker->uc.dir_invalidated = 0;
+		worker->uc.dir_opened = 0;
+		wdir->untracked = &worker->uc;
+	}
+}
+
+static void finish_scan_worker(struct dir_scan_worker *worker,
+			       struct dir_struct *dir)
+{
+	struct dir_struct *wdir = &worker->dir;
+	struct exclude_list_group *group = &wdir->exclude_list_group[EXC_DIRS];
+	struct exclude_stack *stk;
+	int i;
+
+	ALLOC_GROW(dir->entries, dir->nr + wdir->nr, dir->alloc);
+	COPY_ARRAY(dir->entries + dir->nr, wdir->entries, wdir->nr);
+	dir->nr += wdir->nr;
+	free(wdir->entries);
+
+	ALLOC_GROW(dir->ignored, dir->ignored_nr + wdir->ignored_nr,
+		   dir->ignored_alloc);
+	COPY_ARRAY(dir->ignored + dir->ignored_nr, wdir->ignored,
+		   wdir->ignored_nr);
+	dir->ignored_nr += wdir->ignored_nr;
+	free(wdir->ignored);
+
+	if (dir->untracked) {
+		dir->untracked->dir_created += worker->uc.dir_created;
+		dir->untracked->gitignore_invalidated +=
+			worker->uc.gitignore_invalidated;
+		dir->untracked->dir_invalidated += worker->uc.dir_invalidated;
+		dir->untracked->dir_opened += worker->uc.dir_opened;
+	}
+
+	for (i = 0; i < group->nr; i++) {
+		free((char *)group->el[i].src);
+		clear_exclude_list(&group->el[i]);
+	}
+	free(group->el);
+	stk = wdir->exclude_stack;
+	while (stk) {
+		struct exclude_stack *prev = stk->prev;
+		free(stk);
+		stk = prev;
+	}
+	strbuf_release(&wdir->basebuf);
+	free(worker->jobs);
+}
+
+static int untracked_scan_threads(const struct pathspec *pathspec)
+{
+	int nr_threads = 1;
+
+	if (!HAVE_THREADS)
+		return 1;
+	/* attribute lookups are not thread-safe */
+	if (pathspec && (pathspec->magic & PATHSPEC_ATTR))
+		return 1;
+	git_config_get_int("core.untrackedscanthreads", &nr_threads);
+	nr_threads = git_env_ulong("GIT_TEST_UNTRACKED_SCAN_THREADS",
+				   nr_threads);
+	if (nr_threads <= 0)
+		nr_threads = online_cpus();
+	return nr_threads;
+}
+
+/*
+ * Like read_directory_recursive() on the top-level directory, but fan
+ * the subdirectories out to "nr_threads" threads. The entries end up
+ * in "dir" in no particular order; read_directory() sorts them.
+ */
+static void read_directory_parallel(struct dir_struct *dir,
+				    struct index_state *istate,
+				    const char *path, int len,
+				    struct untracked_cache_dir *untracked,
+				    const struct pathspec *pathspec,
+				    int nr_threads)
+{
+	struct dir_scan_pool pool;
+	struct dir_scan_job root;
+	int i;
+
+	/* do the lazy initialization that the threads would race on */
+	lazy_init_name_hash(istate);
+	if (dir->untracked)
+		refresh_fsmonitor(istate);
+
+	memset(&pool, 0, sizeof(pool));
+	pool.istate = istate;
+	pool.pathspec = pathspec;
+	pool.nr_workers = nr_threads;
+	pthread_mutex_init(&pool.mutex, NULL);
+	pthread_mutex_init(&pool.serial_mutex, NULL);
+	pthread_cond_init(&pool.cond, NULL);
+	for (i = EXC_CMDL; i <= EXC_FILE; i++) {
+		struct exclude_list_group *group = &dir->exclude_list_group[i];
+		int j;
+
+		for (j = 0; j < group->nr; j++)
+			prepare_exclude_matcher(&group->el[j]);
+	}
+
+	pool.workers = xcalloc(nr_threads, sizeof(*pool.workers));
+	for (i = 0; i < nr_threads; i++)
+		init_scan_worker(&pool.workers[i], &pool, dir);
+
+	root.path = xmemdupz(path, len);
+	root.len = len;
+	root.untracked = untracked;
+	queue_scan_jobs(&pool.workers[0], &root, 1);
+
+	for (i = 0; i < nr_threads; i++) {
+		int err = pthread_create(&pool.workers[i].thread, NULL,
+					 scan_worker_thread, &pool.workers[i]);
+		if (err)
+			die(_("unable to create threaded directory scan: %s"),
+			    strerror(err));
+	}
+	for (i = 0; i < nr_threads; i++) {
+		int err = pthread_join(pool.workers[i].thread, NULL);
+		if (err)
+			die(_("unable to join threaded directory scan: %s"),
+			    strerror(err));
+		finish_scan_worker(&pool.workers[i], dir);
+	}
+
+	free(pool.workers);
+	pthread_cond_destroy(&pool.cond);
+	pthread_mutex_destroy(&pool.serial_mutex);
+	pthread_mutex_destroy(&pool.mutex);
+}
+
 int read_directory(struct dir_struct *dir, struct index_state *istate,
 		   const char *path, int len, const struct pathspec *pathspec)
 {
@@ -2290,8 +2878,16 @@ int read_directory(struct dir_struct *dir, struct index_state *istate,
 		 * e.g. prep_exclude()
 		 */
 		dir->untracked = NULL;
-	if (!len || treat_leading_path(dir, istate, path, len, pathspec))
-		read_directory_recursive(dir, istate, path, len, untracked, 0, 0, pathspec);
+	if (!len || treat_leading_path(dir, istate, path, len, pathspec)) {
+		int nr_threads = untracked_scan_threads(pathspec);
+
+		if (nr_threads > 1)
+			read_directory_parallel(dir, istate, path, len,
+						untracked, pathspec, nr_threads);
+		else
+			read_directory_recursive(dir, istate, path, len,
+						 untracked, 0, 0, pathspec);
+	}
 	QSORT(dir->entries, dir->nr, cmp_dir_entry);
 	QSORT(dir->ignored, dir->ignored_nr, cmp_dir_entry);
 
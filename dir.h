@@ -55,6 +55,9 @@ struct exclude_list {
 	const char *src;
 
 	struct exclude **excludes;
+
+	/* hash tables over "excludes" for long lists, built on first use */
+	struct exclude_matcher *matcher;
 };
 
 /*
@@ -194,6 +197,12 @@ struct dir_struct {
 	struct exclude *exclude;
 	struct strbuf basebuf;
 
+	/*
+	 * Set on the per-thread copies of the dir_struct used when
+	 * read_directory() scans the worktree with multiple threads.
+	 */
+	struct dir_scan_worker *scan_worker;
+
 	/* Enable untracked file cache if set */
 	struct untracked_cache *untracked;
 	struct oid_stat ss_info_exclude;
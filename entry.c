@@ -6,6 +6,8 @@
 #include "submodule.h"
 #include "progress.h"
 #include "fsmonitor.h"
+#include "config.h"
+#include "thread-utils.h"
 
 static void create_directories(const char *path, int path_len,
 			       const struct checkout *state)
@@ -140,6 +142,237 @@ static int streaming_write_entry(const struct cache_entry *ce, char *path,
 	return result;
 }
 
+/*
+ * Bound the size of the blobs read and converted ahead of the workers
+ * writing them out.
+ */
+#define ASYNC_CHECKOUT_MAX_IN_FLIGHT (32 * 1024 * 1024)
+
+struct async_write {
+	struct async_write *next;
+	struct cache_entry *ce;
+	char *path;
+	char *buf;
+	size_t size;
+	unsigned use_fstat:1,
+		 want_stat:1;
+	/* filled in by the worker */
+	struct stat st;
+	const char *failed;
+	int saved_errno;
+};
+
+struct async_checkout {
+	pthread_mutex_t mutex;
+	pthread_cond_t work_cond;
+	pthread_cond_t done_cond;
+	pthread_t *threads;
+	int nr_threads;
+	struct async_write *todo, **todo_tail;
+	struct async_write *done, **done_tail;
+	size_t in_flight;
+	int pending;
+	int stop;
+	int errs;
+};
+
+static void do_async_write(struct async_write *w)
+{
+	int fd = create_file(w->path, w->ce->ce_mode);
+
+	if (fd < 0) {
+		w->failed = "unable to create file %s";
+		w->saved_errno = errno;
+		return;
+	}
+	if (write_in_full(fd, w->buf, w->size) < 0) {
+		w->failed = "unable to write file %s";
+		w->saved_errno = errno;
+		close(fd);
+		return;
+	}
+	if (w->use_fstat) {
+		fstat(fd, &w->st);
+		w->want_stat = 0;
+	}
+	close(fd);
+	if (w->want_stat && lstat(w->ce->name, &w->st) < 0) {
+		w->failed = "unable to stat just-written file %s";
+		w->saved_errno = errno;
+	}
+}
+
+static void *async_checkout_thread(void *data)
+{
+	struct async_checkout *ac = data;
+
+	pthread_mutex_lock(&ac->mutex);
+	for (;;) {
+		struct async_write *w;
+
+		while (!ac->todo && !ac->stop)
+			pthread_cond_wait(&ac->work_cond, &ac->mutex);
+		if (!ac->todo)
+			break;
+		w = ac->todo;
+		ac->todo = w->next;
+		if (!ac->todo)
+			ac->todo_tail = &ac->todo;
+		pthread_mutex_unlock(&ac->mutex);
+
+		do_async_write(w);
+
+		pthread_mutex_lock(&ac->mutex);
+		w->next = NULL;
+		*ac->done_tail = w;
+		ac->done_tail = &w->next;
+		pthread_cond_signal(&ac->done_cond);
+	}
+	pthread_mutex_unlock(&ac->mutex);
+	return NULL;
+}
+
+/*
+ * Record the stat data of the entries written so far, in the order
+ * they completed, waiting for at least one if "wait" is set.
+ */
+static void collect_async_writes(const struct checkout *state, int wait)
+{
+	struct async_checkout *ac = state->async_checkout;
+	struct async_write *w;
+
+	pthread_mutex_lock(&ac->mutex);
+	while (wait && !ac->done)
+		pthread_cond_wait(&ac->done_cond, &ac->mutex);
+	w = ac->done;
+	ac->done = NULL;
+	ac->done_tail = &ac->done;
+	pthread_mutex_unlock(&ac->mutex);
+
+	while (w) {
+		struct async_write *next = w->next;
+		struct cache_entry *ce = w->ce;
+
+		ac->in_flight -= w->size;
+		ac->pending--;
+		if (w->failed) {
+			errno = w->saved_errno;
+			ac->errs |= error_errno(w->failed, w->path);
+		} else if (state->refresh_cache) {
+			fill_stat_cache_info(ce, &w->st);
+			ce->ce_flags |= CE_UPDATE_IN_BASE;
+			mark_fsmonitor_invalid(state->istate, ce);
+			state->istate->cache_changed |= CE_ENTRY_CHANGED;
+		}
+		free(w->path);
+		free(w->buf);
+		free(w);
+		w = next;
+	}
+}
+
+static void queue_async_write(struct cache_entry *ce, const char *path,
+			      char *buf, size_t size,
+			      const struct checkout *state)
+{
+	struct async_checkout *ac = state->async_checkout;
+	struct async_write *w = xcalloc(1, sizeof(*w));
+
+	w->ce = ce;
+	w->path = xstrdup(path);
+	w->buf = buf;
+	w->size = size;
+	w->want_stat = state->refresh_cache;
+	/* use fstat() only when path == ce->name, as in fstat_output() */
+	w->use_fstat = fstat_is_reliable() &&
+		state->refresh_cache && !state->base_dir_len;
+
+	collect_async_writes(state, 0);
+	while (ac->pending &&
+	       ac->in_flight + size > ASYNC_CHECKOUT_MAX_IN_FLIGHT)
+		collect_async_writes(state, 1);
+
+	ac->in_flight += size;
+	ac->pending++;
+	pthread_mutex_lock(&ac->mutex);
+	*ac->todo_tail = w;
+	ac->todo_tail = &w->next;
+	pthread_cond_signal(&ac->work_cond);
+	pthread_mutex_unlock(&ac->mutex);
+}
+
+static int checkout_workers(void)
+{
+	int workers;
+
+	workers = git_env_ulong("GIT_TEST_CHECKOUT_WORKERS", 0);
+	if (!workers && git_config_get_int("checkout.workers", &workers))
+		workers = 1;
+	if (workers < 1)
+		workers = online_cpus();
+	return workers;
+}
+
+void enable_async_checkout(struct checkout *state)
+{
+	struct async_checkout *ac;
+	int i, workers = checkout_workers();
+
+	/*
+	 * On a case insensitive file system, two entries may be
+	 * checked out to the same file, which checkout_entry() only
+	 * notices if the first one has been written already.
+	 */
+	if (!HAVE_THREADS || workers < 2 || ignore_case ||
+	    state->async_checkout)
+		return;
+
+	ac = xcalloc(1, sizeof(*ac));
+	pthread_mutex_init(&ac->mutex, NULL);
+	pthread_cond_init(&ac->work_cond, NULL);
+	pthread_cond_init(&ac->done_cond, NULL);
+	ac->todo_tail = &ac->todo;
+	ac->done_tail = &ac->done;
+	ac->nr_threads = workers;
+	ALLOC_ARRAY(ac->threads, workers);
+	for (i = 0; i < workers; i++) {
+		int err = pthread_create(&ac->threads[i], NULL,
+					 async_checkout_thread, ac);
+		if (err)
+			die(_("unable to create checkout thread: %s"),
+			    strerror(err));
+	}
+	state->async_checkout = ac;
+}
+
+int finish_async_checkout(struct checkout *state)
+{
+	struct async_checkout *ac = state->async_checkout;
+	int i, errs;
+
+	if (!ac)
+		return 0;
+
+	while (ac->pending)
+		collect_async_writes(state, 1);
+
+	pthread_mutex_lock(&ac->mutex);
+	ac->stop = 1;
+	pthread_cond_broadcast(&ac->work_cond);
+	pthread_mutex_unlock(&ac->mutex);
+	for (i = 0; i < ac->nr_threads; i++)
+		if (pthread_join(ac->threads[i], NULL))
+			die("unable to join checkout thread");
+
+	errs = ac->errs;
+	pthread_cond_destroy(&ac->work_cond);
+	pthread_cond_destroy(&ac->done_cond);
+	pthread_mutex_destroy(&ac->mutex);
+	free(ac->threads);
+	FREE_AND_NULL(state->async_checkout);
+	return errs;
+}
+
 void enable_delayed_checkout(struct checkout *state)
 {
 	if (!state->delayed_checkout) {
@@ -334,6 +567,11 @@ static int write_entry(struct cache_entry *ce,
 		 * filter is required), then we would have died already.
 		 */
 
+		if (state->async_checkout && !to_tempfile) {
+			queue_async_write(ce, path, new_blob, size, state);
+			return 0;
+		}
+
 	write_file_entry:
 		fd = open_output_fd(path, ce, to_tempfile);
 		if (fd < 0) {
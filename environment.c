@@ -47,6 +47,7 @@ int fsync_object_files;
 size_t packed_git_window_size = DEFAULT_PACKED_GIT_WINDOW_SIZE;
 size_t packed_git_limit = DEFAULT_PACKED_GIT_LIMIT;
 size_t delta_base_cache_limit = 96 * 1024 * 1024;
+size_t tree_cache_limit = 1024 * 1024;
 unsigned long big_file_threshold = 512 * 1024 * 1024;
 int pager_use_color = 1;
 const char *editor_program;
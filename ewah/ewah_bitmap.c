@@ -276,6 +276,33 @@ void ewah_each_bit(struct ewah_bitmap *self, void (*callback)(size_t, void*), vo
 	}
 }
 
+int ewah_get(struct ewah_bitmap *self, size_t pos)
+{
+	size_t word_pos = pos / BITS_IN_EWORD;
+	size_t cur = 0;
+	size_t pointer = 0;
+
+	while (pointer < self->buffer_size) {
+		eword_t *word = &self->buffer[pointer];
+		size_t run = rlw_get_running_len(word);
+		size_t literals = rlw_get_literal_words(word);
+
+		if (word_pos < cur + run)
+			return rlw_get_run_bit(word);
+		cur += run;
+
+		if (word_pos < cur + literals) {
+			eword_t literal = self->buffer[pointer + 1 + word_pos - cur];
+			return (literal & ((eword_t)1 << (pos % BITS_IN_EWORD))) != 0;
+		}
+		cur += literals;
+
+		pointer += 1 + literals;
+	}
+
+	return 0;
+}
+
 /**
  * Clear all the bits in the bitmap. Does not free or resize
  * memory.
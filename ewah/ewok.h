@@ -114,6 +114,14 @@ void ewah_each_bit(struct ewah_bitmap *self, ewah_callback callback, void *paylo
  */
 void ewah_set(struct ewah_bitmap *self, size_t i);
 
+/**
+ * Return whether the bit at position `pos` is set.
+ *
+ * This skips over compressed runs without decompressing them, so it
+ * costs time proportional to the number of runs before `pos`.
+ */
+int ewah_get(struct ewah_bitmap *self, size_t pos);
+
 struct ewah_iterator {
 	const eword_t *buffer;
 	size_t buffer_size;
@@ -58,6 +58,14 @@ extern void line_log_init(struct rev_info *rev, const char *prefix, struct strin
 
 extern int line_log_filter(struct rev_info *rev);
 
+/*
+ * Process the line ranges of a single commit, passing them on to its
+ * parents.  Returns 1 if the commit changes any of its ranges, 0 if it
+ * is to be skipped.  The commit's children must have been processed.
+ */
+extern int line_log_process_ranges_arbitrary_commit(struct rev_info *rev,
+						     struct commit *commit);
+
 extern int line_log_print(struct rev_info *rev, struct commit *commit);
 
 #endif /* LINE_LOG_H */
@@ -908,6 +908,33 @@ static int log_tree_diff(struct rev_info *opt, struct commit *commit, struct log
 	return showed_log;
 }
 
+void log_tree_prefetch(struct rev_info *opt, struct commit *commit,
+		       struct diff_prefetch *prefetch)
+{
+	struct commit_list *parents;
+	int trim = !opt->diffopt.context && !opt->diffopt.flags.funccontext;
+
+	if (!opt->diff || !(opt->diffopt.output_format & DIFF_FORMAT_PATCH) ||
+	    opt->diffopt.flags.follow_renames || opt->diffopt.anchors_nr ||
+	    opt->line_level_traverse)
+		return;
+
+	parse_commit_or_die(commit);
+	parents = get_saved_parents(opt, commit);
+	if (parents && parents->next &&
+	    (opt->ignore_merges || opt->combine_merges))
+		return;
+	for (; parents; parents = parents->next) {
+		parse_commit_or_die(parents->item);
+		diff_tree_prefetch_blobs(get_commit_tree_oid(parents->item),
+					 get_commit_tree_oid(commit),
+					 &opt->diffopt, opt->diffopt.xdl_opts, trim,
+					 prefetch);
+		if (opt->first_parent_only)
+			break;
+	}
+}
+
 int log_tree_commit(struct rev_info *opt, struct commit *commit)
 {
 	struct log_info log;
@@ -15,6 +15,7 @@ int parse_decorate_color_config(const char *var, const char *slot_name, const ch
 void init_log_tree_opt(struct rev_info *);
 int log_tree_diff_flush(struct rev_info *);
 int log_tree_commit(struct rev_info *, struct commit *);
+void log_tree_prefetch(struct rev_info *, struct commit *, struct diff_prefetch *);
 int log_tree_opt_parse(struct rev_info *, const char **, int);
 void show_log(struct rev_info *opt);
 void format_decorations_extended(struct strbuf *sb, const struct commit *commit,
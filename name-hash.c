@@ -14,9 +14,30 @@ struct dir_entry {
 	struct dir_entry *parent;
 	int nr;
 	unsigned int namelen;
+	unsigned int id; /* scratch space for write_name_hash_extension() */
 	char name[FLEX_ARRAY];
 };
 
+/*
+ * The name hash as found in the "NHSH" index extension, in host byte
+ * order.  Directories are numbered from 1 in the order they appear
+ * (parents before their children) and each one is described by
+ *
+ *   - the hash of its name,
+ *   - the number of its parent directory (0 for the top level),
+ *   - the position of an index entry whose path starts with it,
+ *   - the length of its name.
+ *
+ * Each index entry is then described by the hash of its name and the
+ * number of the directory it is in.
+ */
+struct stored_name_hash {
+	unsigned int nr_dirs;
+	unsigned int nr_entries;
+	uint32_t *dirs;
+	uint32_t *entries;
+};
+
 static int dir_entry_cmp(const void *unused_cmp_data,
 			 const void *entry,
 			 const void *entry_or_key,
@@ -566,8 +587,67 @@ static void threaded_lazy_init_name_hash(
 	free(lazy_entries);
 }
 
-static void lazy_init_name_hash(struct index_state *istate)
+/*
+ * Fill the hash tables from the hashes saved in the index file,
+ * instead of computing them again.  This is only done if the index
+ * entries have not changed since they were read.
+ */
+static int load_stored_name_hash(struct index_state *istate)
+{
+	struct stored_name_hash *stored = istate->stored_name_hash;
+	struct dir_entry **dirs;
+	unsigned int i;
+
+	if (!stored || !ignore_case || istate->partially_read ||
+	    stored->nr_entries != istate->cache_nr)
+		return 0;
+
+	for (i = 0; i < stored->nr_dirs; i++) {
+		const uint32_t *d = stored->dirs + 4 * i;
+		const struct cache_entry *ce;
+
+		if (d[1] > i || d[2] >= stored->nr_entries)
+			return 0;
+		ce = istate->cache[d[2]];
+		if (!d[3] || d[3] >= ce_namelen(ce) || ce->name[d[3]] != '/')
+			return 0;
+	}
+	for (i = 0; i < stored->nr_entries; i++)
+		if (stored->entries[2 * i + 1] > stored->nr_dirs)
+			return 0;
+
+	ALLOC_ARRAY(dirs, stored->nr_dirs);
+	for (i = 0; i < stored->nr_dirs; i++) {
+		const uint32_t *d = stored->dirs + 4 * i;
+		struct dir_entry *dir;
+
+		FLEX_ALLOC_MEM(dir, name, istate->cache[d[2]]->name, d[3]);
+		hashmap_entry_init(dir, d[0]);
+		dir->namelen = d[3];
+		if (d[1]) {
+			dir->parent = dirs[d[1] - 1];
+			dir->parent->nr++;
+		}
+		hashmap_add(&istate->dir_hash, dir);
+		dirs[i] = dir;
+	}
+	for (i = 0; i < stored->nr_entries; i++) {
+		struct cache_entry *ce = istate->cache[i];
+		uint32_t dir = stored->entries[2 * i + 1];
+
+		ce->ce_flags |= CE_HASHED;
+		hashmap_entry_init(ce, stored->entries[2 * i]);
+		hashmap_add(&istate->name_hash, ce);
+		if (dir)
+			dirs[dir - 1]->nr++;
+	}
+	free(dirs);
+	return 1;
+}
+
+void lazy_init_name_hash(struct index_state *istate)
 {
+	int stored;
 
 	if (istate->name_hash_initialized)
 		return;
@@ -575,7 +655,9 @@ static void lazy_init_name_hash(struct index_state *istate)
 	hashmap_init(&istate->name_hash, cache_entry_cmp, NULL, istate->cache_nr);
 	hashmap_init(&istate->dir_hash, dir_entry_cmp, NULL, istate->cache_nr);
 
-	if (lookup_lazy_params(istate)) {
+	stored = load_stored_name_hash(istate);
+	discard_stored_name_hash(istate);
+	if (!stored && lookup_lazy_params(istate)) {
 		/*
 		 * Disable item counting and automatic rehashing because
 		 * we do per-chain (mod n) locking rather than whole hashmap
@@ -585,14 +667,15 @@ static void lazy_init_name_hash(struct index_state *istate)
 		hashmap_disable_item_counting(&istate->dir_hash);
 		threaded_lazy_init_name_hash(istate);
 		hashmap_enable_item_counting(&istate->dir_hash);
-	} else {
+	} else if (!stored) {
 		int nr;
 		for (nr = 0; nr < istate->cache_nr; nr++)
 			hash_index_entry(istate, istate->cache[nr]);
 	}
 
 	istate->name_hash_initialized = 1;
-	trace_performance_leave("initialize name hash");
+	trace_performance_leave(stored ? "load name hash from index" :
+				"initialize name hash");
 }
 
 /*
@@ -622,6 +705,7 @@ void add_name_hash(struct index_state *istate, struct cache_entry *ce)
 
 void remove_name_hash(struct index_state *istate, struct cache_entry *ce)
 {
+	discard_stored_name_hash(istate);
 	if (!istate->name_hash_initialized || !(ce->ce_flags & CE_HASHED))
 		return;
 	ce->ce_flags &= ~CE_HASHED;
@@ -715,8 +799,127 @@ struct cache_entry *index_file_exists(struct index_state *istate, const char *na
 	return NULL;
 }
 
+void read_name_hash_extension(struct index_state *istate,
+			      const char *data, unsigned long sz)
+{
+	struct stored_name_hash *stored;
+	unsigned int nr_dirs, nr_words, i;
+
+	if (sz < 4 || sz % 8 != 4)
+		return;
+	nr_dirs = get_be32(data);
+	if (nr_dirs > (sz - 4) / 16)
+		return;
+
+	discard_stored_name_hash(istate);
+	nr_words = (sz - 4) / 4;
+	stored = xmalloc(sizeof(*stored));
+	ALLOC_ARRAY(stored->dirs, nr_words);
+	for (i = 0; i < nr_words; i++)
+		stored->dirs[i] = get_be32(data + 4 + 4 * i);
+	stored->nr_dirs = nr_dirs;
+	stored->entries = stored->dirs + 4 * nr_dirs;
+	stored->nr_entries = (nr_words - 4 * nr_dirs) / 2;
+	istate->stored_name_hash = stored;
+}
+
+static void add_be32(struct strbuf *sb, uint32_t value)
+{
+	uint32_t be = htonl(value);
+	strbuf_add(sb, &be, sizeof(be));
+}
+
+static void write_dir_entry(struct strbuf *sb, struct dir_entry *dir,
+			    unsigned int pos, unsigned int *nr_dirs)
+{
+	if (!dir || dir->id)
+		return;
+	write_dir_entry(sb, dir->parent, pos, nr_dirs);
+	dir->id = ++*nr_dirs;
+	add_be32(sb, dir->ent.hash);
+	add_be32(sb, dir->parent ? dir->parent->id : 0);
+	add_be32(sb, pos);
+	add_be32(sb, dir->namelen);
+}
+
+/*
+ * Save the name hash for the entries that will be written out, i.e.
+ * those not marked CE_REMOVE.  Returns -1 (and writes nothing) if the
+ * hash tables do not match the index.
+ */
+int write_name_hash_extension(struct strbuf *sb, struct index_state *istate)
+{
+	struct strbuf dirs = STRBUF_INIT, entries = STRBUF_INIT;
+	struct hashmap_iter iter;
+	struct dir_entry *dir, *last = NULL;
+	const char *last_name = NULL;
+	unsigned int nr_dirs = 0, pos = 0, i;
+
+	lazy_init_name_hash(istate);
+
+	for (dir = hashmap_iter_first(&istate->dir_hash, &iter);
+	     dir;
+	     dir = hashmap_iter_next(&iter))
+		dir->id = 0;
+
+	for (i = 0; i < istate->cache_nr; i++) {
+		const struct cache_entry *ce = istate->cache[i];
+		int len = ce_namelen(ce);
+
+		if (ce->ce_flags & CE_REMOVE)
+			continue;
+		if (!(ce->ce_flags & CE_HASHED))
+			goto fail;
+
+		while (len > 0 && ce->name[len - 1] != '/')
+			len--;
+		if (len)
+			len--;
+
+		if (!len)
+			dir = NULL;
+		else if (last && last->namelen == len &&
+			 !memcmp(last_name, ce->name, len))
+			dir = last;
+		else if (!(dir = find_dir_entry(istate, ce->name, len)))
+			goto fail;
+		if (dir) {
+			last = dir;
+			last_name = ce->name;
+		}
+
+		write_dir_entry(&dirs, dir, pos, &nr_dirs);
+		add_be32(&entries, ce->ent.hash);
+		add_be32(&entries, dir ? dir->id : 0);
+		pos++;
+	}
+
+	add_be32(sb, nr_dirs);
+	strbuf_addbuf(sb, &dirs);
+	strbuf_addbuf(sb, &entries);
+	strbuf_release(&dirs);
+	strbuf_release(&entries);
+	return 0;
+
+fail:
+	strbuf_release(&dirs);
+	strbuf_release(&entries);
+	return -1;
+}
+
+void discard_stored_name_hash(struct index_state *istate)
+{
+	struct stored_name_hash *stored = istate->stored_name_hash;
+
+	if (!stored)
+		return;
+	free(stored->dirs);
+	FREE_AND_NULL(istate->stored_name_hash);
+}
+
 void free_name_hash(struct index_state *istate)
 {
+	discard_stored_name_hash(istate);
 	if (!istate->name_hash_initialized)
 		return;
 	istate->name_hash_initialized = 0;
@@ -420,6 +420,60 @@ static int ext_index_add_object(struct bitmap_index *bitmap_git,
 	return bitmap_pos + bitmap_git->pack->num_objects;
 }
 
+int bitmap_object_position(struct bitmap_index *bitmap_git,
+			   const struct object_id *oid)
+{
+	return bitmap_position(bitmap_git, oid->hash);
+}
+
+struct ewah_bitmap *bitmap_for_commit(struct bitmap_index *bitmap_git,
+				      struct commit *commit)
+{
+	khiter_t hash_pos = kh_get_sha1(bitmap_git->bitmaps,
+					commit->object.oid.hash);
+
+	if (hash_pos >= kh_end(bitmap_git->bitmaps))
+		return NULL;
+	return lookup_stored_bitmap(kh_value(bitmap_git->bitmaps, hash_pos));
+}
+
+struct bitmap *bitmap_reachable_from_commit(struct bitmap_index *bitmap_git,
+					    struct commit *tip)
+{
+	struct bitmap *result = bitmap_new();
+	struct commit_list *stack = NULL;
+
+	commit_list_insert(tip, &stack);
+	while (stack) {
+		struct commit *commit = pop_commit(&stack);
+		struct ewah_bitmap *stored;
+		struct commit_list *parent;
+		int pos;
+
+		pos = bitmap_position(bitmap_git, commit->object.oid.hash);
+		if (pos >= 0 && bitmap_get(result, pos))
+			continue;
+
+		stored = bitmap_for_commit(bitmap_git, commit);
+		if (stored) {
+			bitmap_or_ewah(result, stored);
+			continue;
+		}
+
+		if (pos < 0)
+			pos = ext_index_add_object(bitmap_git,
+						   (struct object *)commit,
+						   NULL);
+		bitmap_set(result, pos);
+
+		parse_commit_or_die(commit);
+		for (parent = commit->parents; parent; parent = parent->next)
+			commit_list_insert(parent->item, &stack);
+	}
+
+	return result;
+}
+
 struct bitmap_show_data {
 	struct bitmap_index *bitmap_git;
 	struct bitmap *base;
@@ -49,6 +49,30 @@ struct bitmap_index *prepare_bitmap_walk(struct rev_info *revs);
 int reuse_partial_packfile_from_bitmap(struct bitmap_index *,
 				       struct packed_git **packfile,
 				       uint32_t *entries, off_t *up_to);
+/*
+ * Return the bit position of an object in the bitmaps of the index:
+ * its position in the bitmapped pack or, for objects outside of the
+ * pack that an earlier walk has seen, in the extended index. Return
+ * -1 if the object has no position.
+ */
+int bitmap_object_position(struct bitmap_index *, const struct object_id *oid);
+
+/*
+ * Return the reachability bitmap stored in the index for 'commit', or
+ * NULL if the commit has none of its own.
+ */
+struct ewah_bitmap *bitmap_for_commit(struct bitmap_index *, struct commit *commit);
+
+/*
+ * Compute the set of objects reachable from 'tip', walking commits only
+ * until the walk meets commits with a stored bitmap. Commits outside of
+ * the bitmapped pack that the walk passes through are added to the
+ * extended index, so bitmap_object_position() can be used to test any
+ * commit against the result. The caller must bitmap_free() it.
+ */
+struct bitmap *bitmap_reachable_from_commit(struct bitmap_index *,
+					    struct commit *tip);
+
 int rebuild_existing_bitmaps(struct bitmap_index *, struct packing_data *mapping,
 			     khash_sha1 *reused_bitmaps, int show_progress);
 void free_bitmap_index(struct bitmap_index *);
@@ -5,6 +5,8 @@
 #include "progress.h"
 #include "packfile.h"
 #include "object-store.h"
+#include "delta.h"
+#include "thread-utils.h"
 
 struct idx_entry {
 	off_t                offset;
@@ -15,6 +17,75 @@ struct idx_entry {
 	unsigned int nr;
 };
 
+struct verify_pack_data {
+	struct packed_git *p;
+	struct idx_entry *entries;
+	uint32_t nr_objects;
+	verify_fn fn;
+	struct progress *progress;
+	uint32_t base_count;
+	uint32_t nr_done;
+	uint32_t next;
+};
+
+struct verify_thread_data {
+	pthread_t thread;
+	struct verify_pack_data *data;
+	int err;
+};
+
+/*
+ * Objects are handed out to the workers in ranges of this many
+ * consecutive entries (in pack offset order), so that each worker
+ * keeps touching nearby pack windows and delta bases.
+ */
+#define VERIFY_PACK_CHUNK 256
+
+static int threads_active;
+
+/* protects pack windows, the delta base cache and unpack_entry() */
+static pthread_mutex_t pack_mutex;
+/* serializes calls to the verify_fn callback and progress updates */
+static pthread_mutex_t fn_mutex;
+/* protects verify_pack_data.next */
+static pthread_mutex_t work_mutex;
+
+static inline void lock_mutex(pthread_mutex_t *mutex)
+{
+	if (threads_active)
+		pthread_mutex_lock(mutex);
+}
+
+static inline void unlock_mutex(pthread_mutex_t *mutex)
+{
+	if (threads_active)
+		pthread_mutex_unlock(mutex);
+}
+
+static unsigned char *use_pack_locked(struct packed_git *p,
+				      struct pack_window **w_curs,
+				      off_t offset, unsigned long *left)
+{
+	unsigned char *ret;
+
+	/*
+	 * The window stays mapped after we drop the lock, as w_curs
+	 * holds a use count on it until the next use_pack() or
+	 * unuse_pack() on the same cursor.
+	 */
+	lock_mutex(&pack_mutex);
+	ret = use_pack(p, w_curs, offset, left);
+	unlock_mutex(&pack_mutex);
+	return ret;
+}
+
+static void unuse_pack_locked(struct pack_window **w_curs)
+{
+	lock_mutex(&pack_mutex);
+	unuse_pack(w_curs);
+	unlock_mutex(&pack_mutex);
+}
+
 static int compare_entries(const void *e1, const void *e2)
 {
 	const struct idx_entry *entry1 = e1;
@@ -34,7 +105,7 @@ int check_pack_crc(struct packed_git *p, struct pack_window **w_curs,
 
 	do {
 		unsigned long avail;
-		void *data = use_pack(p, w_curs, offset, &avail);
+		void *data = use_pack_locked(p, w_curs, offset, &avail);
 		if (avail > len)
 			avail = len;
 		data_crc = crc32(data_crc, data, avail);
@@ -48,10 +119,264 @@ int check_pack_crc(struct packed_git *p, struct pack_window **w_curs,
 	return data_crc != ntohl(*index_crc);
 }
 
+static void *inflate_pack_data(struct packed_git *p,
+			       struct pack_window **w_curs,
+			       off_t curpos, unsigned long size)
+{
+	int st;
+	git_zstream stream;
+	unsigned char *buffer, *in;
+
+	buffer = xmallocz_gently(size);
+	if (!buffer)
+		return NULL;
+	memset(&stream, 0, sizeof(stream));
+	stream.next_out = buffer;
+	stream.avail_out = size + 1;
+
+	git_inflate_init(&stream);
+	do {
+		in = use_pack_locked(p, w_curs, curpos, &stream.avail_in);
+		stream.next_in = in;
+		st = git_inflate(&stream, Z_FINISH);
+		if (!stream.avail_out)
+			break; /* the payload is larger than it should be */
+		curpos += stream.next_in - in;
+	} while (st == Z_OK || st == Z_BUF_ERROR);
+	git_inflate_end(&stream);
+	if ((st != Z_STREAM_END) || stream.total_out != size) {
+		free(buffer);
+		return NULL;
+	}
+
+	/* versions of zlib can clobber unconsumed portion of outbuf */
+	buffer[size] = '\0';
+
+	return buffer;
+}
+
+/*
+ * Unpack the object at "offset" doing as much of the work as possible
+ * without holding pack_mutex: only the header parsing and the lookup
+ * of a delta base go through the shared pack machinery, while
+ * inflating the object and applying the delta happen in the caller's
+ * thread. Anything unusual is punted to unpack_entry(), which knows
+ * how to report and recover from corruption.
+ */
+static void *unpack_for_verify(struct packed_git *p,
+			       struct pack_window **w_curs,
+			       off_t offset, enum object_type *type,
+			       unsigned long *size)
+{
+	off_t curpos = offset, base_offset = 0;
+	void *base = NULL, *delta, *data = NULL;
+	unsigned long base_size, delta_size;
+
+	lock_mutex(&pack_mutex);
+	*type = unpack_object_header(p, w_curs, &curpos, size);
+	if (*type == OBJ_OFS_DELTA || *type == OBJ_REF_DELTA) {
+		base_offset = get_delta_base(p, w_curs, &curpos, *type, offset);
+		if (base_offset)
+			base = unpack_entry(the_repository, p, base_offset,
+					    type, &base_size);
+	}
+	unlock_mutex(&pack_mutex);
+
+	switch (*type) {
+	case OBJ_COMMIT:
+	case OBJ_TREE:
+	case OBJ_BLOB:
+	case OBJ_TAG:
+		if (!base_offset) {
+			data = inflate_pack_data(p, w_curs, curpos, *size);
+			break;
+		}
+		if (!base)
+			break;
+		delta_size = *size;
+		delta = inflate_pack_data(p, w_curs, curpos, delta_size);
+		if (delta)
+			data = patch_delta(base, base_size, delta, delta_size,
+					   size);
+		free(delta);
+		break;
+	default:
+		break;
+	}
+	free(base);
+	unuse_pack_locked(w_curs);
+
+	if (!data) {
+		lock_mutex(&pack_mutex);
+		data = unpack_entry(the_repository, p, offset, type, size);
+		unlock_mutex(&pack_mutex);
+	}
+	return data;
+}
+
+static int verify_one_object(struct verify_pack_data *d, uint32_t i,
+			     struct pack_window **w_curs)
+{
+	struct packed_git *p = d->p;
+	struct idx_entry *entry = &d->entries[i];
+	void *data;
+	enum object_type type;
+	unsigned long size;
+	off_t curpos;
+	int data_valid;
+	int err = 0;
+	char hex[GIT_MAX_HEXSZ + 1];
+
+	oid_to_hex_r(hex, entry->oid.oid);
+	if (p->index_version > 1) {
+		off_t offset = entry->offset;
+		off_t len = entry[1].offset - offset;
+		unsigned int nr = entry->nr;
+		if (check_pack_crc(p, w_curs, offset, len, nr))
+			err = error("index CRC mismatch for object %s "
+				    "from %s at offset %"PRIuMAX"",
+				    hex, p->pack_name, (uintmax_t)offset);
+	}
+
+	lock_mutex(&pack_mutex);
+	curpos = entry->offset;
+	type = unpack_object_header(p, w_curs, &curpos, &size);
+	unuse_pack(w_curs);
+	unlock_mutex(&pack_mutex);
+
+	if (type == OBJ_BLOB && big_file_threshold <= size) {
+		/*
+		 * Let check_object_signature() check it with
+		 * the streaming interface; no point slurping
+		 * the data in-core only to discard.
+		 */
+		data = NULL;
+		data_valid = 0;
+	} else {
+		data = unpack_for_verify(p, w_curs, entry->offset, &type, &size);
+		data_valid = 1;
+	}
+
+	if (data_valid && !data)
+		err = error("cannot unpack %s from %s at offset %"PRIuMAX"",
+			    hex, p->pack_name, (uintmax_t)entry->offset);
+	else {
+		int corrupt;
+
+		/* streaming goes through the pack windows */
+		if (!data)
+			lock_mutex(&pack_mutex);
+		corrupt = check_object_signature(entry->oid.oid, data, size,
+						 type_name(type));
+		if (!data)
+			unlock_mutex(&pack_mutex);
+
+		if (corrupt)
+			err = error("packed %s from %s is corrupt",
+				    hex, p->pack_name);
+		else if (d->fn) {
+			int eaten = 0;
+			lock_mutex(&fn_mutex);
+			err |= d->fn(entry->oid.oid, type, size, data, &eaten);
+			unlock_mutex(&fn_mutex);
+			if (eaten)
+				data = NULL;
+		}
+	}
+
+	lock_mutex(&fn_mutex);
+	if (((d->base_count + d->nr_done) & 1023) == 0)
+		display_progress(d->progress, d->base_count + d->nr_done);
+	d->nr_done++;
+	unlock_mutex(&fn_mutex);
+	free(data);
+
+	return err;
+}
+
+static int verify_objects(struct verify_pack_data *d,
+			  struct pack_window **w_curs)
+{
+	uint32_t i;
+	int err = 0;
+
+	for (i = 0; i < d->nr_objects; i++)
+		err |= verify_one_object(d, i, w_curs);
+	return err;
+}
+
+static void *verify_worker(void *data)
+{
+	struct verify_thread_data *me = data;
+	struct verify_pack_data *d = me->data;
+	struct pack_window *w_curs = NULL;
+
+	for (;;) {
+		uint32_t i, end;
+
+		lock_mutex(&work_mutex);
+		i = d->next;
+		end = i + VERIFY_PACK_CHUNK;
+		if (end > d->nr_objects)
+			end = d->nr_objects;
+		d->next = end;
+		unlock_mutex(&work_mutex);
+
+		if (i >= end)
+			break;
+		for (; i < end; i++)
+			me->err |= verify_one_object(d, i, &w_curs);
+	}
+	unuse_pack_locked(&w_curs);
+	return NULL;
+}
+
+static void try_to_free_from_threads(size_t size)
+{
+	lock_mutex(&pack_mutex);
+	release_pack_memory(size);
+	unlock_mutex(&pack_mutex);
+}
+
+static int verify_objects_threaded(struct verify_pack_data *d, int nr_threads)
+{
+	struct verify_thread_data *threads;
+	try_to_free_t old_try_to_free_routine;
+	int i, err = 0;
+
+	/* allocations may free pack memory while pack_mutex is held */
+	init_recursive_mutex(&pack_mutex);
+	pthread_mutex_init(&fn_mutex, NULL);
+	pthread_mutex_init(&work_mutex, NULL);
+	threads_active = 1;
+	old_try_to_free_routine = set_try_to_free_routine(try_to_free_from_threads);
+
+	threads = xcalloc(nr_threads, sizeof(*threads));
+	for (i = 0; i < nr_threads; i++) {
+		threads[i].data = d;
+		if (pthread_create(&threads[i].thread, NULL,
+				   verify_worker, &threads[i]))
+			die(_("unable to create thread"));
+	}
+	for (i = 0; i < nr_threads; i++) {
+		pthread_join(threads[i].thread, NULL);
+		err |= threads[i].err;
+	}
+	free(threads);
+
+	set_try_to_free_routine(old_try_to_free_routine);
+	threads_active = 0;
+	pthread_mutex_destroy(&pack_mutex);
+	pthread_mutex_destroy(&fn_mutex);
+	pthread_mutex_destroy(&work_mutex);
+	return err;
+}
+
 static int verify_packfile(struct packed_git *p,
 			   struct pack_window **w_curs,
 			   verify_fn fn,
-			   struct progress *progress, uint32_t base_count)
+			   struct progress *progress, uint32_t base_count,
+			   int nr_threads)
 
 {
 	off_t index_size = p->index_size;
@@ -62,6 +387,7 @@ static int verify_packfile(struct packed_git *p,
 	uint32_t nr_objects, i;
 	int err = 0;
 	struct idx_entry *entries;
+	struct verify_pack_data data = { NULL };
 
 	if (!is_pack_valid(p))
 		return error("packfile %s cannot be accessed", p->pack_name);
@@ -104,60 +430,19 @@ static int verify_packfile(struct packed_git *p,
 	}
 	QSORT(entries, nr_objects, compare_entries);
 
-	for (i = 0; i < nr_objects; i++) {
-		void *data;
-		enum object_type type;
-		unsigned long size;
-		off_t curpos;
-		int data_valid;
-
-		if (p->index_version > 1) {
-			off_t offset = entries[i].offset;
-			off_t len = entries[i+1].offset - offset;
-			unsigned int nr = entries[i].nr;
-			if (check_pack_crc(p, w_curs, offset, len, nr))
-				err = error("index CRC mismatch for object %s "
-					    "from %s at offset %"PRIuMAX"",
-					    oid_to_hex(entries[i].oid.oid),
-					    p->pack_name, (uintmax_t)offset);
-		}
-
-		curpos = entries[i].offset;
-		type = unpack_object_header(p, w_curs, &curpos, &size);
-		unuse_pack(w_curs);
-
-		if (type == OBJ_BLOB && big_file_threshold <= size) {
-			/*
-			 * Let check_object_signature() check it with
-			 * the streaming interface; no point slurping
-			 * the data in-core only to discard.
-			 */
-			data = NULL;
-			data_valid = 0;
-		} else {
-			data = unpack_entry(the_repository, p, entries[i].offset, &type, &size);
-			data_valid = 1;
-		}
+	data.p = p;
+	data.entries = entries;
+	data.nr_objects = nr_objects;
+	data.fn = fn;
+	data.progress = progress;
+	data.base_count = base_count;
 
-		if (data_valid && !data)
-			err = error("cannot unpack %s from %s at offset %"PRIuMAX"",
-				    oid_to_hex(entries[i].oid.oid), p->pack_name,
-				    (uintmax_t)entries[i].offset);
-		else if (check_object_signature(entries[i].oid.oid, data, size, type_name(type)))
-			err = error("packed %s from %s is corrupt",
-				    oid_to_hex(entries[i].oid.oid), p->pack_name);
-		else if (fn) {
-			int eaten = 0;
-			err |= fn(entries[i].oid.oid, type, size, data, &eaten);
-			if (eaten)
-				data = NULL;
-		}
-		if (((base_count + i) & 1023) == 0)
-			display_progress(progress, base_count + i);
-		free(data);
+	if (nr_threads > 1 && nr_objects > VERIFY_PACK_CHUNK)
+		err |= verify_objects_threaded(&data, nr_threads);
+	else
+		err |= verify_objects(&data, w_curs);
 
-	}
-	display_progress(progress, base_count + i);
+	display_progress(progress, base_count + nr_objects);
 	free(entries);
 
 	return err;
@@ -187,7 +472,8 @@ int verify_pack_index(struct packed_git *p)
 }
 
 int verify_pack(struct packed_git *p, verify_fn fn,
-		struct progress *progress, uint32_t base_count)
+		struct progress *progress, uint32_t base_count,
+		int nr_threads)
 {
 	int err = 0;
 	struct pack_window *w_curs = NULL;
@@ -196,7 +482,8 @@ int verify_pack(struct packed_git *p, verify_fn fn,
 	if (!p->index_data)
 		return -1;
 
-	err |= verify_packfile(p, &w_curs, fn, progress, base_count);
+	err |= verify_packfile(p, &w_curs, fn, progress, base_count,
+			       nr_threads);
 	unuse_pack(&w_curs);
 
 	return err;
@@ -80,7 +80,14 @@ typedef int (*verify_fn)(const struct object_id *, enum object_type, unsigned lo
 extern const char *write_idx_file(const char *index_name, struct pack_idx_entry **objects, int nr_objects, const struct pack_idx_option *, const unsigned char *sha1);
 extern int check_pack_crc(struct packed_git *p, struct pack_window **w_curs, off_t offset, off_t len, unsigned int nr);
 extern int verify_pack_index(struct packed_git *);
-extern int verify_pack(struct packed_git *, verify_fn fn, struct progress *, uint32_t);
+
+/*
+ * Verify the pack checksum and every object in the pack, calling "fn"
+ * on each object that passes. With nr_threads > 1, objects are
+ * inflated and hashed by that many worker threads; "fn" is still
+ * called for one object at a time, but not in any particular order.
+ */
+extern int verify_pack(struct packed_git *, verify_fn fn, struct progress *, uint32_t base_count, int nr_threads);
 extern off_t write_pack_header(struct hashfile *f, uint32_t);
 extern void fixup_pack_header_footer(int, unsigned char *, const char *, uint32_t, unsigned char *, off_t);
 extern char *index_pack_lockfile(int fd);
@@ -1,8 +1,16 @@
 #include "cache.h"
+#include "attr.h"
+#include "config.h"
 #include "diff.h"
 #include "commit.h"
 #include "sha1-lookup.h"
 #include "patch-ids.h"
+#include "oidmap.h"
+#include "lockfile.h"
+#include "repository.h"
+#include "replace-object.h"
+#include "thread-utils.h"
+#include "xdiff-interface.h"
 
 static int patch_id_defined(struct commit *commit)
 {
@@ -25,6 +33,338 @@ int commit_patch_id(struct commit *commit, struct diff_options *options,
 	return diff_flush_patch_id(options, oid, diff_header_only);
 }
 
+/*
+ * The patch ids computed with the options of init_patch_ids() (and no
+ * pathspec) are remembered for the rest of the process, and with
+ * patchId.cache, in $GIT_DIR/patch-id-cache across processes.  Both
+ * hold the ids for one set of diff options only, which the hash of
+ * patch_id_options() stands for.
+ *
+ * The file starts with the signature "PIDC", a one-byte version, a
+ * one-byte hash version and two unused bytes, followed by the hash of
+ * the options and a fanout table of 256 four-byte network-order
+ * counts.  Then come the records,
+ * sorted by commit: the commit id, the header-only patch id and the
+ * full patch id of the commit, either of which is all zeros if it was
+ * not computed.
+ */
+#define PATCH_ID_CACHE_SIGNATURE 0x50494443 /* "PIDC" */
+#define PATCH_ID_CACHE_VERSION 1
+#define PATCH_ID_CACHE_OID_VERSION 1
+#define PATCH_ID_CACHE_FANOUT_SIZE (256 * 4)
+
+struct cached_patch_id {
+	struct oidmap_entry ent;
+	struct object_id header_id;
+	struct object_id full_id;
+};
+
+static struct patch_id_cache {
+	int initialized, loaded;
+	const unsigned char *data;
+	size_t size;
+	const uint32_t *fanout;
+	const unsigned char *records;
+	uint32_t nr;
+	struct oidmap computed;
+	int dirty;
+	struct object_id options;
+} patch_id_cache;
+
+static size_t header_size(void)
+{
+	return 8 + the_hash_algo->rawsz;
+}
+
+static size_t record_size(void)
+{
+	return 3 * the_hash_algo->rawsz;
+}
+
+/*
+ * Hash what the patch ids computed with "opt" depend on, besides the
+ * commits and the attributes.
+ */
+static void patch_id_options(const struct diff_options *opt,
+			     struct object_id *oid)
+{
+	struct strbuf buf = STRBUF_INIT;
+	git_hash_ctx ctx;
+
+	strbuf_addf(&buf, "%lx %ld %lu %d %d %s",
+		    (unsigned long)opt->xdl_opts, git_xdiff_max_cost,
+		    big_file_threshold, opt->flags.ignore_submodules,
+		    opt->flags.override_submodule_config,
+		    opt->orderfile ? opt->orderfile : "");
+	the_hash_algo->init_fn(&ctx);
+	the_hash_algo->update_fn(&ctx, buf.buf, buf.len);
+	the_hash_algo->final_fn(oid->hash, &ctx);
+	strbuf_release(&buf);
+}
+
+/*
+ * Check the header and size of a cache file, and that it is for the
+ * options of the patch ids remembered now; returns the number of
+ * records and points fanout and records into it, or returns -1.
+ */
+static int parse_patch_id_cache(const unsigned char *data, size_t size,
+				const uint32_t **fanout,
+				const unsigned char **records)
+{
+	size_t nr;
+
+	if (size < header_size() + PATCH_ID_CACHE_FANOUT_SIZE ||
+	    get_be32(data) != PATCH_ID_CACHE_SIGNATURE ||
+	    data[4] != PATCH_ID_CACHE_VERSION ||
+	    data[5] != PATCH_ID_CACHE_OID_VERSION ||
+	    !hasheq(data + 8, patch_id_cache.options.hash))
+		return -1;
+	*fanout = (const uint32_t *)(data + header_size());
+	*records = data + header_size() + PATCH_ID_CACHE_FANOUT_SIZE;
+	size -= header_size() + PATCH_ID_CACHE_FANOUT_SIZE;
+	nr = size / record_size();
+	if (size % record_size() || nr != ntohl((*fanout)[255]))
+		return -1;
+	return nr;
+}
+
+static const unsigned char *map_patch_id_cache(const char *path, size_t *size)
+{
+	struct stat st;
+	void *data;
+	int fd = git_open(path);
+
+	if (fd < 0)
+		return NULL;
+	if (fstat(fd, &st) || !st.st_size) {
+		close(fd);
+		return NULL;
+	}
+	*size = xsize_t(st.st_size);
+	data = xmmap(NULL, *size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	return data;
+}
+
+/*
+ * Get ready to remember the patch ids computed with "opt", forgetting
+ * those computed with other options.
+ */
+static void init_patch_id_cache(const struct diff_options *opt)
+{
+	struct object_id options;
+
+	patch_id_options(opt, &options);
+	if (patch_id_cache.initialized) {
+		if (oideq(&options, &patch_id_cache.options))
+			return;
+		oidmap_free(&patch_id_cache.computed, 1);
+		if (patch_id_cache.data)
+			munmap((void *)patch_id_cache.data, patch_id_cache.size);
+		patch_id_cache.data = NULL;
+		patch_id_cache.loaded = 0;
+		patch_id_cache.dirty = 0;
+	}
+	patch_id_cache.initialized = 1;
+	oidcpy(&patch_id_cache.options, &options);
+	oidmap_init(&patch_id_cache.computed, 0);
+}
+
+static void load_patch_id_cache(struct repository *r)
+{
+	char *path;
+	int nr;
+
+	if (patch_id_cache.loaded)
+		return;
+	patch_id_cache.loaded = 1;
+
+	path = repo_git_path(r, "patch-id-cache");
+	patch_id_cache.data = map_patch_id_cache(path, &patch_id_cache.size);
+	free(path);
+	if (!patch_id_cache.data)
+		return;
+	nr = parse_patch_id_cache(patch_id_cache.data, patch_id_cache.size,
+				  &patch_id_cache.fanout,
+				  &patch_id_cache.records);
+	if (nr < 0) {
+		munmap((void *)patch_id_cache.data, patch_id_cache.size);
+		patch_id_cache.data = NULL;
+		return;
+	}
+	patch_id_cache.nr = nr;
+}
+
+static int cached_patch_id(const struct object_id *commit_oid,
+			   struct object_id *oid, int diff_header_only)
+{
+	const unsigned char *record;
+	struct cached_patch_id *e;
+	uint32_t pos;
+
+	e = oidmap_get(&patch_id_cache.computed, commit_oid);
+	if (e) {
+		const struct object_id *id =
+			diff_header_only ? &e->header_id : &e->full_id;
+		if (!is_null_oid(id)) {
+			oidcpy(oid, id);
+			return 1;
+		}
+	}
+
+	if (!patch_id_cache.data ||
+	    !bsearch_hash(commit_oid->hash, patch_id_cache.fanout,
+			  patch_id_cache.records, record_size(), &pos))
+		return 0;
+	record = patch_id_cache.records + pos * record_size();
+	record += (diff_header_only ? 1 : 2) * the_hash_algo->rawsz;
+	if (hasheq(record, null_oid.hash))
+		return 0;
+	hashcpy(oid->hash, record);
+	return 1;
+}
+
+static void cache_patch_id(const struct object_id *commit_oid,
+			   const struct object_id *oid, int diff_header_only)
+{
+	struct cached_patch_id *e;
+
+	e = oidmap_get(&patch_id_cache.computed, commit_oid);
+	if (!e) {
+		e = xcalloc(1, sizeof(*e));
+		oidcpy(&e->ent.oid, commit_oid);
+		oidmap_put(&patch_id_cache.computed, e);
+	}
+	oidcpy(diff_header_only ? &e->header_id : &e->full_id, oid);
+	patch_id_cache.dirty = 1;
+}
+
+static int cached_patch_id_cmp(const void *a_, const void *b_)
+{
+	const struct cached_patch_id *a = *(const struct cached_patch_id **)a_;
+	const struct cached_patch_id *b = *(const struct cached_patch_id **)b_;
+
+	return oidcmp(&a->ent.oid, &b->ent.oid);
+}
+
+static void add_record(struct strbuf *out, uint32_t *fanout,
+		       const unsigned char *commit_hash,
+		       const unsigned char *header_hash,
+		       const unsigned char *full_hash)
+{
+	strbuf_add(out, commit_hash, the_hash_algo->rawsz);
+	strbuf_add(out, header_hash, the_hash_algo->rawsz);
+	strbuf_add(out, full_hash, the_hash_algo->rawsz);
+	fanout[commit_hash[0]]++;
+}
+
+/*
+ * Merge the patch ids computed by this process into the cache file as
+ * it is now on disk, or replace it if it is for other options; if
+ * another process holds the lock, the new ids are not written this
+ * time.
+ */
+static void write_patch_id_cache(struct repository *r)
+{
+	struct lock_file lock = LOCK_INIT;
+	struct strbuf out = STRBUF_INIT;
+	struct cached_patch_id **computed, *e;
+	struct oidmap_iter iter;
+	const unsigned char *data, *records = NULL;
+	const uint32_t *old_fanout;
+	uint32_t fanout[256] = { 0 };
+	size_t size = 0, rawsz = the_hash_algo->rawsz;
+	int i, j, nr = 0, old_nr = 0;
+	char *path;
+
+	if (!patch_id_cache.dirty)
+		return;
+
+	path = repo_git_path(r, "patch-id-cache");
+	if (hold_lock_file_for_update(&lock, path, 0) < 0)
+		goto out;
+
+	data = map_patch_id_cache(path, &size);
+	if (data) {
+		old_nr = parse_patch_id_cache(data, size, &old_fanout, &records);
+		if (old_nr < 0)
+			old_nr = 0;
+	}
+
+	ALLOC_ARRAY(computed, hashmap_get_size(&patch_id_cache.computed.map));
+	oidmap_iter_init(&patch_id_cache.computed, &iter);
+	while ((e = oidmap_iter_next(&iter)))
+		computed[nr++] = e;
+	QSORT(computed, nr, cached_patch_id_cmp);
+
+	strbuf_grow(&out, header_size() + PATCH_ID_CACHE_FANOUT_SIZE +
+		    st_mult(old_nr + nr, record_size()));
+	strbuf_setlen(&out, header_size() + PATCH_ID_CACHE_FANOUT_SIZE);
+	for (i = j = 0; i < old_nr || j < nr; ) {
+		const unsigned char *old = i < old_nr ? records + i * record_size() : NULL;
+		int cmp = !old ? 1 : j == nr ? -1 :
+			hashcmp(old, computed[j]->ent.oid.hash);
+
+		if (cmp < 0) {
+			add_record(&out, fanout, old, old + rawsz, old + 2 * rawsz);
+			i++;
+			continue;
+		}
+		e = computed[j++];
+		if (!cmp) {
+			/* keep what either of them knows */
+			if (is_null_oid(&e->header_id))
+				hashcpy(e->header_id.hash, old + rawsz);
+			if (is_null_oid(&e->full_id))
+				hashcpy(e->full_id.hash, old + 2 * rawsz);
+			i++;
+		}
+		add_record(&out, fanout, e->ent.oid.hash,
+			   e->header_id.hash, e->full_id.hash);
+	}
+	free(computed);
+	if (data)
+		munmap((void *)data, size);
+
+	put_be32(out.buf, PATCH_ID_CACHE_SIGNATURE);
+	out.buf[4] = PATCH_ID_CACHE_VERSION;
+	out.buf[5] = PATCH_ID_CACHE_OID_VERSION;
+	out.buf[6] = out.buf[7] = 0;
+	hashcpy((unsigned char *)out.buf + 8, patch_id_cache.options.hash);
+	for (i = 0; i < 256; i++) {
+		if (i)
+			fanout[i] += fanout[i - 1];
+		put_be32(out.buf + header_size() + 4 * i, fanout[i]);
+	}
+
+	if (write_in_full(get_lock_file_fd(&lock), out.buf, out.len) < 0)
+		rollback_lock_file(&lock);
+	else if (!commit_lock_file(&lock))
+		patch_id_cache.dirty = 0;
+out:
+	strbuf_release(&out);
+	free(path);
+}
+
+/*
+ * Like commit_patch_id() with the options of "ids", but remembering
+ * the patch ids unless they are limited to a pathspec.
+ */
+static int get_patch_id(struct patch_ids *ids, struct commit *commit,
+			struct object_id *oid, int diff_header_only)
+{
+	int remember = !ids->diffopts.pathspec.nr;
+
+	if (remember && cached_patch_id(&commit->object.oid, oid,
+					diff_header_only))
+		return 0;
+	if (commit_patch_id(commit, &ids->diffopts, oid, diff_header_only))
+		return -1;
+	if (remember)
+		cache_patch_id(&commit->object.oid, oid, diff_header_only);
+	return 0;
+}
+
 /*
  * When we cannot load the full patch-id for both commits for whatever
  * reason, the function returns -1 (i.e. return error(...)). Despite
@@ -41,21 +381,43 @@ static int patch_id_neq(const void *cmpfn_data,
 			const void *unused_keydata)
 {
 	/* NEEDSWORK: const correctness? */
-	struct diff_options *opt = (void *)cmpfn_data;
+	struct patch_ids *ids = (void *)cmpfn_data;
 	struct patch_id *a = (void *)entry;
 	struct patch_id *b = (void *)entry_or_key;
 
 	if (is_null_oid(&a->patch_id) &&
-	    commit_patch_id(a->commit, opt, &a->patch_id, 0))
+	    get_patch_id(ids, a->commit, &a->patch_id, 0))
 		return error("Could not get patch ID for %s",
 			oid_to_hex(&a->commit->object.oid));
 	if (is_null_oid(&b->patch_id) &&
-	    commit_patch_id(b->commit, opt, &b->patch_id, 0))
+	    get_patch_id(ids, b->commit, &b->patch_id, 0))
 		return error("Could not get patch ID for %s",
 			oid_to_hex(&b->commit->object.oid));
 	return !oideq(&a->patch_id, &b->patch_id);
 }
 
+/*
+ * Which parent a commit is diffed against, and with it its patch id,
+ * depends on the replace refs, grafts and shallow boundaries of the
+ * repository; see commit_graph_compatible().
+ */
+static int patch_id_cache_compatible(struct repository *r)
+{
+	if (read_replace_refs) {
+		prepare_replace_object(r);
+		if (hashmap_get_size(&r->objects->replace_map->map))
+			return 0;
+	}
+
+	prepare_commit_graft(r);
+	if (r->parsed_objects && r->parsed_objects->grafts_nr)
+		return 0;
+	if (is_repository_shallow(r))
+		return 0;
+
+	return 1;
+}
+
 int init_patch_ids(struct repository *r, struct patch_ids *ids)
 {
 	memset(ids, 0, sizeof(*ids));
@@ -63,12 +425,36 @@ int init_patch_ids(struct repository *r, struct patch_ids *ids)
 	ids->diffopts.detect_rename = 0;
 	ids->diffopts.flags.recursive = 1;
 	diff_setup_done(&ids->diffopts);
-	hashmap_init(&ids->patches, patch_id_neq, &ids->diffopts, 256);
+	hashmap_init(&ids->patches, patch_id_neq, ids, 256);
+
+	ids->threads = 1;
+	repo_config_get_bool(r, "patchid.cache", &ids->use_cache);
+	repo_config_get_int(r, "patchid.threads", &ids->threads);
+	if (ids->threads < 0)
+		die(_("invalid number of threads specified (%d) for %s"),
+		    ids->threads, "patchId.threads");
+	if (!ids->threads)
+		ids->threads = online_cpus();
+
+	init_patch_id_cache(&ids->diffopts);
+	/*
+	 * Attributes can make a file binary, and the order file and the
+	 * history can change between runs; keep the ids of this process
+	 * to itself.
+	 */
+	if (ids->use_cache &&
+	    (ids->diffopts.orderfile || !patch_id_cache_compatible(r) ||
+	     repo_read_index(r) < 0 || have_attr_files(r->index)))
+		ids->use_cache = 0;
+	if (ids->use_cache)
+		load_patch_id_cache(r);
 	return 0;
 }
 
 int free_patch_ids(struct patch_ids *ids)
 {
+	if (ids->use_cache)
+		write_patch_id_cache(ids->diffopts.repo);
 	hashmap_free(&ids->patches, 1);
 	return 0;
 }
@@ -80,7 +466,7 @@ static int init_patch_id_entry(struct patch_id *patch,
 	struct object_id header_only_patch_id;
 
 	patch->commit = commit;
-	if (commit_patch_id(commit, &ids->diffopts, &header_only_patch_id, 1))
+	if (get_patch_id(ids, commit, &header_only_patch_id, 1))
 		return -1;
 
 	hashmap_entry_init(patch, sha1hash(header_only_patch_id.hash));
@@ -102,6 +488,129 @@ struct patch_id *has_commit_patch_id(struct commit *commit,
 	return hashmap_get(&ids->patches, &patch, NULL);
 }
 
+/*
+ * Compute the full patch ids of the commits, with the diffs of the
+ * next few commits computed by worker threads in the meantime.
+ */
+static void compute_patch_ids(struct patch_ids *ids,
+			      struct commit **commits, int nr)
+{
+	struct diff_prefetch *prefetch;
+	int i, queued = 0, window;
+	struct object_id oid;
+
+	window = xdi_start_prefetch(ids->threads) * 4;
+	if (!window)
+		return;
+	prefetch = xcalloc(window, sizeof(*prefetch));
+
+	for (i = 0; i < nr; i++) {
+		for (; queued < nr && queued < i + window; queued++) {
+			struct commit *commit = commits[queued];
+
+			if (!commit->parents)
+				continue;
+			parse_commit_or_die(commit->parents->item);
+			diff_tree_prefetch_blobs(get_commit_tree_oid(commit->parents->item),
+						 get_commit_tree_oid(commit),
+						 &ids->diffopts, 0, 0,
+						 &prefetch[queued % window]);
+		}
+		get_patch_id(ids, commits[i], &oid, 0);
+		diff_prefetch_release(&prefetch[i % window]);
+	}
+
+	free(prefetch);
+	xdi_stop_prefetch();
+}
+
+static int commit_ptr_cmp(const void *a_, const void *b_)
+{
+	const struct commit *a = *(const struct commit **)a_;
+	const struct commit *b = *(const struct commit **)b_;
+
+	return a < b ? -1 : a > b;
+}
+
+static int patch_id_hash_cmp(const void *a_, const void *b_)
+{
+	const struct patch_id *a = *(const struct patch_id **)a_;
+	const struct patch_id *b = *(const struct patch_id **)b_;
+
+	return a->ent.hash < b->ent.hash ? -1 : a->ent.hash > b->ent.hash;
+}
+
+void has_commit_patch_ids(struct commit **commits, int nr,
+			  struct patch_ids *ids, struct patch_id **found)
+{
+	struct patch_id **entries, *key;
+	struct commit **todo = NULL;
+	struct hashmap_iter iter;
+	struct object_id oid;
+	int i, j, entries_nr = 0, todo_nr = 0, todo_alloc = 0;
+
+	if (ids->threads < 2 || ids->diffopts.pathspec.nr)
+		goto lookup;
+
+	/*
+	 * Only the commits whose header-only patch ids collide with those
+	 * of the other side need their full patch ids, as in
+	 * has_commit_patch_id(); find them and compute those at once.
+	 */
+	ALLOC_ARRAY(entries, hashmap_get_size(&ids->patches));
+	hashmap_iter_init(&ids->patches, &iter);
+	while ((key = hashmap_iter_next(&iter)))
+		entries[entries_nr++] = key;
+	QSORT(entries, entries_nr, patch_id_hash_cmp);
+
+	key = xcalloc(1, sizeof(*key));
+	for (i = 0; i < nr; i++) {
+		int lo = 0, hi = entries_nr, collided = 0;
+
+		if (!patch_id_defined(commits[i]) ||
+		    init_patch_id_entry(key, commits[i], ids))
+			continue;
+		while (lo < hi) {
+			int mi = lo + (hi - lo) / 2;
+
+			if (entries[mi]->ent.hash < key->ent.hash)
+				lo = mi + 1;
+			else
+				hi = mi;
+		}
+		for (; lo < entries_nr && entries[lo]->ent.hash == key->ent.hash; lo++) {
+			struct patch_id *e = entries[lo];
+
+			collided = 1;
+			if (is_null_oid(&e->patch_id) &&
+			    !cached_patch_id(&e->commit->object.oid, &oid, 0)) {
+				ALLOC_GROW(todo, todo_nr + 1, todo_alloc);
+				todo[todo_nr++] = e->commit;
+			}
+		}
+		if (collided && !cached_patch_id(&commits[i]->object.oid, &oid, 0)) {
+			ALLOC_GROW(todo, todo_nr + 1, todo_alloc);
+			todo[todo_nr++] = commits[i];
+		}
+	}
+	free(key);
+	free(entries);
+
+	/* a commit may collide with several of the other side */
+	QSORT(todo, todo_nr, commit_ptr_cmp);
+	for (i = j = 0; i < todo_nr; i++)
+		if (!j || todo[j - 1] != todo[i])
+			todo[j++] = todo[i];
+	todo_nr = j;
+	if (todo_nr)
+		compute_patch_ids(ids, todo, todo_nr);
+	free(todo);
+
+lookup:
+	for (i = 0; i < nr; i++)
+		found[i] = has_commit_patch_id(commits[i], ids);
+}
+
 struct patch_id *add_commit_patch_id(struct commit *commit,
 				     struct patch_ids *ids)
 {
@@ -17,6 +17,9 @@ struct patch_id {
 struct patch_ids {
 	struct hashmap patches;
 	struct diff_options diffopts;
+	/* patchId.cache and patchId.threads */
+	int use_cache;
+	int threads;
 };
 
 int commit_patch_id(struct commit *commit, struct diff_options *options,
@@ -25,5 +28,13 @@ int init_patch_ids(struct repository *, struct patch_ids *);
 int free_patch_ids(struct patch_ids *);
 struct patch_id *add_commit_patch_id(struct commit *, struct patch_ids *);
 struct patch_id *has_commit_patch_id(struct commit *, struct patch_ids *);
+/*
+ * Like has_commit_patch_id() for each of the nr commits, storing the
+ * results in found, but with the full patch ids it takes to tell them
+ * apart from the commits in ids computed together, using the threads
+ * of patchId.threads.
+ */
+void has_commit_patch_ids(struct commit **commits, int nr,
+			  struct patch_ids *ids, struct patch_id **found);
 
 #endif /* PATCH_IDS_H */
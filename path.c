@@ -107,6 +107,7 @@ struct common_dir {
 };
 
 static struct common_dir common_list[] = {
+	{ 0, 1, 0, "blame-cache" },
 	{ 0, 1, 0, "branches" },
 	{ 0, 1, 0, "common" },
 	{ 0, 1, 0, "hooks" },
@@ -127,6 +128,7 @@ static struct common_dir common_list[] = {
 	{ 0, 0, 0, "config" },
 	{ 1, 0, 0, "gc.pid" },
 	{ 0, 0, 0, "packed-refs" },
+	{ 0, 0, 0, "patch-id-cache" },
 	{ 0, 0, 0, "shallow" },
 	{ 0, 0, 0, NULL }
 };
@@ -18,7 +18,16 @@
 #define MAX_PARALLEL (20)
 #define THREAD_COST (500)
 
-struct progress_data {
+/*
+ * Threads take the entries to check in batches of this many
+ * neighbours, so that one slow directory does not hold up the
+ * entries assigned to a thread while the others sit idle.
+ */
+#define PRELOAD_BATCH (64)
+
+struct preload_data {
+	struct index_state *index;
+	int next;
 	unsigned long n;
 	struct progress *progress;
 	pthread_mutex_t mutex;
@@ -26,111 +35,132 @@ struct progress_data {
 
 struct thread_data {
 	pthread_t pthread;
-	struct index_state *index;
+	struct preload_data *preload;
 	struct pathspec pathspec;
-	struct progress_data *progress;
-	int offset, nr;
 };
 
+/*
+ * Hand out the next batch of entries, accounting for the previous
+ * one in the progress meter. Returns 0 once all have been handed out.
+ */
+static int next_preload_batch(struct preload_data *pd, int done,
+			      int *offset, int *nr)
+{
+	int ret = 0;
+
+	pthread_mutex_lock(&pd->mutex);
+	if (pd->progress && done) {
+		pd->n += done;
+		display_progress(pd->progress, pd->n);
+	}
+	if (pd->next < pd->index->cache_nr) {
+		*offset = pd->next;
+		*nr = pd->index->cache_nr - pd->next;
+		if (*nr > PRELOAD_BATCH)
+			*nr = PRELOAD_BATCH;
+		pd->next += *nr;
+		ret = 1;
+	}
+	pthread_mutex_unlock(&pd->mutex);
+	return ret;
+}
+
 static void *preload_thread(void *_data)
 {
-	int nr, last_nr;
+	int offset, nr = 0;
 	struct thread_data *p = _data;
-	struct index_state *index = p->index;
-	struct cache_entry **cep = index->cache + p->offset;
+	struct index_state *index = p->preload->index;
 	struct cache_def cache = CACHE_DEF_INIT;
 
-	nr = p->nr;
-	if (nr + p->offset > index->cache_nr)
-		nr = index->cache_nr - p->offset;
-	last_nr = nr;
-
-	do {
-		struct cache_entry *ce = *cep++;
-		struct stat st;
-
-		if (ce_stage(ce))
-			continue;
-		if (S_ISGITLINK(ce->ce_mode))
-			continue;
-		if (ce_uptodate(ce))
-			continue;
-		if (ce_skip_worktree(ce))
-			continue;
-		if (ce->ce_flags & CE_FSMONITOR_VALID)
-			continue;
-		if (p->progress && !(nr & 31)) {
-			struct progress_data *pd = p->progress;
-
-			pthread_mutex_lock(&pd->mutex);
-			pd->n += last_nr - nr;
-			display_progress(pd->progress, pd->n);
-			pthread_mutex_unlock(&pd->mutex);
-			last_nr = nr;
+	while (next_preload_batch(p->preload, nr, &offset, &nr)) {
+		struct cache_entry **cep = index->cache + offset;
+		int i;
+
+		for (i = 0; i < nr; i++) {
+			struct cache_entry *ce = *cep++;
+			struct stat st;
+
+			if (ce_stage(ce))
+				continue;
+			if (S_ISGITLINK(ce->ce_mode))
+				continue;
+			if (ce_uptodate(ce))
+				continue;
+			if (ce_skip_worktree(ce))
+				continue;
+			if (ce->ce_flags & CE_FSMONITOR_VALID)
+				continue;
+			if (!ce_path_match(index, ce, &p->pathspec, NULL))
+				continue;
+			if (threaded_has_symlink_leading_path(&cache, ce->name, ce_namelen(ce)))
+				continue;
+			if (lstat(ce->name, &st))
+				continue;
+			if (ie_match_stat(index, ce, &st, CE_MATCH_RACY_IS_DIRTY|CE_MATCH_IGNORE_FSMONITOR))
+				continue;
+			ce_mark_uptodate(ce);
+			mark_fsmonitor_valid(ce);
 		}
-		if (!ce_path_match(index, ce, &p->pathspec, NULL))
-			continue;
-		if (threaded_has_symlink_leading_path(&cache, ce->name, ce_namelen(ce)))
-			continue;
-		if (lstat(ce->name, &st))
-			continue;
-		if (ie_match_stat(index, ce, &st, CE_MATCH_RACY_IS_DIRTY|CE_MATCH_IGNORE_FSMONITOR))
-			continue;
-		ce_mark_uptodate(ce);
-		mark_fsmonitor_valid(ce);
-	} while (--nr > 0);
-	if (p->progress) {
-		struct progress_data *pd = p->progress;
-
-		pthread_mutex_lock(&pd->mutex);
-		display_progress(pd->progress, pd->n + last_nr);
-		pthread_mutex_unlock(&pd->mutex);
 	}
 	cache_def_clear(&cache);
 	return NULL;
 }
 
+/*
+ * lstat() is bound by latency rather than CPU, so on network file
+ * systems it pays to keep many more of them in flight than there are
+ * CPUs: core.preloadIndexThreads lifts the default cap.
+ */
+static int preload_threads(struct index_state *index)
+{
+	int threads, max_threads;
+
+	if (git_config_get_int("core.preloadindexthreads", &max_threads) ||
+	    max_threads <= 0) {
+		threads = index->cache_nr / THREAD_COST;
+		if ((index->cache_nr > 1) && (threads < 2) && git_env_bool("GIT_TEST_PRELOAD_INDEX", 0))
+			threads = 2;
+		if (threads > MAX_PARALLEL)
+			threads = MAX_PARALLEL;
+		return threads;
+	}
+
+	threads = DIV_ROUND_UP(index->cache_nr, PRELOAD_BATCH);
+	if (threads > max_threads)
+		threads = max_threads;
+	return threads;
+}
+
 void preload_index(struct index_state *index,
 		   const struct pathspec *pathspec,
 		   unsigned int refresh_flags)
 {
-	int threads, i, work, offset;
-	struct thread_data data[MAX_PARALLEL];
-	struct progress_data pd;
+	int threads, i;
+	struct thread_data *data;
+	struct preload_data pd;
 
 	if (!HAVE_THREADS || !core_preload_index)
 		return;
 
-	threads = index->cache_nr / THREAD_COST;
-	if ((index->cache_nr > 1) && (threads < 2) && git_env_bool("GIT_TEST_PRELOAD_INDEX", 0))
-		threads = 2;
+	threads = preload_threads(index);
 	if (threads < 2)
 		return;
 	trace_performance_enter();
-	if (threads > MAX_PARALLEL)
-		threads = MAX_PARALLEL;
-	offset = 0;
-	work = DIV_ROUND_UP(index->cache_nr, threads);
-	memset(&data, 0, sizeof(data));
+	data = xcalloc(threads, sizeof(*data));
 
 	memset(&pd, 0, sizeof(pd));
-	if (refresh_flags & REFRESH_PROGRESS && isatty(2)) {
+	pd.index = index;
+	pthread_mutex_init(&pd.mutex, NULL);
+	if (refresh_flags & REFRESH_PROGRESS && isatty(2))
 		pd.progress = start_delayed_progress(_("Refreshing index"), index->cache_nr);
-		pthread_mutex_init(&pd.mutex, NULL);
-	}
 
 	for (i = 0; i < threads; i++) {
 		struct thread_data *p = data+i;
 		int err;
 
-		p->index = index;
+		p->preload = &pd;
 		if (pathspec)
 			copy_pathspec(&p->pathspec, pathspec);
-		p->offset = offset;
-		p->nr = work;
-		if (pd.progress)
-			p->progress = &pd;
-		offset += work;
 		err = pthread_create(&p->pthread, NULL, preload_thread, p);
 
 		if (err)
@@ -140,8 +170,11 @@ void preload_index(struct index_state *index,
 		struct thread_data *p = data+i;
 		if (pthread_join(p->pthread, NULL))
 			die("unable to join threaded lstat");
+		clear_pathspec(&p->pathspec);
 	}
 	stop_progress(&pd.progress);
+	pthread_mutex_destroy(&pd.mutex);
+	free(data);
 
 	trace_performance_leave("preload index");
 }
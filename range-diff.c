@@ -10,6 +10,8 @@
 #include "commit.h"
 #include "pretty.h"
 #include "userdiff.h"
+#include "config.h"
+#include "thread-utils.h"
 
 struct patch_util {
 	/* For the search for an exact match */
@@ -22,6 +24,12 @@ struct patch_util {
 	/* the index of the matching item in the other branch, or -1 */
 	int matching;
 	struct object_id oid;
+
+	/* the sorted hashes of the lines of the diff, see min_diffsize() */
+	unsigned int *line_hash;
+	int line_nr;
+	/* the cost of leaving it unmatched */
+	int creation_cost;
 };
 
 /*
@@ -225,10 +233,147 @@ static int diffsize(const char *a, const char *b)
 	return COST_MAX;
 }
 
-static void get_correspondences(struct string_list *a, struct string_list *b,
-				int creation_factor)
+static int line_hash_cmp(const void *a_, const void *b_)
+{
+	unsigned int a = *(const unsigned int *)a_;
+	unsigned int b = *(const unsigned int *)b_;
+
+	return a < b ? -1 : a > b;
+}
+
+static void hash_lines(struct patch_util *util)
+{
+	const char *p = util->diff;
+	int alloc = 0;
+
+	while (*p) {
+		const char *eol = strchrnul(p, '\n');
+
+		ALLOC_GROW(util->line_hash, util->line_nr + 1, alloc);
+		util->line_hash[util->line_nr++] = memhash(p, eol - p);
+		p = *eol ? eol + 1 : eol;
+	}
+	QSORT(util->line_hash, util->line_nr, line_hash_cmp);
+}
+
+/*
+ * A lower bound of diffsize() that is cheap to compute: every line
+ * that is in only one of the diffs is shown as removed or added,
+ * whichever way the diff turns out.
+ */
+static int min_diffsize(const struct patch_util *a, const struct patch_util *b)
 {
-	int n = a->nr + b->nr;
+	int i = 0, j = 0, common = 0;
+
+	while (i < a->line_nr && j < b->line_nr) {
+		if (a->line_hash[i] < b->line_hash[j])
+			i++;
+		else if (a->line_hash[i] > b->line_hash[j])
+			j++;
+		else {
+			common++;
+			i++;
+			j++;
+		}
+	}
+	return a->line_nr + b->line_nr - 2 * common;
+}
+
+/* A pair of unmatched commits that might correspond */
+struct candidate {
+	struct patch_util *a, *b;
+	int cost, component;
+};
+
+struct diffsize_threads {
+	struct candidate *candidate;
+	int nr, next;
+	pthread_mutex_t mutex;
+};
+
+static void *diffsize_thread(void *data)
+{
+	struct diffsize_threads *t = data;
+
+	for (;;) {
+		struct candidate *c = NULL;
+
+		pthread_mutex_lock(&t->mutex);
+		if (t->next < t->nr)
+			c = &t->candidate[t->next++];
+		pthread_mutex_unlock(&t->mutex);
+		if (!c)
+			return NULL;
+		c->cost = diffsize(c->a->diff, c->b->diff);
+	}
+}
+
+static void compute_candidate_costs(struct candidate *candidate, int nr)
+{
+	struct diffsize_threads t;
+	pthread_t *threads;
+	int i, nr_threads = 1;
+
+	git_config_get_int("rangediff.threads", &nr_threads);
+	if (nr_threads < 0)
+		die(_("invalid number of threads specified (%d) for %s"),
+		    nr_threads, "rangeDiff.threads");
+	if (!nr_threads)
+		nr_threads = online_cpus();
+	if (!HAVE_THREADS)
+		nr_threads = 1;
+	if (nr_threads > nr)
+		nr_threads = nr;
+
+	if (nr_threads < 2) {
+		for (i = 0; i < nr; i++)
+			candidate[i].cost = diffsize(candidate[i].a->diff,
+						     candidate[i].b->diff);
+		return;
+	}
+
+	t.candidate = candidate;
+	t.nr = nr;
+	t.next = 0;
+	pthread_mutex_init(&t.mutex, NULL);
+	ALLOC_ARRAY(threads, nr_threads);
+	for (i = 0; i < nr_threads; i++) {
+		int err = pthread_create(&threads[i], NULL, diffsize_thread, &t);
+		if (err)
+			die(_("unable to create thread: %s"), strerror(err));
+	}
+	for (i = 0; i < nr_threads; i++)
+		pthread_join(threads[i], NULL);
+	free(threads);
+	pthread_mutex_destroy(&t.mutex);
+}
+
+static int find_component(int *parent, int i)
+{
+	while (parent[i] != i)
+		i = parent[i] = parent[parent[i]];
+	return i;
+}
+
+static int candidate_cmp(const void *a_, const void *b_)
+{
+	const struct candidate *a = a_, *b = b_;
+
+	return a->component - b->component;
+}
+
+/*
+ * Find the cheapest assignment between the a_nr commits of a and the
+ * b_nr commits of b that make up one component of the candidate pairs;
+ * `local` maps the index of each commit in its branch to its index in
+ * the component.
+ */
+static void assign_component(struct patch_util **a, int a_nr,
+			     struct patch_util **b, int b_nr,
+			     struct candidate *candidate, int candidate_nr,
+			     int *a_local, int *b_local)
+{
+	int n = a_nr + b_nr;
 	int *cost, c, *a2b, *b2a;
 	int i, j;
 
@@ -236,49 +381,35 @@ static void get_correspondences(struct string_list *a, struct string_list *b,
 	ALLOC_ARRAY(a2b, n);
 	ALLOC_ARRAY(b2a, n);
 
-	for (i = 0; i < a->nr; i++) {
-		struct patch_util *a_util = a->items[i].util;
+	for (i = 0; i < a_nr; i++) {
+		for (j = 0; j < b_nr; j++)
+			cost[i + n * j] = COST_MAX;
 
-		for (j = 0; j < b->nr; j++) {
-			struct patch_util *b_util = b->items[j].util;
-
-			if (a_util->matching == j)
-				c = 0;
-			else if (a_util->matching < 0 && b_util->matching < 0)
-				c = diffsize(a_util->diff, b_util->diff);
-			else
-				c = COST_MAX;
-			cost[i + n * j] = c;
-		}
-
-		c = a_util->matching < 0 ?
-			a_util->diffsize * creation_factor / 100 : COST_MAX;
-		for (j = b->nr; j < n; j++)
+		c = a[i]->creation_cost;
+		for (j = b_nr; j < n; j++)
 			cost[i + n * j] = c;
 	}
 
-	for (j = 0; j < b->nr; j++) {
-		struct patch_util *util = b->items[j].util;
-
-		c = util->matching < 0 ?
-			util->diffsize * creation_factor / 100 : COST_MAX;
-		for (i = a->nr; i < n; i++)
+	for (j = 0; j < b_nr; j++) {
+		c = b[j]->creation_cost;
+		for (i = a_nr; i < n; i++)
 			cost[i + n * j] = c;
 	}
 
-	for (i = a->nr; i < n; i++)
-		for (j = b->nr; j < n; j++)
+	for (i = a_nr; i < n; i++)
+		for (j = b_nr; j < n; j++)
 			cost[i + n * j] = 0;
 
-	compute_assignment(n, n, cost, a2b, b2a);
+	for (i = 0; i < candidate_nr; i++)
+		cost[a_local[candidate[i].a->i] +
+		     n * b_local[candidate[i].b->i]] = candidate[i].cost;
 
-	for (i = 0; i < a->nr; i++)
-		if (a2b[i] >= 0 && a2b[i] < b->nr) {
-			struct patch_util *a_util = a->items[i].util;
-			struct patch_util *b_util = b->items[a2b[i]].util;
+	compute_assignment(n, n, cost, a2b, b2a);
 
-			a_util->matching = a2b[i];
-			b_util->matching = i;
+	for (i = 0; i < a_nr; i++)
+		if (a2b[i] >= 0 && a2b[i] < b_nr) {
+			a[i]->matching = b[a2b[i]]->i;
+			b[a2b[i]]->matching = a[i]->i;
 		}
 
 	free(cost);
@@ -286,6 +417,137 @@ static void get_correspondences(struct string_list *a, struct string_list *b,
 	free(b2a);
 }
 
+/*
+ * Match the commits that have no exact match in the other branch, so
+ * that the sum of the sizes of the diffs between the patches of the
+ * matched pairs, and of the patches of the unmatched commits (weighed by
+ * the creation factor) is minimal.
+ *
+ * A pair whose diff is larger than leaving both commits unmatched would
+ * cost is never part of that assignment: the pair is worse than
+ * matching either commit with nothing. So only the pairs that pass the
+ * cheap min_diffsize() test are diffed, and only the pairs that pass the
+ * real test become candidates. The commits fall into components that
+ * are connected by candidates, and each of those is solved separately.
+ */
+static void get_correspondences(struct string_list *a, struct string_list *b,
+				int creation_factor)
+{
+	struct patch_util **ua, **ub, **ca, **cb;
+	struct candidate *candidate = NULL;
+	int ua_nr = 0, ub_nr = 0, candidate_nr = 0, candidate_alloc = 0;
+	int *parent, *first, *next, *a_local, *b_local;
+	int nodes, i, j, k;
+
+	ALLOC_ARRAY(ua, a->nr);
+	ALLOC_ARRAY(ub, b->nr);
+	for (i = 0; i < a->nr; i++) {
+		struct patch_util *util = a->items[i].util;
+
+		if (util->matching >= 0)
+			continue;
+		util->creation_cost = util->diffsize * creation_factor / 100;
+		hash_lines(util);
+		ua[ua_nr++] = util;
+	}
+	for (j = 0; j < b->nr; j++) {
+		struct patch_util *util = b->items[j].util;
+
+		if (util->matching >= 0)
+			continue;
+		util->creation_cost = util->diffsize * creation_factor / 100;
+		hash_lines(util);
+		ub[ub_nr++] = util;
+	}
+
+	for (i = 0; i < ua_nr; i++)
+		for (j = 0; j < ub_nr; j++) {
+			if (min_diffsize(ua[i], ub[j]) >
+			    ua[i]->creation_cost + ub[j]->creation_cost)
+				continue;
+			ALLOC_GROW(candidate, candidate_nr + 1, candidate_alloc);
+			candidate[candidate_nr].a = ua[i];
+			candidate[candidate_nr].b = ub[j];
+			candidate_nr++;
+		}
+	compute_candidate_costs(candidate, candidate_nr);
+
+	/* the commits of a are the nodes 0..ua_nr-1, those of b follow */
+	nodes = ua_nr + ub_nr;
+	ALLOC_ARRAY(parent, nodes);
+	for (i = 0; i < nodes; i++)
+		parent[i] = i;
+	ALLOC_ARRAY(a_local, a->nr);
+	ALLOC_ARRAY(b_local, b->nr);
+	for (i = 0; i < ua_nr; i++)
+		a_local[ua[i]->i] = i;
+	for (j = 0; j < ub_nr; j++)
+		b_local[ub[j]->i] = ua_nr + j;
+	for (k = i = 0; i < candidate_nr; i++) {
+		struct candidate *c = &candidate[i];
+
+		if (c->cost > c->a->creation_cost + c->b->creation_cost)
+			continue;
+		parent[find_component(parent, a_local[c->a->i])] =
+			find_component(parent, b_local[c->b->i]);
+		candidate[k++] = *c;
+	}
+	candidate_nr = k;
+	for (i = 0; i < candidate_nr; i++)
+		candidate[i].component =
+			find_component(parent, a_local[candidate[i].a->i]);
+	QSORT(candidate, candidate_nr, candidate_cmp);
+
+	/* list the nodes of each component, in their original order */
+	ALLOC_ARRAY(first, nodes);
+	ALLOC_ARRAY(next, nodes);
+	for (i = 0; i < nodes; i++)
+		first[i] = -1;
+	for (i = nodes - 1; i >= 0; i--) {
+		int component = find_component(parent, i);
+
+		next[i] = first[component];
+		first[component] = i;
+	}
+
+	ALLOC_ARRAY(ca, ua_nr);
+	ALLOC_ARRAY(cb, ub_nr);
+	for (k = 0; k < candidate_nr; k = j) {
+		int ca_nr = 0, cb_nr = 0;
+
+		for (j = k; j < candidate_nr; j++)
+			if (candidate[j].component != candidate[k].component)
+				break;
+
+		for (i = first[candidate[k].component]; i >= 0; i = next[i])
+			if (i < ua_nr) {
+				a_local[ua[i]->i] = ca_nr;
+				ca[ca_nr++] = ua[i];
+			} else {
+				b_local[ub[i - ua_nr]->i] = cb_nr;
+				cb[cb_nr++] = ub[i - ua_nr];
+			}
+
+		assign_component(ca, ca_nr, cb, cb_nr,
+				 candidate + k, j - k, a_local, b_local);
+	}
+
+	for (i = 0; i < ua_nr; i++)
+		FREE_AND_NULL(ua[i]->line_hash);
+	for (j = 0; j < ub_nr; j++)
+		FREE_AND_NULL(ub[j]->line_hash);
+	free(ca);
+	free(cb);
+	free(first);
+	free(next);
+	free(a_local);
+	free(b_local);
+	free(parent);
+	free(candidate);
+	free(ua);
+	free(ub);
+}
+
 static void output_pair_header(struct diff_options *diffopt,
 			       int patch_no_width,
 			       struct strbuf *buf,
@@ -43,10 +43,12 @@
 #define CACHE_EXT_TREE 0x54524545	/* "TREE" */
 #define CACHE_EXT_RESOLVE_UNDO 0x52455543 /* "REUC" */
 #define CACHE_EXT_LINK 0x6c696e6b	  /* "link" */
+#define CACHE_EXT_LAYER 0x6c617972	  /* "layr" */
 #define CACHE_EXT_UNTRACKED 0x554E5452	  /* "UNTR" */
 #define CACHE_EXT_FSMONITOR 0x46534D4E	  /* "FSMN" */
 #define CACHE_EXT_ENDOFINDEXENTRIES 0x454F4945	/* "EOIE" */
 #define CACHE_EXT_INDEXENTRYOFFSETTABLE 0x49454F54 /* "IEOT" */
+#define CACHE_EXT_NAMEHASH 0x4E485348	  /* "NHSH" */
 
 /* changes that can be kept in $GIT_DIR/index (basically all extensions) */
 #define EXTMASK (RESOLVE_UNDO_CHANGED | CACHE_TREE_CHANGED | \
@@ -1328,6 +1330,7 @@ int add_index_entry(struct index_state *istate, struct cache_entry *ce, int opti
 	ALLOC_GROW(istate->cache, istate->cache_nr + 1, istate->cache_alloc);
 
 	/* Add it in.. */
+	discard_stored_name_hash(istate);
 	istate->cache_nr++;
 	if (istate->cache_nr > pos + 1)
 		MOVE_ARRAY(istate->cache + pos + 1, istate->cache + pos,
@@ -1712,12 +1715,18 @@ static int read_index_extension(struct index_state *istate,
 		if (read_link_extension(istate, data, sz))
 			return -1;
 		break;
+	case CACHE_EXT_LAYER:
+		/* only there to keep out readers that do not follow layers */
+		break;
 	case CACHE_EXT_UNTRACKED:
 		istate->untracked = read_untracked_extension(data, sz);
 		break;
 	case CACHE_EXT_FSMONITOR:
 		read_fsmonitor_extension(istate, data, sz);
 		break;
+	case CACHE_EXT_NAMEHASH:
+		read_name_hash_extension(istate, data, sz);
+		break;
 	case CACHE_EXT_ENDOFINDEXENTRIES:
 	case CACHE_EXT_INDEXENTRYOFFSETTABLE:
 		/* already handled in do_read_index() */
@@ -1742,13 +1751,19 @@ int read_index(struct index_state *istate)
 	return read_index_from(istate, get_index_file(), get_git_dir());
 }
 
-static struct cache_entry *create_from_disk(struct mem_pool *ce_mem_pool,
-					    unsigned int version,
-					    struct ondisk_cache_entry *ondisk,
-					    unsigned long *ent_size,
-					    const struct cache_entry *previous_ce)
+/*
+ * Parse the flags and the name of an on-disk entry. Return where the
+ * name stored in the entry starts, and set "len" to the length of the
+ * full name; in a v4 index, its first "copy_len" bytes are to be taken
+ * from the name of the previous entry, whose length is "previous_len".
+ */
+static const char *parse_ondisk_name(unsigned int version,
+				     const struct ondisk_cache_entry *ondisk,
+				     size_t previous_len,
+				     const char *previous_name,
+				     unsigned int *flags_p,
+				     size_t *len_p, size_t *copy_len_p)
 {
-	struct cache_entry *ce;
 	size_t len;
 	const char *name;
 	unsigned int flags;
@@ -1782,15 +1797,14 @@ static struct cache_entry *create_from_disk(struct mem_pool *ce_mem_pool,
 
 	if (expand_name_field) {
 		const unsigned char *cp = (const unsigned char *)name;
-		size_t strip_len, previous_len;
+		size_t strip_len;
 
 		/* If we're at the begining of a block, ignore the previous name */
 		strip_len = decode_varint(&cp);
-		if (previous_ce) {
-			previous_len = previous_ce->ce_namelen;
+		if (previous_name) {
 			if (previous_len < strip_len)
 				die(_("malformed name field in the index, near path '%s'"),
-					previous_ce->name);
+					previous_name);
 			copy_len = previous_len - strip_len;
 		}
 		name = (const char *)cp;
@@ -1802,8 +1816,16 @@ static struct cache_entry *create_from_disk(struct mem_pool *ce_mem_pool,
 			len += copy_len;
 	}
 
-	ce = mem_pool__ce_alloc(ce_mem_pool, len);
+	*flags_p = flags;
+	*len_p = len;
+	*copy_len_p = copy_len;
+	return name;
+}
 
+static void copy_ondisk_fields(struct cache_entry *ce,
+			       const struct ondisk_cache_entry *ondisk,
+			       unsigned int flags, size_t len)
+{
 	ce->ce_stat_data.sd_ctime.sec = get_be32(&ondisk->ctime.sec);
 	ce->ce_stat_data.sd_mtime.sec = get_be32(&ondisk->mtime.sec);
 	ce->ce_stat_data.sd_ctime.nsec = get_be32(&ondisk->ctime.nsec);
@@ -1818,8 +1840,28 @@ static struct cache_entry *create_from_disk(struct mem_pool *ce_mem_pool,
 	ce->ce_namelen = len;
 	ce->index = 0;
 	hashcpy(ce->oid.hash, ondisk->sha1);
+}
 
-	if (expand_name_field) {
+static struct cache_entry *create_from_disk(struct mem_pool *ce_mem_pool,
+					    unsigned int version,
+					    struct ondisk_cache_entry *ondisk,
+					    unsigned long *ent_size,
+					    const struct cache_entry *previous_ce)
+{
+	struct cache_entry *ce;
+	size_t len, copy_len;
+	const char *name;
+	unsigned int flags;
+
+	name = parse_ondisk_name(version, ondisk,
+				 previous_ce ? previous_ce->ce_namelen : 0,
+				 previous_ce ? previous_ce->name : NULL,
+				 &flags, &len, &copy_len);
+
+	ce = mem_pool__ce_alloc(ce_mem_pool, len);
+	copy_ondisk_fields(ce, ondisk, flags, len);
+
+	if (version == 4) {
 		if (copy_len)
 			memcpy(ce->name, previous_ce->name, copy_len);
 		memcpy(ce->name + copy_len, name, len + 1 - copy_len);
@@ -2238,6 +2280,379 @@ int do_read_index(struct index_state *istate, const char *path, int must_exist)
 	die("index file corrupt");
 }
 
+static int has_index_extension(const char *mmap, size_t mmap_size,
+			       size_t offset, uint32_t ext)
+{
+	while (offset <= mmap_size - the_hash_algo->rawsz - 8) {
+		if (CACHE_EXT((mmap + offset)) == ext)
+			return 1;
+		offset += 8;
+		offset += get_be32(mmap + offset - 4);
+	}
+	return 0;
+}
+
+/*
+ * Return the name of an on-disk entry that starts a block of the index
+ * entry offset table, i.e. that does not depend on the previous entry
+ * even in a v4 index.
+ */
+static const char *ondisk_block_name(unsigned int version,
+				     const struct ondisk_cache_entry *ondisk,
+				     size_t *len)
+{
+	unsigned int flags = get_be16(&ondisk->flags);
+	const char *name;
+
+	if (flags & CE_EXTENDED)
+		name = ((const struct ondisk_cache_entry_extended *)ondisk)->name;
+	else
+		name = ondisk->name;
+	if (version == 4) {
+		const unsigned char *cp = (const unsigned char *)name;
+
+		decode_varint(&cp);
+		name = (const char *)cp;
+	}
+	*len = flags & CE_NAMEMASK;
+	if (*len == CE_NAMEMASK)
+		*len = strlen(name);
+	return name;
+}
+
+/* Negative, zero or positive as "name" sorts before, under or after "prefix" */
+static int cmp_prefix(const char *name, size_t len,
+		      const char *prefix, size_t prefixlen)
+{
+	int cmp = memcmp(name, prefix, len < prefixlen ? len : prefixlen);
+
+	if (cmp)
+		return cmp;
+	return len < prefixlen ? -1 : 0;
+}
+
+/*
+ * Check that the blocks of the index entry offset table lie within the
+ * entries and cover all of them.
+ */
+static int ieot_is_usable(const struct index_entry_offset_table *ieot,
+			  const struct cache_header *hdr,
+			  size_t extension_offset)
+{
+	unsigned int i, nr;
+
+	for (i = nr = 0; i < ieot->nr; i++) {
+		if (ieot->entries[i].offset < sizeof(*hdr) ||
+		    ieot->entries[i].offset >= extension_offset)
+			return 0;
+		nr += ieot->entries[i].nr;
+	}
+	return nr == ntohl(hdr->hdr_entries);
+}
+
+/*
+ * The entries whose names start with "prefix" are in the blocks from
+ * "*lo" up to (excluding) "*hi": between the last block starting before
+ * "prefix" and the first block starting after it.
+ */
+static void find_prefix_blocks(unsigned int version, const char *mmap,
+			       const struct index_entry_offset_table *ieot,
+			       const char *prefix, size_t prefixlen,
+			       int *lo_p, int *hi_p)
+{
+	int lo = 0, hi = ieot->nr;
+
+	while (lo < hi) {
+		int mi = lo + (hi - lo) / 2;
+		size_t len;
+		const char *name = ondisk_block_name(version,
+			(const struct ondisk_cache_entry *)(mmap + ieot->entries[mi].offset),
+			&len);
+
+		if (cmp_prefix(name, len, prefix, prefixlen) < 0)
+			lo = mi + 1;
+		else
+			hi = mi;
+	}
+	hi = lo;
+	if (lo)
+		lo--;
+	while (hi < ieot->nr) {
+		size_t len;
+		const char *name = ondisk_block_name(version,
+			(const struct ondisk_cache_entry *)(mmap + ieot->entries[hi].offset),
+			&len);
+
+		if (cmp_prefix(name, len, prefix, prefixlen) > 0)
+			break;
+		hi++;
+	}
+	*lo_p = lo;
+	*hi_p = hi;
+}
+
+/*
+ * Read only the entries whose names start with "prefix", using the
+ * index entry offset table to skip the blocks that cannot contain any
+ * of them. Extensions are not read. Returns -1, having read nothing,
+ * if the index file does not allow it.
+ */
+static int do_read_index_partial(struct index_state *istate, const char *path,
+				 const char *prefix, size_t prefixlen)
+{
+	int fd, lo, hi, i, nr, first, last;
+	struct stat st;
+	const struct cache_header *hdr;
+	const char *mmap;
+	size_t mmap_size, extension_offset;
+	struct index_entry_offset_table *ieot = NULL;
+	unsigned int version;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return -1;
+	if (fstat(fd, &st)) {
+		close(fd);
+		return -1;
+	}
+	mmap_size = xsize_t(st.st_size);
+	if (mmap_size < sizeof(struct cache_header) + the_hash_algo->rawsz) {
+		close(fd);
+		return -1;
+	}
+	mmap = xmmap(NULL, mmap_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+
+	hdr = (const struct cache_header *)mmap;
+	if (verify_hdr(hdr, mmap_size) < 0)
+		goto fallback;
+	version = ntohl(hdr->hdr_version);
+
+	/* a split index needs its shared index, which may not be blocked */
+	extension_offset = read_eoie_extension(mmap, mmap_size);
+	if (!extension_offset ||
+	    has_index_extension(mmap, mmap_size, extension_offset, CACHE_EXT_LINK))
+		goto fallback;
+	ieot = read_ieot_extension(mmap, mmap_size, extension_offset);
+	if (!ieot || !ieot_is_usable(ieot, hdr, extension_offset))
+		goto fallback;
+
+	find_prefix_blocks(version, mmap, ieot, prefix, prefixlen, &lo, &hi);
+
+	istate->version = version;
+	for (i = lo, nr = 0; i < hi; i++)
+		nr += ieot->entries[i].nr;
+	istate->cache_nr = nr;
+	istate->cache_alloc = alloc_nr(nr);
+	istate->cache = xcalloc(istate->cache_alloc, sizeof(*istate->cache));
+	mem_pool_init(&istate->ce_mem_pool,
+		      estimate_cache_size_from_compressed(nr));
+	for (i = lo, nr = 0; i < hi; i++) {
+		load_cache_entry_block(istate, istate->ce_mem_pool, nr,
+				       ieot->entries[i].nr, mmap,
+				       ieot->entries[i].offset, NULL);
+		nr += ieot->entries[i].nr;
+	}
+
+	/* drop the neighbours that came along in the same blocks */
+	for (first = 0; first < istate->cache_nr; first++) {
+		const struct cache_entry *ce = istate->cache[first];
+
+		if (!cmp_prefix(ce->name, ce_namelen(ce), prefix, prefixlen))
+			break;
+	}
+	for (last = first; last < istate->cache_nr; last++) {
+		const struct cache_entry *ce = istate->cache[last];
+
+		if (cmp_prefix(ce->name, ce_namelen(ce), prefix, prefixlen))
+			break;
+	}
+	MOVE_ARRAY(istate->cache, istate->cache + first, last - first);
+	istate->cache_nr = last - first;
+
+	hashcpy(istate->oid.hash, (const unsigned char *)hdr + mmap_size - the_hash_algo->rawsz);
+	istate->timestamp.sec = st.st_mtime;
+	istate->timestamp.nsec = ST_MTIME_NSEC(st);
+	istate->initialized = 1;
+	istate->partially_read = 1;
+
+	free(ieot);
+	munmap((void *)mmap, mmap_size);
+	return istate->cache_nr;
+
+fallback:
+	free(ieot);
+	munmap((void *)mmap, mmap_size);
+	return -1;
+}
+
+int read_index_partial(struct index_state *istate, const char *path,
+		       const char *gitdir, const char *prefix, size_t prefixlen)
+{
+	int ret;
+
+	if (istate->initialized)
+		return istate->cache_nr;
+
+	if (prefixlen) {
+		trace_performance_enter();
+		ret = do_read_index_partial(istate, path, prefix, prefixlen);
+		trace_performance_leave("read partial cache %s", path);
+		if (ret >= 0) {
+			check_ce_order(istate);
+			return ret;
+		}
+	}
+	return read_index_from(istate, path, gitdir);
+}
+
+static int scan_index_in_place(void)
+{
+	int val;
+
+	return !git_config_get_bool("index.scaninplace", &val) && val;
+}
+
+/*
+ * Decode the on-disk entry at "ondisk" into "*ce", which is grown as
+ * needed and, in a v4 index, holds the previous entry, if any, so that
+ * only the part of the name that differs is copied. Returns the size
+ * of the on-disk entry.
+ */
+static unsigned long decode_ondisk_entry(unsigned int version,
+					 const struct ondisk_cache_entry *ondisk,
+					 struct cache_entry **ce, size_t *alloc)
+{
+	const struct cache_entry *previous_ce = *ce && (*ce)->ce_namelen ? *ce : NULL;
+	size_t len, copy_len, size;
+	unsigned int flags;
+	const char *name;
+
+	name = parse_ondisk_name(version, ondisk,
+				 previous_ce ? previous_ce->ce_namelen : 0,
+				 previous_ce ? previous_ce->name : NULL,
+				 &flags, &len, &copy_len);
+
+	size = cache_entry_size(len);
+	if (!*ce) {
+		*alloc = alloc_nr(size);
+		*ce = xcalloc(1, *alloc);
+	} else if (*alloc < size) {
+		*alloc = alloc_nr(size);
+		*ce = xrealloc(*ce, *alloc);
+	}
+	copy_ondisk_fields(*ce, ondisk, flags, len);
+	memcpy((*ce)->name + copy_len, name, len + 1 - copy_len);
+
+	if (version == 4)
+		return (name - (const char *)ondisk) + len + 1 - copy_len;
+	return ondisk_ce_size(*ce);
+}
+
+static int do_for_each_index_file_entry(const char *path,
+					const char *prefix, size_t prefixlen,
+					each_index_entry_fn fn, void *data)
+{
+	int fd, i, nr, lo, hi, ret = 0;
+	struct stat st;
+	const struct cache_header *hdr;
+	const char *mmap;
+	size_t mmap_size, offset, extension_offset, alloc = 0;
+	struct index_entry_offset_table *ieot = NULL;
+	struct cache_entry *ce = NULL;
+	unsigned int version;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return errno == ENOENT ? 0 : -1;
+	if (fstat(fd, &st)) {
+		close(fd);
+		return -1;
+	}
+	mmap_size = xsize_t(st.st_size);
+	if (mmap_size < sizeof(struct cache_header) + the_hash_algo->rawsz) {
+		close(fd);
+		return -1;
+	}
+	mmap = xmmap(NULL, mmap_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+
+	hdr = (const struct cache_header *)mmap;
+	if (verify_hdr(hdr, mmap_size) < 0) {
+		ret = -1;
+		goto done;
+	}
+	version = ntohl(hdr->hdr_version);
+	nr = ntohl(hdr->hdr_entries);
+	offset = sizeof(*hdr);
+
+	/* a split index needs its shared index to be merged in */
+	extension_offset = read_eoie_extension(mmap, mmap_size);
+	if (!extension_offset) {
+		extension_offset = offset;
+		for (i = 0; i < nr; i++)
+			extension_offset += decode_ondisk_entry(version,
+				(const struct ondisk_cache_entry *)(mmap + extension_offset),
+				&ce, &alloc);
+		if (ce)
+			ce->ce_namelen = 0;
+	}
+	if (has_index_extension(mmap, mmap_size, extension_offset, CACHE_EXT_LINK)) {
+		ret = -1;
+		goto done;
+	}
+
+	/* start from the block that may hold the first entry under "prefix" */
+	i = 0;
+	if (prefixlen)
+		ieot = read_ieot_extension(mmap, mmap_size, extension_offset);
+	if (ieot && ieot->nr && ieot_is_usable(ieot, hdr, extension_offset)) {
+		int block;
+
+		find_prefix_blocks(version, mmap, ieot, prefix, prefixlen, &lo, &hi);
+		for (block = 0; block < lo; block++)
+			i += ieot->entries[block].nr;
+		offset = ieot->entries[lo].offset;
+	}
+
+	for (; i < nr; i++) {
+		const struct ondisk_cache_entry *ondisk =
+			(const struct ondisk_cache_entry *)(mmap + offset);
+		int cmp;
+
+		offset += decode_ondisk_entry(version, ondisk, &ce, &alloc);
+		cmp = cmp_prefix(ce->name, ce->ce_namelen, prefix, prefixlen);
+		if (cmp < 0)
+			continue;
+		if (cmp > 0)
+			break;
+		ret = fn(ce, data);
+		if (ret)
+			break;
+	}
+
+done:
+	free(ce);
+	free(ieot);
+	munmap((void *)mmap, mmap_size);
+	return ret;
+}
+
+int for_each_index_file_entry(const char *path,
+			      const char *prefix, size_t prefixlen,
+			      each_index_entry_fn fn, void *data)
+{
+	int ret;
+
+	if (!scan_index_in_place())
+		return -1;
+
+	trace_performance_enter();
+	ret = do_for_each_index_file_entry(path, prefix, prefixlen, fn, data);
+	trace_performance_leave("scan cache %s", path);
+	return ret;
+}
+
 /*
  * Signal that the shared index is used by updating its mtime.
  *
@@ -2250,13 +2665,73 @@ static void freshen_shared_index(const char *shared_index, int warn)
 		warning("could not freshen shared index '%s'", shared_index);
 }
 
+/*
+ * Read the shared index istate is split from and merge it into istate.
+ * The shared index may itself be a layer split from an older shared
+ * index; the whole chain is then read and flattened into a single base.
+ */
+static int read_shared_index(struct index_state *istate, const char *gitdir)
+{
+	struct split_index *si = istate->split_index;
+	struct split_index *lower;
+	struct index_state *base;
+	char *base_oid_hex;
+	char *base_path;
+	int ret;
+
+	trace_performance_enter();
+	if (si->base)
+		discard_index(si->base);
+	else
+		si->base = xcalloc(1, sizeof(*si->base));
+	base = si->base;
+
+	base_oid_hex = oid_to_hex(&si->base_oid);
+	base_path = xstrfmt("%s/sharedindex.%s", gitdir, base_oid_hex);
+	ret = do_read_index(base, base_path, 1);
+	if (!oideq(&si->base_oid, &base->oid))
+		die("broken index, expect %s in %s, got %s",
+		    base_oid_hex, base_path,
+		    oid_to_hex(&base->oid));
+
+	freshen_shared_index(base_path, 0);
+
+	oid_array_clear(&si->layers);
+	lower = base->split_index;
+	if (!lower || is_null_oid(&lower->base_oid)) {
+		si->bottom_nr = base->cache_nr;
+		si->upper_nr = 0;
+	} else {
+		unsigned int nr = base->cache_nr;
+		int i;
+
+		read_shared_index(base, gitdir);
+		for (i = 0; i < lower->layers.nr; i++)
+			oid_array_append(&si->layers, &lower->layers.oid[i]);
+		si->bottom_nr = lower->bottom_nr;
+		si->upper_nr = lower->upper_nr + nr;
+
+		/*
+		 * The merged base now owns the entries of the layers
+		 * below it; see remove_split_index().
+		 */
+		mem_pool_combine(base->ce_mem_pool, lower->base->ce_mem_pool);
+		lower->base->cache_nr = 0;
+		discard_split_index(base);
+	}
+	oid_array_append(&si->layers, &si->base_oid);
+
+	merge_base_index(istate);
+	trace_performance_leave("read cache %s", base_path);
+	free(base_path);
+	return ret;
+}
+
 int read_index_from(struct index_state *istate, const char *path,
 		    const char *gitdir)
 {
 	struct split_index *split_index;
 	int ret;
-	char *base_oid_hex;
-	char *base_path;
 
 	/* istate->initialized covers both .git/index and .git/sharedindex.xxx */
 	if (istate->initialized)
@@ -2272,25 +2747,8 @@ int read_index_from(struct index_state *istate, const char *path,
 		return ret;
 	}
 
-	trace_performance_enter();
-	if (split_index->base)
-		discard_index(split_index->base);
-	else
-		split_index->base = xcalloc(1, sizeof(*split_index->base));
-
-	base_oid_hex = oid_to_hex(&split_index->base_oid);
-	base_path = xstrfmt("%s/sharedindex.%s", gitdir, base_oid_hex);
-	ret = do_read_index(split_index->base, base_path, 1);
-	if (!oideq(&split_index->base_oid, &split_index->base->oid))
-		die("broken index, expect %s in %s, got %s",
-		    base_oid_hex, base_path,
-		    oid_to_hex(&split_index->base->oid));
-
-	freshen_shared_index(base_path, 0);
-	merge_base_index(istate);
+	ret = read_shared_index(istate, gitdir);
 	post_read_index_from(istate);
-	trace_performance_leave("read cache %s", base_path);
-	free(base_path);
 	return ret;
 }
 
@@ -2312,6 +2770,7 @@ int discard_index(struct index_state *istate)
 
 	resolve_undo_clear_index(istate);
 	istate->cache_nr = 0;
+	istate->partially_read = 0;
 	istate->cache_changed = 0;
 	istate->timestamp.sec = 0;
 	istate->timestamp.nsec = 0;
@@ -2690,6 +3149,13 @@ void update_index_if_able(struct index_state *istate, struct lock_file *lockfile
 		rollback_lock_file(lockfile);
 }
 
+static int record_partial_read(void)
+{
+	int val;
+
+	return !git_config_get_bool("index.partialread", &val) && val;
+}
+
 static int record_eoie(void)
 {
 	int val;
@@ -2697,6 +3163,9 @@ static int record_eoie(void)
 	if (!git_config_get_bool("index.recordendofindexentries", &val))
 		return val;
 
+	if (record_partial_read())
+		return 1;
+
 	/*
 	 * As a convenience, the end of index entries extension
 	 * used for threading is written by default if the user
@@ -2705,6 +3174,18 @@ static int record_eoie(void)
 	return !git_config_get_index_threads(&val) && val != 1;
 }
 
+/*
+ * The name hash is only used with core.ignoreCase; see
+ * lazy_init_name_hash().
+ */
+static int record_name_hash(void)
+{
+	int val;
+
+	return ignore_case &&
+		!git_config_get_bool("index.recordnamehash", &val) && val;
+}
+
 static int record_ieot(void)
 {
 	int val;
@@ -2720,6 +3201,39 @@ static int record_ieot(void)
 	return !git_config_get_index_threads(&val) && val != 1;
 }
 
+/*
+ * With index.partialRead, the offset table has blocks of at least this
+ * many entries, each one starting where a directory does if possible,
+ * so that read_index_partial() can load one part of the tree.
+ */
+#define PARTIAL_READ_BLOCK_ENTRIES 1024
+
+static int starts_directory_block(int nr, const struct cache_entry *prev,
+				  const struct cache_entry *ce)
+{
+	const char *slash;
+	int len, prev_len;
+
+	if (nr < PARTIAL_READ_BLOCK_ENTRIES)
+		return 0;
+	if (nr >= 4 * PARTIAL_READ_BLOCK_ENTRIES)
+		return 1;
+	slash = strrchr(ce->name, '/');
+	len = slash ? slash - ce->name : 0;
+	slash = strrchr(prev->name, '/');
+	prev_len = slash ? slash - prev->name : 0;
+	return len != prev_len || memcmp(prev->name, ce->name, len);
+}
+
+/*
+ * A shared index layer is written like a shared index, without any of
+ * the extensions, but keeps the link to the shared index below it. It
+ * also carries the required "layr" extension, as versions of Git that
+ * do not know about layers would ignore the link in a shared index and
+ * silently lose the entries below it.
+ */
+#define STRIP_EXTENSIONS_BUT_LINK 2
+
 /*
  * On success, `tempfile` is closed. If it is the temporary file
  * of a `struct lock_file`, we will therefore effectively perform
@@ -2744,7 +3258,11 @@ static int do_write_index(struct index_state *istate, struct tempfile *tempfile,
 	off_t offset;
 	int ieot_entries = 1;
 	struct index_entry_offset_table *ieot = NULL;
-	int nr, nr_threads;
+	int nr, nr_threads, partial_read = 0;
+	const struct cache_entry *prev_ce = NULL;
+
+	if (istate->partially_read)
+		BUG("cannot write a partially read index");
 
 	for (i = removed = extended = 0; i < entries; i++) {
 		if (cache[i]->ce_flags & CE_REMOVE)
@@ -2781,7 +3299,12 @@ static int do_write_index(struct index_state *istate, struct tempfile *tempfile,
 	if (!HAVE_THREADS || git_config_get_index_threads(&nr_threads))
 		nr_threads = 1;
 
-	if (nr_threads != 1 && record_ieot()) {
+	if (record_partial_read()) {
+		partial_read = 1;
+		ieot = xcalloc(1, sizeof(struct index_entry_offset_table)
+			+ ((entries / PARTIAL_READ_BLOCK_ENTRIES + 1) *
+			   sizeof(struct index_entry_offset)));
+	} else if (nr_threads != 1 && record_ieot()) {
 		int ieot_blocks, cpus;
 
 		/*
@@ -2839,7 +3362,10 @@ static int do_write_index(struct index_state *istate, struct tempfile *tempfile,
 
 			drop_cache_tree = 1;
 		}
-		if (ieot && i && (i % ieot_entries == 0)) {
+		if (ieot && i &&
+		    (partial_read ?
+		     starts_directory_block(nr, prev_ce, ce) :
+		     i % ieot_entries == 0)) {
 			ieot->entries[ieot->nr].nr = nr;
 			ieot->entries[ieot->nr].offset = offset;
 			ieot->nr++;
@@ -2864,6 +3390,7 @@ static int do_write_index(struct index_state *istate, struct tempfile *tempfile,
 		if (err)
 			break;
 		nr++;
+		prev_ce = ce;
 	}
 	if (ieot && nr) {
 		ieot->entries[ieot->nr].nr = nr;
@@ -2905,7 +3432,14 @@ static int do_write_index(struct index_state *istate, struct tempfile *tempfile,
 			return -1;
 	}
 
-	if (!strip_extensions && istate->split_index) {
+	if (strip_extensions == STRIP_EXTENSIONS_BUT_LINK) {
+		err = write_index_ext_header(&c, &eoie_c, newfd,
+					     CACHE_EXT_LAYER, 0) < 0;
+		if (err)
+			return -1;
+	}
+	if ((!strip_extensions || strip_extensions == STRIP_EXTENSIONS_BUT_LINK) &&
+	    istate->split_index) {
 		struct strbuf sb = STRBUF_INIT;
 
 		err = write_link_extension(&sb, istate) < 0 ||
@@ -2958,6 +3492,17 @@ static int do_write_index(struct index_state *istate, struct tempfile *tempfile,
 		if (err)
 			return -1;
 	}
+	if (!strip_extensions && !istate->split_index && record_name_hash()) {
+		struct strbuf sb = STRBUF_INIT;
+
+		if (!write_name_hash_extension(&sb, istate))
+			err = write_index_ext_header(&c, &eoie_c, newfd, CACHE_EXT_NAMEHASH,
+						     sb.len) < 0
+				|| ce_write(&c, newfd, sb.buf, sb.len) < 0;
+		strbuf_release(&sb);
+		if (err)
+			return -1;
+	}
 
 	/*
 	 * CACHE_EXT_ENDOFINDEXENTRIES must be written as the last entry before the SHA1
@@ -3059,7 +3604,20 @@ static int should_delete_shared_index(const char *shared_index_path)
 	return 1;
 }
 
-static int clean_shared_index_files(const char *current_hex)
+static int is_shared_index_layer(struct split_index *si, const char *hex)
+{
+	struct object_id oid;
+	int i;
+
+	if (get_oid_hex(hex, &oid) || hex[the_hash_algo->hexsz])
+		return 0;
+	for (i = 0; i < si->layers.nr; i++)
+		if (oideq(&oid, &si->layers.oid[i]))
+			return 1;
+	return 0;
+}
+
+static int clean_shared_index_files(struct split_index *si)
 {
 	struct dirent *de;
 	DIR *dir = opendir(get_git_dir());
@@ -3072,7 +3630,7 @@ static int clean_shared_index_files(const char *current_hex)
 		const char *shared_index_path;
 		if (!skip_prefix(de->d_name, "sharedindex.", &sha1_hex))
 			continue;
-		if (!strcmp(sha1_hex, current_hex))
+		if (is_shared_index_layer(si, sha1_hex))
 			continue;
 		shared_index_path = git_path("%s", de->d_name);
 		if (should_delete_shared_index(shared_index_path) > 0 &&
@@ -3103,12 +3661,82 @@ static int write_shared_index(struct index_state *istate,
 			      git_path("sharedindex.%s", oid_to_hex(&si->base->oid)));
 	if (!ret) {
 		oidcpy(&si->base_oid, &si->base->oid);
-		clean_shared_index_files(oid_to_hex(&si->base->oid));
+		oid_array_clear(&si->layers);
+		oid_array_append(&si->layers, &si->base_oid);
+		si->bottom_nr = si->base->cache_nr;
+		si->upper_nr = 0;
+		clean_shared_index_files(si);
 	}
 
 	return ret;
 }
 
+/*
+ * Write the entries that would go to the split index as a new shared
+ * index layer on top of the current shared index, and make the merged
+ * result the base of istate.
+ */
+static int write_shared_index_layer(struct index_state *istate,
+				    struct tempfile **temp)
+{
+	struct split_index *si = istate->split_index;
+	struct cache_time timestamp = istate->timestamp;
+	unsigned int nr;
+	int ret;
+
+	prepare_to_write_split_index(istate);
+	nr = istate->cache_nr;
+	ret = do_write_index(istate, *temp, STRIP_EXTENSIONS_BUT_LINK);
+	finish_writing_split_index(istate);
+	istate->timestamp = timestamp;
+	if (ret)
+		return ret;
+	ret = adjust_shared_perm(get_tempfile_path(*temp));
+	if (ret) {
+		error("cannot fix permission bits on %s", get_tempfile_path(*temp));
+		return ret;
+	}
+	ret = rename_tempfile(temp,
+			      git_path("sharedindex.%s", oid_to_hex(&istate->oid)));
+	if (!ret) {
+		oidcpy(&si->base_oid, &istate->oid);
+		move_cache_to_base_index(istate);
+		oidcpy(&si->base->oid, &si->base_oid);
+		oid_array_append(&si->layers, &si->base_oid);
+		si->upper_nr += nr;
+		clean_shared_index_files(si);
+	}
+
+	return ret;
+}
+
+/*
+ * Decide whether the entries that made the split index grow too large
+ * can be pushed as a new layer instead of rewriting the whole shared
+ * index. Everything stacked on top of the bottom shared index has to
+ * stay under half of its size, so reading the chain never costs much
+ * more than reading a single shared index.
+ */
+static int should_write_shared_index_layer(struct index_state *istate)
+{
+	struct split_index *si = istate->split_index;
+	int i, max_layers = git_config_get_max_shared_layers();
+	unsigned int nr = 0;
+
+	if (max_layers <= 1 || !si->base || !si->layers.nr ||
+	    si->layers.nr >= max_layers ||
+	    !oideq(&si->base_oid, &si->layers.oid[si->layers.nr - 1]))
+		return 0;
+
+	for (i = 0; i < istate->cache_nr; i++) {
+		struct cache_entry *ce = istate->cache[i];
+		if (!ce->index || (ce->ce_flags & CE_UPDATE_IN_BASE))
+			nr++;
+	}
+
+	return (uint64_t)(si->upper_nr + nr) * 2 <= si->bottom_nr;
+}
+
 static const int default_max_percent_split_change = 20;
 
 static int too_many_not_shared_entries(struct index_state *istate)
@@ -3139,6 +3767,27 @@ static int too_many_not_shared_entries(struct index_state *istate)
 	return (int64_t)istate->cache_nr * max_split < (int64_t)not_shared * 100;
 }
 
+/*
+ * With index.updateCacheTree, the trees that were invalidated since
+ * the index was read are written out again before the index is, so
+ * that the next commit (or "diff --cached") finds the cache tree
+ * valid.  Paths that cannot be written as a tree yet (unmerged
+ * entries, missing objects, intent-to-add entries) are left
+ * invalid, quietly.
+ */
+static void update_cache_tree_before_write(struct index_state *istate)
+{
+	int val;
+
+	if (git_config_get_bool("index.updatecachetree", &val) || !val)
+		return;
+	if (istate->cache_tree && istate->cache_tree->entry_count >= 0)
+		return;
+	if (!istate->cache_tree)
+		istate->cache_tree = cache_tree();
+	cache_tree_update(istate, WRITE_TREE_SILENT);
+}
+
 int write_locked_index(struct index_state *istate, struct lock_file *lock,
 		       unsigned flags)
 {
@@ -3154,6 +3803,8 @@ int write_locked_index(struct index_state *istate, struct lock_file *lock,
 		return 0;
 	}
 
+	update_cache_tree_before_write(istate);
+
 	if (istate->fsmonitor_last_update)
 		fill_fsmonitor_bitmap(istate);
 
@@ -3186,7 +3837,10 @@ int write_locked_index(struct index_state *istate, struct lock_file *lock,
 			ret = do_write_locked_index(istate, lock, flags);
 			goto out;
 		}
-		ret = write_shared_index(istate, &temp);
+		if (should_write_shared_index_layer(istate))
+			ret = write_shared_index_layer(istate, &temp);
+		else
+			ret = write_shared_index(istate, &temp);
 
 		saved_errno = errno;
 		if (is_tempfile_active(temp))
@@ -3203,7 +3857,12 @@ int write_locked_index(struct index_state *istate, struct lock_file *lock,
 	if (!ret && !new_shared_index) {
 		const char *shared_index = git_path("sharedindex.%s",
 						    oid_to_hex(&si->base_oid));
+		int i;
+
 		freshen_shared_index(shared_index, 1);
+		for (i = 0; i + 1 < si->layers.nr; i++)
+			freshen_shared_index(git_path("sharedindex.%s",
+						      oid_to_hex(&si->layers.oid[i])), 1);
 	}
 
 out:
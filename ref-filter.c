@@ -20,6 +20,7 @@
 #include "commit-slab.h"
 #include "commit-graph.h"
 #include "commit-reach.h"
+#include "pack-bitmap.h"
 
 static struct ref_msg {
 	const char *gone;
@@ -1928,6 +1929,7 @@ struct ref_filter_cbdata {
 	struct ref_filter *filter;
 	struct contains_cache contains_cache;
 	struct contains_cache no_contains_cache;
+	struct bitmap_index *bitmap_git;
 };
 
 /*
@@ -1975,11 +1977,15 @@ static int ref_filter_handler(const char *refname, const struct object_id *oid,
 			return 0;
 		/* We perform the filtering for the '--contains' option... */
 		if (filter->with_commit &&
-		    !commit_contains(filter, commit, filter->with_commit, &ref_cbdata->contains_cache))
+		    !commit_contains(filter, commit, filter->with_commit,
+				     &ref_cbdata->contains_cache,
+				     ref_cbdata->bitmap_git))
 			return 0;
 		/* ...or for the `--no-contains' option */
 		if (filter->no_commit &&
-		    commit_contains(filter, commit, filter->no_commit, &ref_cbdata->no_contains_cache))
+		    commit_contains(filter, commit, filter->no_commit,
+				    &ref_cbdata->no_contains_cache,
+				    ref_cbdata->bitmap_git))
 			return 0;
 	}
 
@@ -2022,6 +2028,40 @@ void ref_array_clear(struct ref_array *array)
 	array->nr = array->alloc = 0;
 }
 
+/*
+ * With reachability bitmaps, compute the set of commits reachable from
+ * the merge commit once and test each ref against it, instead of
+ * walking the history between the refs and the merge commit.
+ */
+static void do_merge_filter_bitmap(struct ref_filter_cbdata *ref_cbdata)
+{
+	struct ref_filter *filter = ref_cbdata->filter;
+	struct ref_array *array = ref_cbdata->array;
+	struct bitmap_index *bitmap_git = ref_cbdata->bitmap_git;
+	struct bitmap *reachable;
+	int i, old_nr;
+
+	reachable = bitmap_reachable_from_commit(bitmap_git,
+						 filter->merge_commit);
+
+	old_nr = array->nr;
+	array->nr = 0;
+
+	for (i = 0; i < old_nr; i++) {
+		struct ref_array_item *item = array->items[i];
+		int pos = bitmap_object_position(bitmap_git,
+						 &item->commit->object.oid);
+		int is_merged = pos >= 0 && bitmap_get(reachable, pos);
+
+		if (is_merged == (filter->merge == REF_FILTER_MERGED_INCLUDE))
+			array->items[array->nr++] = array->items[i];
+		else
+			free_array_item(item);
+	}
+
+	bitmap_free(reachable);
+}
+
 static void do_merge_filter(struct ref_filter_cbdata *ref_cbdata)
 {
 	struct rev_info revs;
@@ -2087,6 +2127,10 @@ int filter_refs(struct ref_array *array, struct ref_filter *filter, unsigned int
 	init_contains_cache(&ref_cbdata.contains_cache);
 	init_contains_cache(&ref_cbdata.no_contains_cache);
 
+	ref_cbdata.bitmap_git = NULL;
+	if (filter->with_commit || filter->no_commit || filter->merge_commit)
+		ref_cbdata.bitmap_git = prepare_bitmap_git();
+
 	/*  Simple per-ref filtering */
 	if (!filter->kind)
 		die("filter_refs: invalid type");
@@ -2113,9 +2157,14 @@ int filter_refs(struct ref_array *array, struct ref_filter *filter, unsigned int
 	clear_contains_cache(&ref_cbdata.no_contains_cache);
 
 	/*  Filters that need revision walking */
-	if (filter->merge_commit)
-		do_merge_filter(&ref_cbdata);
+	if (filter->merge_commit) {
+		if (ref_cbdata.bitmap_git)
+			do_merge_filter_bitmap(&ref_cbdata);
+		else
+			do_merge_filter(&ref_cbdata);
+	}
 
+	free_bitmap_index(ref_cbdata.bitmap_git);
 	return ret;
 }
 
@@ -864,6 +864,9 @@ static void cherry_pick_list(struct commit_list *list, struct rev_info *revs)
 	int left_count = 0, right_count = 0;
 	int left_first;
 	struct patch_ids ids;
+	struct commit **other;
+	struct patch_id **id;
+	int i, other_nr = 0;
 	unsigned cherry_flag;
 
 	/* First count the commits on the left and on the right */
@@ -906,9 +909,9 @@ static void cherry_pick_list(struct commit_list *list, struct rev_info *revs)
 	cherry_flag = revs->cherry_mark ? PATCHSAME : SHOWN;
 
 	/* Check the other side */
+	ALLOC_ARRAY(other, left_first ? right_count : left_count);
 	for (p = list; p; p = p->next) {
 		struct commit *commit = p->item;
-		struct patch_id *id;
 		unsigned flags = commit->object.flags;
 
 		if (flags & BOUNDARY)
@@ -919,18 +922,23 @@ static void cherry_pick_list(struct commit_list *list, struct rev_info *revs)
 		 */
 		if (left_first == !!(flags & SYMMETRIC_LEFT))
 			continue;
+		other[other_nr++] = commit;
+	}
 
-		/*
-		 * Have we seen the same patch id?
-		 */
-		id = has_commit_patch_id(commit, &ids);
-		if (!id)
+	/*
+	 * Have we seen the same patch id?
+	 */
+	ALLOC_ARRAY(id, other_nr);
+	has_commit_patch_ids(other, other_nr, &ids, id);
+	for (i = 0; i < other_nr; i++) {
+		if (!id[i])
 			continue;
-
-		commit->object.flags |= cherry_flag;
-		id->commit->object.flags |= cherry_flag;
+		other[i]->object.flags |= cherry_flag;
+		id[i]->commit->object.flags |= cherry_flag;
 	}
 
+	free(id);
+	free(other);
 	free_patch_ids(&ids);
 }
 
@@ -2328,6 +2336,11 @@ static void NORETURN diagnose_missing_default(const char *def)
 	    refname);
 }
 
+static inline int want_ancestry(const struct rev_info *revs)
+{
+	return (revs->rewrite_parents || revs->children.name);
+}
+
 /*
  * Parse revision information, filling in the "rev_info" structure,
  * and removing the used arguments from the argument list.
@@ -2489,7 +2502,15 @@ int setup_revisions(int argc, const char **argv, struct rev_info *revs, struct s
 	revs->diffopt.abbrev = revs->abbrev;
 
 	if (revs->line_level_traverse) {
-		revs->limited = 1;
+		/*
+		 * Unless the walk is limited anyway, or parents are to
+		 * be rewritten, which needs to see the whole history
+		 * first, the line ranges are followed as the commits come
+		 * out of the topo-order walk, which gives all children
+		 * of a commit before it.
+		 */
+		if (want_ancestry(revs))
+			revs->limited = 1;
 		revs->topo_order = 1;
 	}
 
@@ -2915,7 +2936,7 @@ define_commit_slab(indegree_slab, int);
 define_commit_slab(author_date_slab, timestamp_t);
 
 struct topo_walk_info {
-	uint32_t min_generation;
+	timestamp_t min_generation;
 	struct prio_queue explore_queue;
 	struct prio_queue indegree_queue;
 	struct prio_queue topo_queue;
@@ -2961,7 +2982,7 @@ static void explore_walk_step(struct rev_info *revs)
 }
 
 static void explore_to_depth(struct rev_info *revs,
-			     uint32_t gen_cutoff)
+			     timestamp_t gen_cutoff)
 {
 	struct topo_walk_info *info = revs->topo_walk_info;
 	struct commit *c;
@@ -3001,7 +3022,7 @@ static void indegree_walk_step(struct rev_info *revs)
 }
 
 static void compute_indegrees_to_depth(struct rev_info *revs,
-				       uint32_t gen_cutoff)
+				       timestamp_t gen_cutoff)
 {
 	struct topo_walk_info *info = revs->topo_walk_info;
 	struct commit *c;
@@ -3165,7 +3186,7 @@ int prepare_revision_walk(struct rev_info *revs)
 			sort_in_topological_order(&revs->commits, revs->sort_order);
 	} else if (revs->topo_order)
 		init_topo_walk(revs);
-	if (revs->line_level_traverse)
+	if (revs->line_level_traverse && revs->limited)
 		line_log_filter(revs);
 	if (revs->simplify_merges)
 		simplify_merges(revs);
@@ -3325,11 +3346,6 @@ static int commit_match(struct commit *commit, struct rev_info *opt)
 	return opt->invert_grep ? !retval : retval;
 }
 
-static inline int want_ancestry(const struct rev_info *revs)
-{
-	return (revs->rewrite_parents || revs->children.name);
-}
-
 /*
  * Return a timestamp to be used for --since/--until comparisons for this
  * commit, based on the revision options.
@@ -3383,6 +3399,9 @@ enum commit_action get_commit_action(struct rev_info *revs, struct commit *commi
 			return commit_ignore;
 		}
 	}
+	if (revs->line_level_traverse && !revs->limited &&
+	    (commit->object.flags & TREESAME))
+		return commit_ignore; /* does not touch the line ranges */
 	return commit_show;
 }
 
@@ -3422,7 +3441,7 @@ static void save_parents(struct rev_info *revs, struct commit *commit)
 		*pp = EMPTY_PARENT_LIST;
 }
 
-static void free_saved_parents(struct rev_info *revs)
+void free_saved_parents(struct rev_info *revs)
 {
 	if (revs->saved_parents_slab)
 		clear_saved_parents(revs->saved_parents_slab);
@@ -3519,6 +3538,17 @@ static struct commit *get_revision_1(struct rev_info *revs)
 					die("Failed to traverse parents of commit %s",
 						oid_to_hex(&commit->object.oid));
 			}
+
+			/*
+			 * In a walk that is not limited, the line ranges
+			 * are followed here instead of in line_log_filter(),
+			 * for every commit the walk reaches, whether it
+			 * is going to be shown or not, as its parents
+			 * need the ranges passed on to them.
+			 */
+			if (revs->line_level_traverse &&
+			    !(commit->object.flags & UNINTERESTING))
+				line_log_process_ranges_arbitrary_commit(revs, commit);
 		}
 
 		switch (simplify_commit(revs, commit)) {
@@ -3706,7 +3736,8 @@ struct commit *get_revision(struct rev_info *revs)
 	if (c && revs->graph)
 		graph_update(revs->graph, c);
 	if (!c) {
-		free_saved_parents(revs);
+		if (!revs->keep_saved_parents)
+			free_saved_parents(revs);
 		if (revs->previous_parents) {
 			free_commit_list(revs->previous_parents);
 			revs->previous_parents = NULL;
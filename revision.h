@@ -270,6 +270,8 @@ struct rev_info {
 
 	/* copies of the parent lists, for --full-diff display */
 	struct saved_parents *saved_parents_slab;
+	/* keep them when the walk ends, see free_saved_parents() */
+	unsigned int keep_saved_parents:1;
 
 	struct commit_list *previous_parents;
 	const char *break_bar;
@@ -374,4 +376,11 @@ int rewrite_parents(struct rev_info *revs,
  */
 struct commit_list *get_saved_parents(struct rev_info *revs, const struct commit *commit);
 
+/*
+ * get_revision() frees the saved parents when the walk ends, unless
+ * keep_saved_parents is set because the caller reads ahead and still
+ * has to show commits it got earlier; it then calls this itself.
+ */
+void free_saved_parents(struct rev_info *revs);
+
 #endif
@@ -399,6 +399,7 @@ void discard_split_index(struct index_state *istate)
 		discard_index(si->base);
 		free(si->base);
 	}
+	oid_array_clear(&si->layers);
 	free(si);
 }
 
@@ -2,6 +2,7 @@
 #define SPLIT_INDEX_H
 
 #include "cache.h"
+#include "sha1-array.h"
 
 struct index_state;
 struct strbuf;
@@ -16,6 +17,15 @@ struct split_index {
 	unsigned int saved_cache_nr;
 	unsigned int nr_deletions;
 	unsigned int nr_replacements;
+	/*
+	 * The shared index files "base" was merged from, bottom first
+	 * and base_oid last, and the number of entries stored in the
+	 * bottom one and in the layers above it (see
+	 * splitIndex.maxSharedLayers).
+	 */
+	struct oid_array layers;
+	unsigned int bottom_nr;
+	unsigned int upper_nr;
 	int refcount;
 };
 
@@ -26,6 +26,7 @@ static void dump_run(void)
 		struct dir_entry *parent;
 		int nr;
 		unsigned int namelen;
+		unsigned int id;
 		char name[FLEX_ARRAY];
 	};
 
@@ -138,7 +138,7 @@ int cmd__reach(int ac, const char **av)
 		else
 			filter.with_commit_tag_algo = 0;
 
-		printf("%s(_,A,X,_):%d\n", av[1], commit_contains(&filter, A, X, &cache));
+		printf("%s(_,A,X,_):%d\n", av[1], commit_contains(&filter, A, X, &cache, NULL));
 	} else if (!strcmp(av[1], "get_reachable_subset")) {
 		const int reachable_flag = 1;
 		int i, count = 0;
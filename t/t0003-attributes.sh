@@ -268,6 +268,47 @@ EOF
 	test_line_count = 0 err
 '
 
+test_expect_success 'pathname patterns across directories' '
+	mkdir -p deep/x/y/b &&
+	test_when_finished "rm -rf deep" &&
+	cat >deep/.gitattributes <<-\EOF &&
+	x/y/*.c	test=xy
+	/top	test=top
+	x/**/z	test=starstar
+	[xy]/q	test=bracket
+	m	-test
+	EOF
+	echo "y/w	test=w" >deep/x/.gitattributes &&
+	cat >paths <<-\EOF &&
+	deep/x/y/a.c
+	deep/top
+	deep/x/top
+	deep/x/y/z
+	deep/x/z
+	deep/y/q
+	deep/x/y/w
+	deep/x/y/m
+	deep/x/y/a.c
+	deep/a.c
+	deep/x/y/b/a.c
+	EOF
+	cat >expect <<-\EOF &&
+	deep/x/y/a.c: test: xy
+	deep/top: test: top
+	deep/x/top: test: unspecified
+	deep/x/y/z: test: starstar
+	deep/x/z: test: starstar
+	deep/y/q: test: bracket
+	deep/x/y/w: test: w
+	deep/x/y/m: test: unset
+	deep/x/y/a.c: test: xy
+	deep/a.c: test: unspecified
+	deep/x/y/b/a.c: test: unspecified
+	EOF
+	git check-attr --stdin test <paths >actual &&
+	test_cmp expect actual
+'
+
 test_expect_success 'using --git-dir and --work-tree' '
 	mkdir unreal real &&
 	git init real &&
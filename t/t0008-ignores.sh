@@ -857,5 +857,63 @@ test_expect_success 'info/exclude trumps core.excludesfile' '
 	git status --porcelain usually-ignored >actual &&
 	test_cmp expect actual
 '
+test_expect_success 'long ignore files keep last-match-wins semantics' '
+	mkdir -p long/build long/x/sub long/sub &&
+	cat >long/.gitignore <<-\EOF &&
+	*.o
+	!keep.o
+	build/
+	/top-only
+	sub/deep.txt
+	foo*bar
+	literal-file
+	!literal-file
+	*.log
+	debug.log
+	EOF
+	for i in $(test_seq 20)
+	do
+		echo "filler-$i" || return 1
+	done >>long/.gitignore &&
+	>long/x/build &&
+	cat >paths <<-\EOF &&
+	long/a.o
+	long/keep.o
+	long/build
+	long/x/build
+	long/top-only
+	long/x/top-only
+	long/sub/deep.txt
+	long/x/sub/deep.txt
+	long/x/fooXbar
+	long/literal-file
+	long/debug.log
+	long/x/other.log
+	long/x/filler-20
+	EOF
+	cat >expect <<-\EOF &&
+	long/.gitignore:1:*.o	long/a.o
+	long/.gitignore:2:!keep.o	long/keep.o
+	long/.gitignore:3:build/	long/build
+	::	long/x/build
+	long/.gitignore:4:/top-only	long/top-only
+	::	long/x/top-only
+	long/.gitignore:5:sub/deep.txt	long/sub/deep.txt
+	::	long/x/sub/deep.txt
+	long/.gitignore:6:foo*bar	long/x/fooXbar
+	long/.gitignore:8:!literal-file	long/literal-file
+	long/.gitignore:10:debug.log	long/debug.log
+	long/.gitignore:9:*.log	long/x/other.log
+	long/.gitignore:30:filler-20	long/x/filler-20
+	EOF
+	git check-ignore -v -n --stdin <paths >actual &&
+	test_cmp expect actual &&
+	sed -e "s/a\.o/A.O/" -e "s/debug/DEBUG/" paths >paths-icase &&
+	sed -e "s/a\.o$/A.O/" -e "s/	long\/debug/	long\/DEBUG/" \
+		expect >expect-icase &&
+	git -c core.ignorecase=true check-ignore -v -n --stdin \
+		<paths-icase >actual &&
+	test_cmp expect-icase actual
+'
 
 test_done
@@ -114,6 +114,29 @@ test_expect_success 'update-index invalidates cache-tree' '
 	test_invalid_cache_tree
 '
 
+test_expect_success 'index.updateCacheTree keeps cache-tree valid' '
+	test_when_finished "git reset --hard; git read-tree HEAD" &&
+	test_config index.updateCacheTree true &&
+	echo "I changed this file" >foo &&
+	git add foo &&
+	test_cache_tree &&
+	mkdir -p dirx &&
+	echo "I changed this file" >dirx/foo &&
+	git update-index --add dirx/foo &&
+	test_cache_tree &&
+	git rm -q --cached dirx/foo &&
+	test_cache_tree
+'
+
+test_expect_success 'index.updateCacheTree leaves unwritable trees invalid' '
+	test_when_finished "git reset --hard; git read-tree HEAD" &&
+	test_config index.updateCacheTree true &&
+	git update-index --add \
+		--cacheinfo 100644,1234567890123456789012345678901234567890,missing 2>err &&
+	test_must_be_empty err &&
+	test_invalid_cache_tree
+'
+
 test_expect_success 'write-tree establishes cache-tree' '
 	test-tool scrap-cache-tree &&
 	git write-tree &&
@@ -780,6 +780,55 @@ test_expect_success 'bogus head does not fallback to all heads' '
 	! grep $blob out
 '
 
+test_expect_success 'setup pack large enough for threaded verification' '
+	git init threaded &&
+	for i in $(test_seq 100)
+	do
+		echo "commit refs/heads/master" &&
+		echo "committer A U Thor <author@example.com> $((1112912053 + i)) -0700" &&
+		echo "data <<EOF" &&
+		echo "commit $i" &&
+		echo "EOF" &&
+		echo "M 644 inline file" &&
+		echo "data <<EOF" &&
+		test_seq 1000 | sed "${i}s/.*/changed/" &&
+		echo "EOF" || return 1
+	done >input &&
+	git -C threaded fast-import <input &&
+	git -C threaded repack -ad &&
+	git -C threaded count-objects -v >count &&
+	grep "^in-pack: 300$" count
+'
+
+test_expect_success 'threaded fsck agrees with single-threaded fsck' '
+	git -C threaded fsck --threads=1 >expect 2>&1 &&
+	git -C threaded -c fsck.threads=4 fsck >actual 2>&1 &&
+	test_cmp expect actual
+'
+
+test_expect_success 'threaded fsck finds corrupt delta' '
+	cp -R threaded threaded-corrupt &&
+	(
+		cd threaded-corrupt &&
+		idx=$(echo .git/objects/pack/pack-*.idx) &&
+		pack=${idx%.idx}.pack &&
+		git verify-pack -v $idx >verify &&
+		set -- $(grep "^[0-9a-f]* blob .* [1-9][0-9]* [0-9a-f]*$" verify |
+			 sed -n 50p) &&
+		obj=$1 &&
+		last=$(($5 + $4 - 1)) &&
+		chmod a+w $pack &&
+		printf "\125\252" |
+		dd of=$pack bs=1 conv=notrunc seek=$((last - 1)) &&
+		test_must_fail git fsck --threads=1 >out 2>&1 &&
+		sort out >expect &&
+		test_must_fail git fsck --threads=4 >out 2>&1 &&
+		sort out >actual &&
+		test_cmp expect actual &&
+		grep "cannot unpack $obj" actual
+	)
+'
+
 # Corrupt the checksum on the index.
 # Add 1 to the last byte in the SHA.
 corrupt_index_checksum () {
@@ -472,4 +472,65 @@ test_expect_success 'writing split index with null sha1 does not write cache tre
 	test_line_count = 0 cache-tree.out
 '
 
+check_layered_index () {
+	rm -f .git/plain-index &&
+	GIT_INDEX_FILE=.git/plain-index git -c core.splitIndex=false add . &&
+	GIT_INDEX_FILE=.git/plain-index git ls-files -s >../expect &&
+	git ls-files -s >../actual &&
+	test_cmp ../expect ../actual
+}
+
+test_expect_success 'shared index layers are stacked, then collapsed' '
+	test_create_repo layers &&
+	(
+		cd layers &&
+		git config core.splitIndex true &&
+		git config splitIndex.maxPercentChange 5 &&
+		git config splitIndex.maxSharedLayers 3 &&
+		git config splitIndex.sharedIndexExpire now &&
+		for i in $(test_seq 40)
+		do
+			echo $i >file$i || return 1
+		done &&
+		test-tool chmtime =-60 file* &&
+		git add . &&
+		bottom=$(git rev-parse --shared-index-path) &&
+		test-tool dump-split-index $bottom >../dump &&
+		grep "not a split index" ../dump &&
+
+		echo changed >file1 &&
+		echo 21 >new21 && echo 22 >new22 && echo 23 >new23 &&
+		test-tool chmtime =-60 file1 new2? &&
+		git add file1 new21 new22 new23 &&
+		middle=$(git rev-parse --shared-index-path) &&
+		test "$middle" != "$bottom" &&
+		test-tool dump-split-index $middle >../dump &&
+		grep "^base ${bottom##*.}" ../dump &&
+		grep layr "$middle" >/dev/null &&
+		! grep layr "$bottom" >/dev/null &&
+		check_layered_index &&
+
+		git rm -q --cached file2 &&
+		echo 24 >new24 && echo 25 >new25 && echo 26 >new26 &&
+		test-tool chmtime =-60 new24 new25 new26 &&
+		git add new24 new25 new26 &&
+		top=$(git rev-parse --shared-index-path) &&
+		test-tool dump-split-index $top >../dump &&
+		grep "^base ${middle##*.}" ../dump &&
+		ls .git/sharedindex.* >../shared &&
+		test_line_count = 3 ../shared &&
+		git add file2 &&
+		check_layered_index &&
+
+		echo 27 >new27 && echo 28 >new28 && echo 29 >new29 &&
+		test-tool chmtime =-60 new27 new28 new29 &&
+		git add new27 new28 new29 &&
+		test-tool dump-split-index $(git rev-parse --shared-index-path) >../dump &&
+		grep "not a split index" ../dump &&
+		ls .git/sharedindex.* >../shared &&
+		test_line_count = 1 ../shared &&
+		check_layered_index
+	)
+'
+
 test_done
@@ -48,5 +48,34 @@ test_expect_success 'path checkout' '
 
 '
 
-test_done
+test_expect_success 'branch switching with checkout workers' '
+
+	git checkout -b many master &&
+	for i in $(test_seq 100)
+	do
+		mkdir -p dir$((i % 10)) &&
+		echo $i >dir$((i % 10))/file$i || return 1
+	done &&
+	test_chmod +x dir3/file13 &&
+	git add dir* &&
+	git commit -m many &&
+	git ls-files -s >expect &&
+	git checkout master &&
+	test_path_is_missing dir3 &&
+
+	git -c checkout.workers=4 checkout many &&
+	test "$(git diff-files --raw)" = "" &&
+	test "$(cat dir7/file57)" = 57 &&
+
+	git -c checkout.workers=4 checkout master &&
+	test "$(git diff-files --raw)" = "" &&
+	test_path_is_missing dir3 &&
+
+	git -c checkout.workers=4 clone -b many . clone &&
+	test "$(git -C clone diff-files --raw)" = "" &&
+	git -C clone ls-files -s >actual &&
+	test_cmp expect actual
 
+'
+
+test_done
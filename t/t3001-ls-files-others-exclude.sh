@@ -297,5 +297,18 @@ test_expect_success 'ls-files with "**" patterns and no slashes' '
 	git ls-files -o -i --exclude "one**a.1" >actual &&
 	test_must_be_empty actual
 '
+test_expect_success 'ls-files -o gives the same result with threads' '
+	git ls-files -o --exclude-per-directory=.gitignore >expect &&
+	git -c core.untrackedScanThreads=4 \
+		ls-files -o --exclude-per-directory=.gitignore >actual &&
+	test_cmp expect actual &&
+	git ls-files -o -i --exclude-per-directory=.gitignore >expect &&
+	git -c core.untrackedScanThreads=4 \
+		ls-files -o -i --exclude-per-directory=.gitignore >actual &&
+	test_cmp expect actual &&
+	git ls-files -o --directory >expect &&
+	git -c core.untrackedScanThreads=4 ls-files -o --directory >actual &&
+	test_cmp expect actual
+'
 
 test_done
@@ -50,5 +50,108 @@ test_expect_success SYMLINKS 'ls-files with absolute paths to symlinks' '
 	) &&
 	test_cmp expect actual
 '
+test_expect_success 'ls-files reads only the blocks it needs' '
+	git init partial &&
+	(
+		cd partial &&
+		blob=$(echo content | git hash-object -w --stdin) &&
+		for d in a b c d e
+		do
+			for i in $(test_seq 700)
+			do
+				echo "100644 $blob	$d/dir$((i % 7))/file$i" || return 1
+			done
+		done >list &&
+		echo "100644 $blob	top" >>list &&
+		git update-index --index-info <list &&
+		git ls-files -s >all &&
+		mkdir -p b/dir2 &&
+
+		for version in 2 4
+		do
+			git -c index.partialRead=true \
+				update-index --force-write-index --index-version $version &&
+			for prefix in a/ c/dir3/ e/dir6/ d/dir0/file7
+			do
+				case "$prefix" in
+				*/)
+					grep "	$prefix" all ;;
+				*)
+					grep "	$prefix\$" all ;;
+				esac >expect &&
+				rm -f trace &&
+				GIT_TRACE_PERFORMANCE="$(pwd)/trace" \
+					git ls-files -s "$prefix" >actual &&
+				test_cmp expect actual &&
+				grep "read partial cache" trace &&
+				! grep "read cache" trace || return 1
+			done &&
+			(
+				cd b/dir2 &&
+				git ls-files >../../actual
+			) &&
+			grep "	b/dir2/" all | sed -e "s|.*	b/dir2/||" >expect &&
+			test_cmp expect actual || return 1
+		done &&
+		git ls-files -s >actual &&
+		test_cmp all actual &&
+		git update-index --force-write-index --index-version 2 &&
+		rm -f trace &&
+		GIT_TRACE_PERFORMANCE="$(pwd)/trace" git ls-files -s a/ >actual &&
+		grep "	a/" all >expect &&
+		test_cmp expect actual &&
+		grep "read cache" trace
+	)
+'
+
+test_expect_success 'ls-files --eol reads the whole index' '
+	(
+		cd partial &&
+		git ls-files --eol c/dir3/ >expect &&
+		git -c index.partialRead=true update-index --force-write-index &&
+		rm -f trace &&
+		GIT_TRACE_PERFORMANCE="$(pwd)/trace" \
+			git ls-files --eol c/dir3/ >actual &&
+		test_cmp expect actual &&
+		grep "read cache" trace &&
+		! grep "read partial cache" trace
+	)
+'
+
+test_expect_success 'ls-files scans the index in place' '
+	(
+		cd partial &&
+		git update-index --skip-worktree c/dir3/file3 &&
+		for version in 2 3 4
+		do
+			for partial in false true
+			do
+				git -c index.partialRead=$partial update-index \
+					--force-write-index --index-version $version &&
+				for args in "" "-s" "-t" "-s --debug" "c/dir3/" \
+					    "-s e/dir6/" "d/dir0/file7" "-s e/*file69"
+				do
+					git ls-files $args >expect &&
+					rm -f trace &&
+					GIT_TRACE_PERFORMANCE="$(pwd)/trace" \
+						git -c index.scanInPlace=true \
+						ls-files $args >actual &&
+					test_cmp expect actual &&
+					grep "scan cache" trace &&
+					! grep "read.* cache" trace || return 1
+				done
+			done || return 1
+		done &&
+		git update-index --no-skip-worktree c/dir3/file3 &&
+		git -c index.scanInPlace=true ls-files -s >actual &&
+		test_cmp all actual &&
+		git update-index --split-index &&
+		rm -f trace &&
+		GIT_TRACE_PERFORMANCE="$(pwd)/trace" \
+			git -c index.scanInPlace=true ls-files -s >actual &&
+		test_cmp all actual &&
+		grep "read cache" trace
+	)
+'
 
 test_done
@@ -4,15 +4,13 @@ test_description='Test the lazy init name hash with various folder structures'
 
 . ./test-lib.sh
 
-if test 1 -eq $($GIT_BUILD_DIR/t/helper/test-tool online-cpus)
-then
-	skip_all='skipping lazy-init tests, single cpu'
-	test_done
-fi
+test_lazy_prereq MULTIPLE_CPUS '
+	test 1 -lt $(test-tool online-cpus)
+'
 
 LAZY_THREAD_COST=2000
 
-test_expect_success 'no buffer overflow in lazy_init_name_hash' '
+test_expect_success 'setup' '
 	(
 	    test_seq $LAZY_THREAD_COST | sed "s/^/a_/" &&
 	    echo b/b/b &&
@@ -20,8 +18,40 @@ test_expect_success 'no buffer overflow in lazy_init_name_hash' '
 	    test_seq 50 | sed "s/^/d_/" | tr "\n" "/" && echo d
 	) |
 	sed "s/^/100644 $EMPTY_BLOB	/" |
-	git update-index --index-info &&
+	git update-index --index-info
+'
+
+test_expect_success MULTIPLE_CPUS 'no buffer overflow in lazy_init_name_hash' '
 	test-tool lazy-init-name-hash -m
 '
 
+dump_name_hash () {
+	test-tool lazy-init-name-hash -d -s | sort
+}
+
+test_expect_success 'name hash recorded in the index matches a computed one' '
+	git config core.ignorecase true &&
+	dump_name_hash >expect &&
+	git config index.recordNameHash true &&
+	git update-index --force-write-index &&
+	rm -f trace &&
+	GIT_TRACE_PERFORMANCE="$(pwd)/trace" dump_name_hash >actual &&
+	grep "load name hash from index" trace &&
+	test_cmp expect actual
+'
+
+test_expect_success 'recorded name hash follows changes to the index' '
+	echo "100644 $EMPTY_BLOB	b/c/new" |
+	git update-index --index-info &&
+	git rm -q --cached a_1 b/b/b &&
+	rm -f trace &&
+	GIT_TRACE_PERFORMANCE="$(pwd)/trace" dump_name_hash >actual &&
+	grep "load name hash from index" trace &&
+	git -c index.recordNameHash=false update-index --force-write-index &&
+	rm -f trace &&
+	GIT_TRACE_PERFORMANCE="$(pwd)/trace" dump_name_hash >expect &&
+	! grep "load name hash from index" trace &&
+	test_cmp expect actual
+'
+
 test_done
@@ -122,6 +122,13 @@ test_expect_success 'changed commit' '
 	test_cmp expected actual
 '
 
+test_expect_success 'changed commit with rangeDiff.threads' '
+	git -c rangeDiff.threads=2 range-diff --no-color topic...changed \
+		>actual &&
+	# same "expected" as above
+	test_cmp expected actual
+'
+
 test_expect_success 'changed commit with --no-patch diff option' '
 	git range-diff --no-color --no-patch topic...changed >actual &&
 	cat >expected <<-EOF &&
@@ -50,4 +50,34 @@ test_expect_success verify '
 	test_cmp expect actual
 '
 
+test_expect_success 'verify without the tree cache' '
+	git -c core.treeCacheLimit=0 diff-tree -r -t --name-status HEAD^ HEAD >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'unchanged entries around the changes are skipped' '
+	mkdir many &&
+	for i in $(test_seq 100)
+	do
+		echo $i >many/$i || return 1
+	done &&
+	git add many &&
+	test_tick &&
+	git commit -m many &&
+	echo changed >many/1 &&
+	echo changed >many/50 &&
+	echo changed >many/99 &&
+	git commit -a -m "change some" &&
+	cat >expect <<-\EOF &&
+	M	many/1
+	M	many/50
+	M	many/99
+	EOF
+	git diff-tree -r --name-status HEAD^ HEAD >actual &&
+	test_cmp expect actual &&
+	git -c core.treeCacheLimit=0 log -2 --raw -r --format=%s >expect &&
+	git log -2 --raw -r --format=%s >actual &&
+	test_cmp expect actual
+'
+
 test_done
@@ -0,0 +1,45 @@
+#!/bin/sh
+
+test_description='diff.maxCost limits the work spent on a diff'
+
+. ./test-lib.sh
+
+test_expect_success 'setup' '
+	test_seq 1000 >file &&
+	git add file &&
+	git commit -m initial &&
+	test_seq 1000 | sed -e "s/^.*[37]$/changed &/" | sort >file
+'
+
+test_expect_success 'a large maxCost does not change the diff' '
+	git diff >expect &&
+	git -c diff.maxCost=100000000 diff >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'a small maxCost gives a larger diff that still applies' '
+	git diff >full &&
+	git -c diff.maxCost=50 diff >capped &&
+	test $(wc -l <full) -lt $(wc -l <capped) &&
+	cp file wanted &&
+	git checkout file &&
+	git apply capped &&
+	test_cmp wanted file
+'
+
+test_expect_success 'GIT_TRACE_DIFF_COST reports when the limit was hit' '
+	rm -f trace &&
+	GIT_TRACE_DIFF_COST="$(pwd)/trace" git diff >/dev/null &&
+	grep "steps" trace &&
+	! grep "gave up refining" trace &&
+	rm -f trace &&
+	GIT_TRACE_DIFF_COST="$(pwd)/trace" git -c diff.maxCost=50 diff >/dev/null &&
+	grep "gave up refining" trace
+'
+
+test_expect_success 'the limit also applies to --minimal' '
+	git -c diff.maxCost=50 diff --minimal >capped-minimal &&
+	test $(wc -l <full) -lt $(wc -l <capped-minimal)
+'
+
+test_done
@@ -1707,4 +1707,39 @@ test_expect_success '--exclude-promisor-objects does not BUG-crash' '
 	test_must_fail git log --exclude-promisor-objects source-a
 '
 
+test_expect_success 'log -p with log.threads' '
+	test_when_finished "git checkout master" &&
+	git checkout -b threads &&
+	test_seq 1000 >many &&
+	git add many &&
+	git commit -m many &&
+	for i in 10 500 990
+	do
+		sed -e "s/^$i\$/changed $i/" many >many.new &&
+		mv many.new many &&
+		git commit -a -m "change $i" || return 1
+	done &&
+	for opts in "" "-R" "-U0" "-w --stat" "--word-diff" "-m --first-parent" "-n 2"
+	do
+		git log -p $opts >expect &&
+		git -c log.threads=3 log -p $opts >actual &&
+		test_cmp expect actual || return 1
+	done
+'
+
+test_expect_success 'log -p --full-diff --parents with log.threads' '
+	test_when_finished "git checkout master" &&
+	git checkout -b threads-full-diff &&
+	for i in 1 2 3 4 5 6 7 8
+	do
+		echo $i >>threads-a &&
+		echo $i >>threads-b &&
+		git add threads-a threads-b &&
+		git commit -m "threads $i" || return 1
+	done &&
+	git log -p --full-diff --parents -- threads-a >expect &&
+	git -c log.threads=2 log -p --full-diff --parents -- threads-a >actual &&
+	test_cmp expect actual
+'
+
 test_done
@@ -105,6 +105,30 @@ test_expect_success '-L with --output' '
 	test_line_count = 70 log
 '
 
+list_line_log_commits () {
+	git log --format="commit %H" "$@" |
+	sed -n -e "s/^.*\(commit [0-9a-f]*\)\$/\1/p"
+}
+
+for opts in "" "--no-merges" "--first-parent" "--author=nobody"
+do
+	test_expect_success "-L $opts shows the same commits without --graph" "
+		git checkout parallel-change &&
+		list_line_log_commits --graph $opts -L :main:b.c >expect &&
+		list_line_log_commits $opts -L :main:b.c >actual &&
+		test_cmp expect actual
+	"
+done
+
+test_expect_success '-L with -1 shows the first commit' '
+	git checkout parallel-change &&
+	list_line_log_commits -L :main:b.c >all &&
+	test_line_count -gt 1 all &&
+	head -n 1 all >expect &&
+	list_line_log_commits -1 -L :main:b.c >actual &&
+	test_cmp expect actual
+'
+
 test_expect_success 'range_set_union' '
 	test_seq 500 > c.c &&
 	git add c.c &&
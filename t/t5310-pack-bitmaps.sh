@@ -48,6 +48,17 @@ test_expect_success 'rev-list --test-bitmap verifies bitmaps' '
 	git rev-list --test-bitmap HEAD
 '
 
+# run a ref-filter command once with and once without the bitmap
+# and compare the results
+ref_filter_bitmap_cmp () {
+	git "$@" >actual &&
+	mkdir -p bitmap-aside &&
+	mv .git/objects/pack/*.bitmap bitmap-aside/ &&
+	git "$@" >expect &&
+	mv bitmap-aside/*.bitmap .git/objects/pack/ &&
+	test_cmp expect actual
+}
+
 rev_list_tests() {
 	state=$1
 
@@ -95,6 +106,22 @@ rev_list_tests() {
 		git rev-list --objects --use-bitmap-index HEAD tagged-blob >actual &&
 		grep $blob actual
 	'
+
+	test_expect_success "ref filters --contains via bitmap ($state)" '
+		ref_filter_bitmap_cmp tag --contains 3 &&
+		ref_filter_bitmap_cmp tag --contains side-2 --contains 8 &&
+		ref_filter_bitmap_cmp tag --no-contains 7 &&
+		ref_filter_bitmap_cmp branch --contains HEAD~7 &&
+		ref_filter_bitmap_cmp for-each-ref --contains HEAD
+	'
+
+	test_expect_success "ref filters --merged via bitmap ($state)" '
+		ref_filter_bitmap_cmp tag --merged HEAD &&
+		ref_filter_bitmap_cmp tag --merged other &&
+		ref_filter_bitmap_cmp tag --no-merged HEAD~3 &&
+		ref_filter_bitmap_cmp branch --merged 5 &&
+		ref_filter_bitmap_cmp for-each-ref --merged HEAD~2
+	'
 }
 
 rev_list_tests 'full bitmap'
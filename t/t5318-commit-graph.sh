@@ -58,16 +58,16 @@ graph_git_behavior 'no graph' full commits/3 commits/1
 
 graph_read_expect() {
 	OPTIONAL=""
-	NUM_CHUNKS=3
+	NUM_CHUNKS=4
 	if test ! -z $2
 	then
 		OPTIONAL=" $2"
-		NUM_CHUNKS=$((3 + $(echo "$2" | wc -w)))
+		NUM_CHUNKS=$((4 + $(echo "$2" | wc -w)))
 	fi
 	cat >expect <<- EOF
 	header: 43475048 1 1 $NUM_CHUNKS 0
 	num_commits: $1
-	chunks: oid_fanout oid_lookup commit_metadata$OPTIONAL
+	chunks: oid_fanout oid_lookup commit_metadata generation_data$OPTIONAL
 	EOF
 	git commit-graph read >output &&
 	test_cmp expect output
@@ -340,7 +340,7 @@ GRAPH_BYTE_HASH=5
 GRAPH_BYTE_CHUNK_COUNT=6
 GRAPH_CHUNK_LOOKUP_OFFSET=8
 GRAPH_CHUNK_LOOKUP_WIDTH=12
-GRAPH_CHUNK_LOOKUP_ROWS=5
+GRAPH_CHUNK_LOOKUP_ROWS=6
 GRAPH_BYTE_OID_FANOUT_ID=$GRAPH_CHUNK_LOOKUP_OFFSET
 GRAPH_BYTE_OID_LOOKUP_ID=$(($GRAPH_CHUNK_LOOKUP_OFFSET + \
 			    1 * $GRAPH_CHUNK_LOOKUP_WIDTH))
@@ -361,8 +361,10 @@ GRAPH_BYTE_COMMIT_WRONG_PARENT=$(($GRAPH_COMMIT_DATA_OFFSET + $HASH_LEN + 3))
 GRAPH_BYTE_COMMIT_GENERATION=$(($GRAPH_COMMIT_DATA_OFFSET + $HASH_LEN + 11))
 GRAPH_BYTE_COMMIT_DATE=$(($GRAPH_COMMIT_DATA_OFFSET + $HASH_LEN + 12))
 GRAPH_COMMIT_DATA_WIDTH=$(($HASH_LEN + 16))
-GRAPH_OCTOPUS_DATA_OFFSET=$(($GRAPH_COMMIT_DATA_OFFSET + \
-			     $GRAPH_COMMIT_DATA_WIDTH * $NUM_COMMITS))
+GRAPH_GENERATION_DATA_OFFSET=$(($GRAPH_COMMIT_DATA_OFFSET + \
+				$GRAPH_COMMIT_DATA_WIDTH * $NUM_COMMITS))
+GRAPH_BYTE_GENERATION_DATA=$(($GRAPH_GENERATION_DATA_OFFSET + 3))
+GRAPH_OCTOPUS_DATA_OFFSET=$(($GRAPH_GENERATION_DATA_OFFSET + 4 * $NUM_COMMITS))
 GRAPH_BYTE_OCTOPUS=$(($GRAPH_OCTOPUS_DATA_OFFSET + 4))
 GRAPH_BYTE_FOOTER=$(($GRAPH_OCTOPUS_DATA_OFFSET + 4 * $NUM_OCTOPUS_EDGES))
 
@@ -469,6 +471,11 @@ test_expect_success 'detect incorrect generation number' '
 		"non-zero generation number"
 '
 
+test_expect_success 'detect incorrect corrected commit date' '
+	corrupt_graph_and_verify $GRAPH_BYTE_GENERATION_DATA "\01" \
+		"corrected commit date for commit"
+'
+
 test_expect_success 'detect incorrect commit date' '
 	corrupt_graph_and_verify $GRAPH_BYTE_COMMIT_DATE "\01" \
 		"commit date"
@@ -492,6 +499,50 @@ test_expect_success 'git fsck (checks commit-graph)' '
 	test_must_fail git fsck
 '
 
+test_expect_success 'write graph without generation data' '
+	cd "$TRASH_DIRECTORY/full" &&
+	test_when_finished "git commit-graph write --reachable" &&
+	GIT_TEST_COMMIT_GRAPH_NO_GDAT=1 git commit-graph write --reachable &&
+	git commit-graph read >output &&
+	! grep generation_data output &&
+	git commit-graph verify &&
+	git -c commitGraph.generationVersion=1 commit-graph write --reachable &&
+	git commit-graph read >output &&
+	! grep generation_data output
+'
+
+graph_git_behavior 'graph with generation data' full commits/8 merge/1
+
+test_expect_success 'generation data is ignored with generationVersion=1' '
+	cd "$TRASH_DIRECTORY/full" &&
+	git commit-graph write --reachable &&
+	git -c commitGraph.generationVersion=1 commit-graph verify &&
+	git -c core.commitGraph=false log --topo-order commits/8 >expect &&
+	git -c commitGraph.generationVersion=1 log --topo-order commits/8 >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success TIME_IS_64BIT,TIME_T_IS_64BIT 'corrected commit date offset overflow' '
+	cd "$TRASH_DIRECTORY" &&
+	git init overflow &&
+	(
+		cd overflow &&
+		GIT_COMMITTER_DATE="@4294967296 +0000" &&
+		export GIT_COMMITTER_DATE &&
+		test_commit --notick future &&
+		GIT_COMMITTER_DATE="@1000000000 +0000" &&
+		test_commit --notick past &&
+		git commit-graph write --reachable &&
+		git commit-graph read >output &&
+		grep "generation_data generation_data_overflow" output &&
+		git commit-graph verify &&
+		git -c core.commitGraph=false log --topo-order >expect &&
+		git -c core.commitGraph=true log --topo-order >actual &&
+		test_cmp expect actual &&
+		git -c core.commitGraph=true merge-base --is-ancestor future past
+	)
+'
+
 test_expect_success 'setup non-the_repository tests' '
 	rm -rf repo &&
 	git init repo &&
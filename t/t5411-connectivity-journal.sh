@@ -0,0 +1,100 @@
+#!/bin/sh
+
+test_description='connectivity journal for receive-pack and fetch'
+
+. ./test-lib.sh
+
+journal=dst.git/objects/info/connected-packs
+
+list_packs () {
+	(
+		cd "$1/objects/pack" &&
+		ls pack-*.pack | sed -e "s/^pack-//" -e "s/\.pack$//" | sort
+	)
+}
+
+test_expect_success 'setup' '
+	git init --bare dst.git &&
+	git -C dst.git config core.connectivityJournal true &&
+	git -C dst.git config receive.unpackLimit 1 &&
+	test_commit one &&
+	test_commit two
+'
+
+test_expect_success 'push into empty repository records the pack' '
+	git push dst.git master &&
+	list_packs dst.git >expect &&
+	sort $journal >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'push on top of journaled pack skips the walk' '
+	test_commit three &&
+	rm -f trace &&
+	GIT_TRACE="$(pwd)/trace" git push dst.git master &&
+	! grep "git rev-list" trace &&
+	list_packs dst.git >expect &&
+	sort $journal >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'push on top of unknown objects walks and is not recorded' '
+	rm -f $journal &&
+	test_commit four &&
+	rm -f trace &&
+	GIT_TRACE="$(pwd)/trace" git push dst.git master &&
+	grep "git rev-list" trace &&
+	test_path_is_missing $journal
+'
+
+test_expect_success 'fsck rebuilds the journal' '
+	git -C dst.git fsck &&
+	list_packs dst.git >expect &&
+	sort $journal >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'journal is ignored unless enabled' '
+	test_when_finished "git -C dst.git config core.connectivityJournal true" &&
+	git -C dst.git config core.connectivityJournal false &&
+	test_commit five &&
+	rm -f trace &&
+	GIT_TRACE="$(pwd)/trace" git push dst.git master &&
+	grep "git rev-list" trace
+'
+
+test_expect_success 'prune clears the journal when it removes objects' '
+	git -C dst.git fsck &&
+	test_path_is_file $journal &&
+	git -C dst.git prune &&
+	test_path_is_file $journal &&
+	blob=$(echo unreachable | git -C dst.git hash-object -w --stdin) &&
+	git -C dst.git prune --expire=now &&
+	test_path_is_missing $journal &&
+	test_must_fail git -C dst.git cat-file -e $blob
+'
+
+test_expect_success 'gc clears the journal when it removes packs' '
+	git -C dst.git fsck &&
+	test_path_is_file $journal &&
+	git -C dst.git gc &&
+	test_path_is_missing $journal
+'
+
+test_expect_success 'fetch records the pack it receives' '
+	git -C dst.git fsck &&
+	git clone --no-local dst.git clone &&
+	git -C clone config core.connectivityJournal true &&
+	git -C clone config fetch.unpackLimit 1 &&
+	git -C clone fsck &&
+	test_commit six &&
+	git push dst.git master &&
+	rm -f trace &&
+	GIT_TRACE="$(pwd)/trace" git -C clone fetch &&
+	! grep "git rev-list" trace &&
+	list_packs clone/.git >expect &&
+	sort clone/.git/objects/info/connected-packs >actual &&
+	test_cmp expect actual
+'
+
+test_done
@@ -245,6 +245,94 @@ test_expect_success '--count --left-right' '
 	test_cmp expect actual
 '
 
+test_expect_success '--cherry-mark with patchId.cache' '
+	git rev-list --left-right --cherry-mark B...C >expect &&
+	git rev-list --left-right --cherry-mark F...E -- bar >>expect &&
+	test_when_finished "rm -f .git/patch-id-cache" &&
+	for i in 1 2
+	do
+		git -c patchId.cache=true rev-list --left-right --cherry-mark \
+			B...C >actual &&
+		git -c patchId.cache=true rev-list --left-right --cherry-mark \
+			F...E -- bar >>actual &&
+		test_cmp expect actual &&
+		test_path_is_file .git/patch-id-cache || return 1
+	done
+'
+
+test_expect_success 'corrupt patch-id-cache is ignored' '
+	git cherry B C >expect &&
+	test_when_finished "rm -f .git/patch-id-cache" &&
+	echo garbage >.git/patch-id-cache &&
+	git -c patchId.cache=true cherry B C >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'patchId.cache follows attributes and diff options' '
+	git init attr-cache &&
+	(
+		cd attr-cache &&
+		test_seq 20 >file &&
+		git add file &&
+		git commit -m base &&
+		git checkout -b upstream &&
+		test_seq 19 >file &&
+		git commit -a -m "drop 20" &&
+		sed -e "s/^1\$/one/" file >file.new &&
+		mv file.new file &&
+		git commit -a -m "one, upstream" &&
+		git checkout -b topic master &&
+		sed -e "s/^1\$/one/" file >file.new &&
+		mv file.new file &&
+		git commit -a -m "one, topic" &&
+
+		git -c patchId.cache=true cherry upstream >actual &&
+		echo "- $(git rev-parse HEAD)" >expect &&
+		test_cmp expect actual &&
+
+		echo "file -diff" >.git/info/attributes &&
+		git -c patchId.cache=true cherry upstream >actual &&
+		echo "+ $(git rev-parse HEAD)" >expect &&
+		test_cmp expect actual &&
+		rm .git/info/attributes &&
+
+		cp .git/patch-id-cache cache.orig &&
+		git -c patchId.cache=true -c diff.maxCost=1 log --cherry-mark \
+			upstream...topic &&
+		! test_cmp_bin cache.orig .git/patch-id-cache
+	)
+'
+
+test_expect_success 'patchId.cache is not used with replace refs' '
+	test_when_finished "git -C attr-cache replace -d upstream" &&
+	(
+		cd attr-cache &&
+		git -c patchId.cache=true cherry upstream >cached &&
+		echo "- $(git rev-parse HEAD)" >expect &&
+		test_cmp expect cached &&
+		git replace --graft upstream master &&
+		git cherry upstream >expect &&
+		! test_cmp cached expect &&
+		git -c patchId.cache=true cherry upstream >actual &&
+		test_cmp expect actual &&
+		git -c patchId.cache=true log --cherry-pick --left-right \
+			--format=%s upstream...topic >actual &&
+		git log --cherry-pick --left-right \
+			--format=%s upstream...topic >expect &&
+		test_cmp expect actual
+	)
+'
+
+test_expect_success '--cherry-mark with patchId.threads' '
+	git rev-list --left-right --cherry-mark B...C >expect &&
+	git rev-list --left-right --cherry-mark F...E >>expect &&
+	git -c patchId.threads=2 rev-list --left-right --cherry-mark \
+		B...C >actual &&
+	git -c patchId.threads=2 rev-list --left-right --cherry-mark \
+		F...E >>actual &&
+	test_cmp expect actual
+'
+
 # Corrupt the object store deliberately to make sure
 # the object is not even checked for its existence.
 remove_loose_object () {
@@ -263,7 +351,8 @@ test_expect_success '--cherry-pick avoids looking at full diffs' '
 	git checkout -b mainline HEAD^ &&
 	test_commit to-cherry-pick &&
 	remove_loose_object shy-diff^:dont-look-at-me.t &&
-	git rev-list --cherry-pick ...shy-diff
+	git rev-list --cherry-pick ...shy-diff &&
+	git -c patchId.threads=2 rev-list --cherry-pick ...shy-diff
 '
 
 test_done
@@ -113,6 +113,31 @@ check_describe A-3-* --long HEAD^^2
 check_describe c-7-* --tags
 check_describe e-3-* --first-parent --tags
 
+test_expect_success 'describe.cache gives the same results' '
+	test_when_finished "rm -f .git/describe-cache" &&
+	git describe HEAD HEAD^ HEAD^^ HEAD^^2 >expect &&
+	git -c describe.cache=true describe HEAD HEAD^ HEAD^^ HEAD^^2 >actual &&
+	test_cmp expect actual &&
+	test_path_is_file .git/describe-cache &&
+	git -c describe.cache=true describe --debug HEAD HEAD^ HEAD^^ HEAD^^2 \
+		>actual 2>err &&
+	test_cmp expect actual &&
+	test_i18ngrep "using cached description" err &&
+	test_i18ngrep ! "traversed" err
+'
+
+test_expect_success 'describe.cache is invalidated by new tags and options' '
+	test_when_finished "rm -f .git/describe-cache && git tag -d cache-tag" &&
+	git -c describe.cache=true describe HEAD^ >/dev/null &&
+	git -c describe.cache=true describe --tags --debug HEAD^ >actual 2>err &&
+	test_i18ngrep ! "using cached description" err &&
+	git tag -a -m cache-tag cache-tag HEAD^^ &&
+	git describe HEAD^ >expect &&
+	git -c describe.cache=true describe --debug HEAD^ >actual 2>err &&
+	test_cmp expect actual &&
+	test_i18ngrep ! "using cached description" err
+'
+
 test_expect_success 'describe --contains defaults to HEAD without commit-ish' '
 	echo "A^0" >expect &&
 	git checkout A &&
@@ -343,7 +368,7 @@ test_expect_success 'describe tag object' '
 	test_i18ngrep "fatal: test-blob-1 is neither a commit nor blob" actual
 '
 
-test_expect_failure ULIMIT_STACK_SIZE 'name-rev works in a deep repo' '
+test_expect_success ULIMIT_STACK_SIZE 'name-rev works in a deep repo' '
 	i=1 &&
 	while test $i -lt 8000
 	do
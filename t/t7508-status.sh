@@ -1679,4 +1679,25 @@ test_expect_success '--no-optional-locks prevents index update' '
 	! grep ^1234567890 out
 '
 
+test_expect_success 'status with many preload threads' '
+	git init preload &&
+	(
+		cd preload &&
+		for i in $(test_seq 300)
+		do
+			echo $i >file$i || return 1
+		done &&
+		git add . &&
+		git commit -q -m files &&
+		echo changed >file7 &&
+		echo changed >file150 &&
+		rm file299 &&
+		git -c core.preloadIndex=false status --porcelain >../expect &&
+		git -c core.preloadIndexThreads=7 status --porcelain >../actual &&
+		test_cmp ../expect ../actual &&
+		git -c core.preloadIndexThreads=1000 status --porcelain >../actual &&
+		test_cmp ../expect ../actual
+	)
+'
+
 test_done
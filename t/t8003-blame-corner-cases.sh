@@ -275,4 +275,30 @@ test_expect_success 'blame file with CRLF core.autocrlf=true' '
 	grep "A U Thor" actual
 '
 
+test_expect_success 'setup history for diff.lineHashCache' '
+	test_seq 100 >cached &&
+	git add cached &&
+	git commit -m "cached: initial" &&
+	for i in 10 30 50 70 90
+	do
+		sed -e "s/^$i\$/changed $i/" -e "s/^$((i + 5))\$/  $((i + 5))/" \
+			<cached >cached.new &&
+		mv cached.new cached &&
+		git commit -a -m "cached: change $i" || return 1
+	done &&
+	test_seq 40 60 >>cached &&
+	git commit -a -m "cached: copy lines"
+'
+
+for opts in "" "-w" "-M -C"
+do
+	test_expect_success "blame $opts is the same with diff.lineHashCache" "
+		git blame $opts cached >expect &&
+		git -c diff.lineHashCache=1 blame $opts cached >actual &&
+		test_cmp expect actual &&
+		git -c diff.lineHashCache=100 blame $opts cached >actual &&
+		test_cmp expect actual
+	"
+done
+
 test_done
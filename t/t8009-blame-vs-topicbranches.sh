@@ -33,4 +33,32 @@ test_expect_success 'blame --reverse --first-parent finds A1' '
 	test_cmp expect actual
 	'
 
+test_expect_success 'setup many topics' '
+	git checkout -b many A3 &&
+	test_seq 60 >many.t &&
+	git add many.t &&
+	git commit -m "many: initial" &&
+	for i in 1 2 3 4 5
+	do
+		git checkout -b topic$i many &&
+		sed -e "s/^${i}0\$/topic $i/" <many.t >many.new &&
+		mv many.new many.t &&
+		git commit -a -m "topic $i" &&
+		git checkout many &&
+		sed -e "s/^${i}5\$/many $i/" <many.t >many.new &&
+		mv many.new many.t &&
+		git commit -a -m "many $i" &&
+		git merge --no-edit topic$i || return 1
+	done
+'
+
+test_expect_success 'blame with blame.threads gives the same result' '
+	git blame --porcelain many.t >expect &&
+	git -c blame.threads=4 blame --porcelain many.t >actual &&
+	test_cmp expect actual &&
+	git blame -M -C --porcelain many.t >expect &&
+	git -c blame.threads=4 blame -M -C --porcelain many.t >actual &&
+	test_cmp expect actual
+'
+
 test_done
@@ -0,0 +1,113 @@
+#!/bin/sh
+
+test_description='git blame with blame.cache'
+. ./test-lib.sh
+
+test_expect_success 'setup' '
+	test_seq 20 >file &&
+	git add file &&
+	test_tick &&
+	git commit -m initial &&
+	for i in 3 8 13 18
+	do
+		sed -e "s/^$i\$/changed $i/" <file >file.new &&
+		mv file.new file &&
+		test_tick &&
+		git commit -a -m "change $i" || return 1
+	done &&
+	git mv file renamed &&
+	echo appended >>renamed &&
+	test_tick &&
+	git commit -a -m "rename and append" &&
+	git tag middle HEAD~2
+'
+
+test_expect_success 'blame writes the cache' '
+	git blame --porcelain middle -- file >expect &&
+	git -c blame.cache=true blame --porcelain middle -- file >actual &&
+	test_cmp expect actual &&
+	ls .git/blame-cache >cached &&
+	test_line_count = 1 cached
+'
+
+test_expect_success 'blame of a cached commit does not dig' '
+	git -c blame.cache=true blame --show-stats middle -- file >actual &&
+	grep "num get patch: 0" actual &&
+	git blame middle -- file >expect &&
+	test_line_count = $(($(wc -l <expect) + 3)) actual
+'
+
+test_expect_success 'blame of a descendant stops at the cached commit' '
+	git -c blame.cache=true blame --show-stats HEAD -- renamed >actual &&
+	grep "num get patch: 2" actual &&
+	git blame --porcelain HEAD -- renamed >expect &&
+	git -c blame.cache=true blame --porcelain HEAD -- renamed >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'blame of the working tree uses the cache' '
+	echo more >>renamed &&
+	git blame -s renamed >expect &&
+	git -c blame.cache=true blame -s renamed >actual &&
+	test_cmp expect actual &&
+	git checkout renamed
+'
+
+test_expect_success 'blame of a range does not use the cache' '
+	git blame HEAD~3..HEAD -- renamed >expect &&
+	git -c blame.cache=true blame HEAD~3..HEAD -- renamed >actual &&
+	test_cmp expect actual &&
+	git -c blame.cache=true blame --show-stats HEAD~3..HEAD -- renamed >actual &&
+	grep "num get patch: 3" actual
+'
+
+test_expect_success 'blame -w uses its own cache entries' '
+	git blame -w HEAD -- renamed >expect &&
+	git -c blame.cache=true blame -w --show-stats HEAD -- renamed >actual &&
+	! grep "num get patch: 0" actual &&
+	git -c blame.cache=true blame -w HEAD -- renamed >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'blame.cache is not used with replace refs' '
+	git -c blame.cache=true blame --porcelain middle -- file >cached &&
+	base=$(git rev-parse middle~2) &&
+	git replace --graft $base &&
+	test_when_finished "git replace -d $base" &&
+	git blame --porcelain middle -- file >expect &&
+	! test_cmp cached expect &&
+	git -c blame.cache=true blame --porcelain middle -- file >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'blame.cache follows the textconv driver' '
+	test_when_finished "rm -f .gitattributes" &&
+	echo "file diff=conv" >.gitattributes &&
+	git -c diff.conv.textconv=cat -c blame.cache=true \
+		blame -s middle -- file >cat &&
+	git -c diff.conv.textconv="sed -e s/changed.//" \
+		blame -s middle -- file >expect &&
+	! test_cmp cat expect &&
+	git -c diff.conv.textconv="sed -e s/changed.//" -c blame.cache=true \
+		blame -s middle -- file >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'corrupt cache entries are ignored' '
+	for f in .git/blame-cache/*
+	do
+		echo garbage >"$f" || return 1
+	done &&
+	git blame --porcelain HEAD -- renamed >expect &&
+	git -c blame.cache=true blame --porcelain HEAD -- renamed >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'gc prunes the blame cache' '
+	git gc &&
+	test_path_is_dir .git/blame-cache &&
+	git -c gc.blameCacheExpire=now gc &&
+	test_path_is_missing .git/blame-cache
+'
+
+test_done
@@ -5,6 +5,8 @@
 #include "diff.h"
 #include "diffcore.h"
 #include "tree.h"
+#include "hashmap.h"
+#include "list.h"
 
 /*
  * internal mode marker, saying a tree entry != entry of tp[imin]
@@ -25,6 +27,207 @@
 		free((x)); \
 } while(0)
 
+/*
+ * Recently diffed trees, so that the trees many diffs have in common,
+ * like the top-level tree and the directories leading to the changes
+ * in "git log --raw", are read and inflated only once, and the offsets
+ * of their entries found only once.  Trees used by a diff in progress
+ * are pinned; the least recently used other ones are dropped to stay
+ * within core.treeCacheLimit.
+ */
+struct tree_cache_entry {
+	struct hashmap_entry ent;
+	struct list_head lru;
+	struct object_id oid;
+	void *buf;
+	unsigned long size;
+	/* where the first nr entries start in buf, see tree_entry_offsets() */
+	unsigned long *offset;
+	int nr, alloc;
+	unsigned long parsed;
+	int broken;
+	int pinned;
+	int cached;
+};
+
+static struct hashmap tree_cache;
+static LIST_HEAD(tree_cache_lru);
+static size_t tree_cache_size;
+
+static int tree_cache_cmp(const void *unused_cmp_data,
+			  const void *entry, const void *entry_or_key,
+			  const void *keydata)
+{
+	const struct tree_cache_entry *a = entry;
+	const struct tree_cache_entry *b = entry_or_key;
+	const struct object_id *oid = keydata;
+
+	return !oideq(&a->oid, oid ? oid : &b->oid);
+}
+
+static void shrink_tree_cache(void)
+{
+	struct list_head *pos, *tmp;
+
+	list_for_each_safe(pos, tmp, &tree_cache_lru) {
+		struct tree_cache_entry *e =
+			list_entry(pos, struct tree_cache_entry, lru);
+
+		if (tree_cache_size <= tree_cache_limit)
+			break;
+		if (e->pinned)
+			continue;
+		hashmap_remove(&tree_cache, e, NULL);
+		list_del(&e->lru);
+		tree_cache_size -= e->size;
+		tree_cache_size -= st_mult(e->nr, sizeof(*e->offset));
+		free(e->offset);
+		free(e->buf);
+		free(e);
+	}
+}
+
+/*
+ * Like fill_tree_descriptor(), but the tree comes from (and goes to)
+ * the cache, and must be released with put_cached_tree() instead of
+ * being freed.
+ */
+static struct tree_cache_entry *get_cached_tree(struct tree_desc *desc,
+						const struct object_id *oid)
+{
+	struct tree_cache_entry *e;
+
+	if (!oid) {
+		init_tree_desc(desc, NULL, 0);
+		return NULL;
+	}
+
+	if (!tree_cache.cmpfn)
+		hashmap_init(&tree_cache, tree_cache_cmp, NULL, 0);
+	e = hashmap_get_from_hash(&tree_cache, sha1hash(oid->hash), oid);
+	if (e) {
+		list_del(&e->lru);
+		list_add_tail(&e->lru, &tree_cache_lru);
+	} else {
+		e = xcalloc(1, sizeof(*e));
+		oidcpy(&e->oid, oid);
+		e->buf = read_object_with_reference(oid, tree_type, &e->size, NULL);
+		if (!e->buf)
+			die("unable to read tree %s", oid_to_hex(oid));
+		if (e->size <= tree_cache_limit) {
+			e->cached = 1;
+			hashmap_entry_init(e, sha1hash(oid->hash));
+			hashmap_add(&tree_cache, e);
+			list_add_tail(&e->lru, &tree_cache_lru);
+			tree_cache_size += e->size;
+			shrink_tree_cache();
+		}
+	}
+	e->pinned++;
+	init_tree_desc(desc, e->buf, e->size);
+	return e;
+}
+
+static void put_cached_tree(struct tree_cache_entry *e)
+{
+	if (!e)
+		return;
+	e->pinned--;
+	if (!e->cached) {
+		free(e->offset);
+		free(e->buf);
+		free(e);
+	} else if (tree_cache_size > tree_cache_limit)
+		shrink_tree_cache();
+}
+
+/*
+ * Find where the entries of the tree start, up to the last one starting
+ * at or before "upto", and return its offset; the entries are decoded
+ * only once for all the diffs the tree is in.  Returns -1 if the tree
+ * cannot be parsed, which is left to the diff itself to report.
+ */
+static long tree_entry_offsets(struct tree_cache_entry *e, unsigned long upto)
+{
+	int nr = e->nr, lo, hi;
+
+	if (e->broken)
+		return -1;
+
+	while (e->parsed < e->size && e->parsed <= upto) {
+		struct tree_desc desc;
+		unsigned long off = e->parsed;
+
+		if (init_tree_desc_gently(&desc, (const char *)e->buf + off,
+					  e->size - off) ||
+		    update_tree_entry_gently(&desc)) {
+			e->broken = 1;
+			return -1;
+		}
+		ALLOC_GROW(e->offset, e->nr + 1, e->alloc);
+		e->offset[e->nr++] = off;
+		e->parsed = e->size - desc.size;
+	}
+	if (e->cached)
+		tree_cache_size += st_mult(e->nr - nr, sizeof(*e->offset));
+
+	if (upto >= e->size)
+		return e->size;
+
+	lo = 0;
+	hi = e->nr;
+	while (lo < hi) {
+		int mi = lo + (hi - lo) / 2;
+
+		if (e->offset[mi] <= upto)
+			lo = mi + 1;
+		else
+			hi = mi;
+	}
+	return lo ? e->offset[lo - 1] : 0;
+}
+
+/*
+ * Entries are equal exactly when their bytes in the trees are, so
+ * when diffing two trees, the entries within the longest common prefix
+ * of their contents can be skipped without decoding and comparing them
+ * one by one, and so can all the entries left once both trees are down
+ * to the same common suffix.  Position the descriptors past the common
+ * prefix, and return the length of the common suffix.
+ */
+static unsigned long skip_common_entries(struct tree_desc *t,
+					 struct tree_cache_entry *te,
+					 struct tree_desc *tp,
+					 struct tree_cache_entry *tpe)
+{
+	const char *a = te->buf, *b = tpe->buf;
+	unsigned long n = te->size < tpe->size ? te->size : tpe->size;
+	unsigned long prefix = 0, suffix = 0;
+	long off;
+
+	while (prefix + 64 <= n && !memcmp(a + prefix, b + prefix, 64))
+		prefix += 64;
+	while (prefix < n && a[prefix] == b[prefix])
+		prefix++;
+
+	while (suffix + 64 <= n &&
+	       !memcmp(a + te->size - suffix - 64, b + tpe->size - suffix - 64, 64))
+		suffix += 64;
+	while (suffix < n && a[te->size - suffix - 1] == b[tpe->size - suffix - 1])
+		suffix++;
+
+	/*
+	 * The entries before the last one starting within the prefix are
+	 * the same in both trees, at the same offsets.
+	 */
+	off = tree_entry_offsets(te, prefix);
+	if (off > 0) {
+		init_tree_desc(t, a + off, te->size - off);
+		init_tree_desc(tp, b + off, tpe->size - off);
+	}
+	return off < 0 ? 0 : suffix;
+}
+
 static struct combine_diff_path *ll_diff_tree_paths(
 	struct combine_diff_path *p, const struct object_id *oid,
 	const struct object_id **parents_oid, int nparent,
@@ -408,7 +611,8 @@ static struct combine_diff_path *ll_diff_tree_paths(
 	struct strbuf *base, struct diff_options *opt)
 {
 	struct tree_desc t, *tp;
-	void *ttree, **tptree;
+	struct tree_cache_entry *ttree, **tptree;
+	unsigned long common_suffix = 0;
 	int i;
 
 	FAST_ARRAY_ALLOC(tp, nparent);
@@ -421,8 +625,12 @@ static struct combine_diff_path *ll_diff_tree_paths(
 	 *   diff_tree_oid(parent, commit) )
 	 */
 	for (i = 0; i < nparent; ++i)
-		tptree[i] = fill_tree_descriptor(&tp[i], parents_oid[i]);
-	ttree = fill_tree_descriptor(&t, oid);
+		tptree[i] = get_cached_tree(&tp[i], parents_oid[i]);
+	ttree = get_cached_tree(&t, oid);
+
+	if (nparent == 1 && ttree && tptree[0] &&
+	    !opt->flags.find_copies_harder)
+		common_suffix = skip_common_entries(&t, ttree, &tp[0], tptree[0]);
 
 	/* Enable recursion indefinitely */
 	opt->pathspec.recursive = opt->flags.recursive;
@@ -433,6 +641,10 @@ static struct combine_diff_path *ll_diff_tree_paths(
 		if (diff_can_quit_early(opt))
 			break;
 
+		/* what is left is the same in both trees */
+		if (t.size <= common_suffix && t.size == tp[0].size)
+			break;
+
 		if (opt->pathspec.nr) {
 			skip_uninteresting(&t, base, opt);
 			for (i = 0; i < nparent; i++)
@@ -537,9 +749,9 @@ static struct combine_diff_path *ll_diff_tree_paths(
 		}
 	}
 
-	free(ttree);
+	put_cached_tree(ttree);
 	for (i = nparent-1; i >= 0; i--)
-		free(tptree[i]);
+		put_cached_tree(tptree[i]);
 	FAST_ARRAY_FREE(tptree, nparent);
 	FAST_ARRAY_FREE(tp, nparent);
 
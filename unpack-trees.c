@@ -418,6 +418,8 @@ static int check_updates(struct unpack_trees_options *o)
 		load_gitmodules_file(index, &state);
 
 	enable_delayed_checkout(&state);
+	if (o->update && !o->dry_run)
+		enable_async_checkout(&state);
 	if (repository_format_partial_clone && o->update && !o->dry_run) {
 		/*
 		 * Prefetch the objects that are to be checked out in the loop
@@ -455,6 +457,7 @@ static int check_updates(struct unpack_trees_options *o)
 		}
 	}
 	stop_progress(&progress);
+	errs |= finish_async_checkout(&state);
 	errs |= finish_delayed_checkout(&state);
 	if (o->update)
 		git_attr_set_direction(GIT_ATTR_CHECKIN);
@@ -1,8 +1,12 @@
 #include "cache.h"
 #include "config.h"
 #include "object-store.h"
+#include "hashmap.h"
+#include "list.h"
+#include "thread-utils.h"
 #include "xdiff-interface.h"
 #include "xdiff/xtypes.h"
+#include "xdiff/xprepare.h"
 #include "xdiff/xdiffi.h"
 #include "xdiff/xemit.h"
 #include "xdiff/xmacros.h"
@@ -101,10 +105,25 @@ static void trim_common_tail(mmfile_t *a, mmfile_t *b)
 	b->size -= trimmed - recovered;
 }
 
+long git_xdiff_max_cost;
+
+static struct trace_key trace_diff_cost = TRACE_KEY_INIT(DIFF_COST);
+
+static void trace_diff_cost_of(mmfile_t *a, mmfile_t *b, xdcost_t *cost)
+{
+	trace_printf_key(&trace_diff_cost,
+			 "diff of %ld and %ld bytes: %ld steps%s\n",
+			 a->size, b->size, cost->spent,
+			 cost->capped ? " (gave up refining)" : "");
+}
+
 int xdi_diff(mmfile_t *mf1, mmfile_t *mf2, xpparam_t const *xpp, xdemitconf_t const *xecfg, xdemitcb_t *xecb)
 {
 	mmfile_t a = *mf1;
 	mmfile_t b = *mf2;
+	xpparam_t capped = *xpp;
+	xdcost_t cost = { 0, 0 };
+	int ret;
 
 	if (mf1->size > MAX_XDIFF_SIZE || mf2->size > MAX_XDIFF_SIZE)
 		return -1;
@@ -112,7 +131,395 @@ int xdi_diff(mmfile_t *mf1, mmfile_t *mf2, xpparam_t const *xpp, xdemitconf_t co
 	if (!xecfg->ctxlen && !(xecfg->flags & XDL_EMIT_FUNCCONTEXT))
 		trim_common_tail(&a, &b);
 
-	return xdl_diff(&a, &b, xpp, xecfg, xecb);
+	if (!capped.max_cost)
+		capped.max_cost = git_xdiff_max_cost;
+	if (!capped.cost)
+		capped.cost = &cost;
+
+	ret = xdl_diff(&a, &b, &capped, xecfg, xecb);
+
+	if (capped.cost == &cost)
+		trace_diff_cost_of(&a, &b, &cost);
+	return ret;
+}
+
+int git_xdiff_line_cache_size;
+
+/*
+ * The line offsets and hashes of recently diffed blobs, so that a blob
+ * that is diffed over and over again (as blame and "log -L" do with
+ * the same file across a run of commits) is only split and hashed once.
+ * Entries are keyed by the blob and the whitespace flags the hashes
+ * were computed with, and the least recently used one is dropped once
+ * there are more than git_xdiff_line_cache_size of them.
+ */
+struct line_cache_entry {
+	struct hashmap_entry ent;
+	struct list_head lru;
+	struct object_id oid;
+	long flags;
+	xdlines_t lines;
+};
+
+static struct hashmap line_cache;
+static LIST_HEAD(line_cache_lru);
+static int line_cache_nr;
+
+static int line_cache_cmp(const void *unused_cmp_data,
+			  const void *entry, const void *entry_or_key,
+			  const void *unused_keydata)
+{
+	const struct line_cache_entry *a = entry;
+	const struct line_cache_entry *b = entry_or_key;
+
+	return a->flags != b->flags || !oideq(&a->oid, &b->oid);
+}
+
+static void line_cache_evict(int limit)
+{
+	while (line_cache_nr > limit) {
+		struct line_cache_entry *e =
+			list_entry(line_cache_lru.prev, struct line_cache_entry, lru);
+
+		list_del(&e->lru);
+		hashmap_remove(&line_cache, e, NULL);
+		xdl_free_lines(&e->lines);
+		free(e);
+		line_cache_nr--;
+	}
+}
+
+static const xdlines_t *cached_lines(mmfile_t *mf, const struct object_id *oid,
+				     long flags)
+{
+	struct line_cache_entry key, *e;
+
+	if (!oid || git_xdiff_line_cache_size <= 0)
+		return NULL;
+
+	if (!line_cache.tablesize)
+		hashmap_init(&line_cache, line_cache_cmp, NULL, 0);
+
+	key.flags = flags & XDF_WHITESPACE_FLAGS;
+	oidcpy(&key.oid, oid);
+	hashmap_entry_init(&key, sha1hash(oid->hash) ^ key.flags);
+	e = hashmap_get(&line_cache, &key, NULL);
+	if (e) {
+		list_del(&e->lru);
+		list_add(&e->lru, &line_cache_lru);
+		return &e->lines;
+	}
+
+	e = xcalloc(1, sizeof(*e));
+	if (xdl_hash_lines(mf, key.flags, &e->lines) < 0) {
+		free(e);
+		return NULL;
+	}
+	hashmap_entry_init(e, key.ent.hash);
+	oidcpy(&e->oid, oid);
+	e->flags = key.flags;
+	hashmap_add(&line_cache, e);
+	list_add(&e->lru, &line_cache_lru);
+	line_cache_nr++;
+
+	/*
+	 * Keep at least two entries, so that looking up the second side
+	 * of a diff never evicts the first one.
+	 */
+	line_cache_evict(git_xdiff_line_cache_size < 2 ? 2 : git_xdiff_line_cache_size);
+	return &e->lines;
+}
+
+int xdi_diff_blobs(mmfile_t *mf1, const struct object_id *oid1,
+		   mmfile_t *mf2, const struct object_id *oid2,
+		   xpparam_t const *xpp, xdemitconf_t const *xecfg, xdemitcb_t *xecb)
+{
+	xpparam_t params = *xpp;
+
+	if (mf1->size > MAX_XDIFF_SIZE || mf2->size > MAX_XDIFF_SIZE)
+		return -1;
+
+	params.lines1 = cached_lines(mf1, oid1, xpp->flags);
+	params.lines2 = cached_lines(mf2, oid2, xpp->flags);
+	return xdi_diff(mf1, mf2, &params, xecfg, xecb);
+}
+
+/*
+ * Diffs of blobs computed ahead of time by worker threads, for the
+ * diffs a command is about to show.  The edit script is computed by
+ * a worker, and emitted when xdi_diff_outf_blobs() is called for the
+ * same pair of blobs with the same options; the output is the same as
+ * if the blobs were diffed there.
+ */
+struct xdiff_prefetch {
+	struct hashmap_entry ent;
+	/* in the queue of diffs waiting for a worker */
+	struct xdiff_prefetch *next_queued;
+	struct object_id oid1, oid2;
+	unsigned long flags;
+	int trim;
+	mmfile_t mf1, mf2;
+	/* the part of mf1 and mf2 that is diffed */
+	mmfile_t a, b;
+	xdcost_t cost;
+	xdfenv_t xe;
+	xdchange_t *xscr;
+	int ret, done, used;
+	/* for xdi_prefetched_blob() */
+	struct prefetch_blob {
+		struct hashmap_entry ent;
+		const struct object_id *oid;
+		mmfile_t *mf;
+	} blob[2];
+};
+
+static struct xdiff_prefetch_pool {
+	pthread_mutex_t mutex;
+	pthread_cond_t work_cond;
+	pthread_cond_t done_cond;
+	struct xdiff_prefetch *queue, **queue_tail;
+	struct hashmap diffs;
+	struct hashmap blobs;
+	pthread_t *threads;
+	int nr_threads;
+	int stop;
+} prefetch_pool;
+
+static int prefetch_cmp(const void *unused_cmp_data,
+			const void *entry, const void *entry_or_key,
+			const void *keydata)
+{
+	const struct xdiff_prefetch *a = entry;
+	const struct xdiff_prefetch *b = entry_or_key;
+
+	/* with keydata, look for that very diff, as pairs of blobs repeat */
+	if (keydata)
+		return a != keydata;
+	return a->flags != b->flags || a->trim != b->trim ||
+		!oideq(&a->oid1, &b->oid1) || !oideq(&a->oid2, &b->oid2);
+}
+
+static int prefetch_blob_cmp(const void *unused_cmp_data,
+			     const void *entry, const void *entry_or_key,
+			     const void *keydata)
+{
+	const struct prefetch_blob *a = entry;
+	const struct prefetch_blob *b = entry_or_key;
+
+	/* without an oid, look for the very entry, as blobs repeat */
+	if (!keydata)
+		return a != b;
+	return !oideq(a->oid, keydata);
+}
+
+static unsigned int prefetch_hash(const struct object_id *oid1,
+				  const struct object_id *oid2,
+				  unsigned long flags, int trim)
+{
+	return sha1hash(oid1->hash) ^ sha1hash(oid2->hash) ^ flags ^ trim;
+}
+
+static void *xdiff_prefetch_worker(void *unused)
+{
+	pthread_mutex_lock(&prefetch_pool.mutex);
+	for (;;) {
+		struct xdiff_prefetch *p;
+		xpparam_t xpp;
+
+		while (!prefetch_pool.queue && !prefetch_pool.stop)
+			pthread_cond_wait(&prefetch_pool.work_cond,
+					  &prefetch_pool.mutex);
+		p = prefetch_pool.queue;
+		if (!p)
+			break;
+		prefetch_pool.queue = p->next_queued;
+		if (!prefetch_pool.queue)
+			prefetch_pool.queue_tail = &prefetch_pool.queue;
+		pthread_mutex_unlock(&prefetch_pool.mutex);
+
+		memset(&xpp, 0, sizeof(xpp));
+		xpp.flags = p->flags;
+		xpp.max_cost = git_xdiff_max_cost;
+		xpp.cost = &p->cost;
+		p->ret = xdl_diff_prepare(&p->a, &p->b, &xpp, &p->xe, &p->xscr);
+
+		pthread_mutex_lock(&prefetch_pool.mutex);
+		p->done = 1;
+		pthread_cond_broadcast(&prefetch_pool.done_cond);
+	}
+	pthread_mutex_unlock(&prefetch_pool.mutex);
+	return NULL;
+}
+
+int xdi_start_prefetch(int nr_threads)
+{
+	int i;
+
+	if (!HAVE_THREADS || nr_threads < 2)
+		return 0;
+
+	pthread_mutex_init(&prefetch_pool.mutex, NULL);
+	pthread_cond_init(&prefetch_pool.work_cond, NULL);
+	pthread_cond_init(&prefetch_pool.done_cond, NULL);
+	prefetch_pool.queue = NULL;
+	prefetch_pool.queue_tail = &prefetch_pool.queue;
+	prefetch_pool.stop = 0;
+	hashmap_init(&prefetch_pool.diffs, prefetch_cmp, NULL, 0);
+	hashmap_init(&prefetch_pool.blobs, prefetch_blob_cmp, NULL, 0);
+	ALLOC_ARRAY(prefetch_pool.threads, nr_threads);
+	for (i = 0; i < nr_threads; i++) {
+		if (pthread_create(&prefetch_pool.threads[i], NULL,
+				   xdiff_prefetch_worker, NULL)) {
+			warning(_("unable to create diff thread"));
+			break;
+		}
+	}
+	prefetch_pool.nr_threads = i;
+	if (!prefetch_pool.nr_threads) {
+		hashmap_free(&prefetch_pool.diffs, 0);
+		hashmap_free(&prefetch_pool.blobs, 0);
+		pthread_cond_destroy(&prefetch_pool.work_cond);
+		pthread_cond_destroy(&prefetch_pool.done_cond);
+		pthread_mutex_destroy(&prefetch_pool.mutex);
+		FREE_AND_NULL(prefetch_pool.threads);
+	}
+	return prefetch_pool.nr_threads;
+}
+
+void xdi_stop_prefetch(void)
+{
+	int i;
+
+	if (!prefetch_pool.nr_threads)
+		return;
+	pthread_mutex_lock(&prefetch_pool.mutex);
+	prefetch_pool.stop = 1;
+	pthread_cond_broadcast(&prefetch_pool.work_cond);
+	pthread_mutex_unlock(&prefetch_pool.mutex);
+	for (i = 0; i < prefetch_pool.nr_threads; i++)
+		pthread_join(prefetch_pool.threads[i], NULL);
+	hashmap_free(&prefetch_pool.diffs, 0);
+	hashmap_free(&prefetch_pool.blobs, 0);
+	pthread_cond_destroy(&prefetch_pool.work_cond);
+	pthread_cond_destroy(&prefetch_pool.done_cond);
+	pthread_mutex_destroy(&prefetch_pool.mutex);
+	FREE_AND_NULL(prefetch_pool.threads);
+	prefetch_pool.nr_threads = 0;
+}
+
+static void wait_for_prefetch(struct xdiff_prefetch *p)
+{
+	pthread_mutex_lock(&prefetch_pool.mutex);
+	while (!p->done)
+		pthread_cond_wait(&prefetch_pool.done_cond, &prefetch_pool.mutex);
+	pthread_mutex_unlock(&prefetch_pool.mutex);
+}
+
+struct xdiff_prefetch *xdi_prefetch_blobs(mmfile_t *mf1, const struct object_id *oid1,
+					  mmfile_t *mf2, const struct object_id *oid2,
+					  unsigned long flags, int trim)
+{
+	struct xdiff_prefetch *p;
+	int i;
+
+	if (!prefetch_pool.nr_threads ||
+	    mf1->size > MAX_XDIFF_SIZE || mf2->size > MAX_XDIFF_SIZE) {
+		free(mf1->ptr);
+		free(mf2->ptr);
+		return NULL;
+	}
+
+	p = xcalloc(1, sizeof(*p));
+	oidcpy(&p->oid1, oid1);
+	oidcpy(&p->oid2, oid2);
+	p->flags = flags;
+	p->trim = trim;
+	p->a = p->mf1 = *mf1;
+	p->b = p->mf2 = *mf2;
+	if (trim)
+		trim_common_tail(&p->a, &p->b);
+	hashmap_entry_init(p, prefetch_hash(oid1, oid2, flags, trim));
+	p->blob[0].oid = &p->oid1;
+	p->blob[0].mf = &p->mf1;
+	p->blob[1].oid = &p->oid2;
+	p->blob[1].mf = &p->mf2;
+	for (i = 0; i < 2; i++) {
+		hashmap_entry_init(&p->blob[i], sha1hash(p->blob[i].oid->hash));
+		hashmap_add(&prefetch_pool.blobs, &p->blob[i]);
+	}
+
+	pthread_mutex_lock(&prefetch_pool.mutex);
+	hashmap_add(&prefetch_pool.diffs, p);
+	*prefetch_pool.queue_tail = p;
+	prefetch_pool.queue_tail = &p->next_queued;
+	pthread_cond_signal(&prefetch_pool.work_cond);
+	pthread_mutex_unlock(&prefetch_pool.mutex);
+	return p;
+}
+
+void xdi_release_prefetch(struct xdiff_prefetch *p)
+{
+	if (!p)
+		return;
+	wait_for_prefetch(p);
+	hashmap_remove(&prefetch_pool.blobs, &p->blob[0], NULL);
+	hashmap_remove(&prefetch_pool.blobs, &p->blob[1], NULL);
+	if (!p->used) {
+		pthread_mutex_lock(&prefetch_pool.mutex);
+		hashmap_remove(&prefetch_pool.diffs, p, p);
+		pthread_mutex_unlock(&prefetch_pool.mutex);
+	}
+	if (!p->ret) {
+		xdl_free_script(p->xscr);
+		xdl_free_env(&p->xe);
+	}
+	free(p->mf1.ptr);
+	free(p->mf2.ptr);
+	free(p);
+}
+
+void *xdi_prefetched_blob(const struct object_id *oid, unsigned long *size)
+{
+	struct prefetch_blob *b;
+
+	if (!prefetch_pool.nr_threads)
+		return NULL;
+	b = hashmap_get_from_hash(&prefetch_pool.blobs, sha1hash(oid->hash), oid);
+	if (!b)
+		return NULL;
+	*size = b->mf->size;
+	return xmemdupz(b->mf->ptr, b->mf->size);
+}
+
+/*
+ * Find the prefetched diff of the blobs, if there is one, and take it
+ * out of the table, so that it is emitted only once.
+ */
+static struct xdiff_prefetch *take_prefetch(const struct object_id *oid1,
+					    const struct object_id *oid2,
+					    xpparam_t const *xpp,
+					    xdemitconf_t const *xecfg)
+{
+	struct xdiff_prefetch key, *p;
+
+	if (!prefetch_pool.nr_threads || !oid1 || !oid2 ||
+	    xpp->anchors_nr || xpp->max_cost || xpp->cost)
+		return NULL;
+
+	oidcpy(&key.oid1, oid1);
+	oidcpy(&key.oid2, oid2);
+	key.flags = xpp->flags;
+	key.trim = !xecfg->ctxlen && !(xecfg->flags & XDL_EMIT_FUNCCONTEXT);
+	hashmap_entry_init(&key, prefetch_hash(oid1, oid2, key.flags, key.trim));
+
+	pthread_mutex_lock(&prefetch_pool.mutex);
+	p = hashmap_remove(&prefetch_pool.diffs, &key, NULL);
+	if (p)
+		p->used = 1;
+	pthread_mutex_unlock(&prefetch_pool.mutex);
+	if (p)
+		wait_for_prefetch(p);
+	return p;
 }
 
 void discard_hunk_line(void *priv,
@@ -126,9 +533,21 @@ int xdi_diff_outf(mmfile_t *mf1, mmfile_t *mf2,
 		  xdiff_emit_line_fn line_fn,
 		  void *consume_callback_data,
 		  xpparam_t const *xpp, xdemitconf_t const *xecfg)
+{
+	return xdi_diff_outf_blobs(mf1, NULL, mf2, NULL, hunk_fn, line_fn,
+				   consume_callback_data, xpp, xecfg);
+}
+
+int xdi_diff_outf_blobs(mmfile_t *mf1, const struct object_id *oid1,
+			mmfile_t *mf2, const struct object_id *oid2,
+			xdiff_emit_hunk_fn hunk_fn,
+			xdiff_emit_line_fn line_fn,
+			void *consume_callback_data,
+			xpparam_t const *xpp, xdemitconf_t const *xecfg)
 {
 	int ret;
 	struct xdiff_emit_state state;
+	struct xdiff_prefetch *p;
 	xdemitcb_t ecb;
 
 	memset(&state, 0, sizeof(state));
@@ -141,7 +560,14 @@ int xdi_diff_outf(mmfile_t *mf1, mmfile_t *mf2,
 	ecb.out_line = xdiff_outf;
 	ecb.priv = &state;
 	strbuf_init(&state.remainder, 0);
-	ret = xdi_diff(mf1, mf2, xpp, xecfg, &ecb);
+	p = take_prefetch(oid1, oid2, xpp, xecfg);
+	if (p && !p->ret && p->mf1.size == mf1->size && p->mf2.size == mf2->size) {
+		trace_diff_cost_of(&p->a, &p->b, &p->cost);
+		ret = xdl_diff_emit(&p->xe, p->xscr, &ecb, xecfg) < 0 ? -1 : 0;
+	} else if (oid1 && oid2)
+		ret = xdi_diff_blobs(mf1, oid1, mf2, oid2, xpp, xecfg, &ecb);
+	else
+		ret = xdi_diff(mf1, mf2, xpp, xecfg, &ecb);
 	strbuf_release(&state.remainder);
 	return ret;
 }
@@ -18,11 +18,59 @@ typedef void (*xdiff_emit_hunk_fn)(void *data,
 				   const char *func, long funclen);
 
 int xdi_diff(mmfile_t *mf1, mmfile_t *mf2, xpparam_t const *xpp, xdemitconf_t const *xecfg, xdemitcb_t *ecb);
+/*
+ * Like xdi_diff(), but mf1 and mf2 are the contents of the blobs oid1
+ * and oid2 (either of which may be NULL), whose lines are split and
+ * hashed only once while they stay in the diff.lineHashCache.
+ */
+int xdi_diff_blobs(mmfile_t *mf1, const struct object_id *oid1,
+		   mmfile_t *mf2, const struct object_id *oid2,
+		   xpparam_t const *xpp, xdemitconf_t const *xecfg, xdemitcb_t *ecb);
 int xdi_diff_outf(mmfile_t *mf1, mmfile_t *mf2,
 		  xdiff_emit_hunk_fn hunk_fn,
 		  xdiff_emit_line_fn line_fn,
 		  void *consume_callback_data,
 		  xpparam_t const *xpp, xdemitconf_t const *xecfg);
+/*
+ * Like xdi_diff_outf(), but mf1 and mf2 are the contents of the blobs
+ * oid1 and oid2 (either of which may be NULL), whose diff may already
+ * have been computed by xdi_prefetch_blobs().
+ */
+int xdi_diff_outf_blobs(mmfile_t *mf1, const struct object_id *oid1,
+			mmfile_t *mf2, const struct object_id *oid2,
+			xdiff_emit_hunk_fn hunk_fn,
+			xdiff_emit_line_fn line_fn,
+			void *consume_callback_data,
+			xpparam_t const *xpp, xdemitconf_t const *xecfg);
+
+/*
+ * Diff blobs from worker threads, ahead of the calls to
+ * xdi_diff_outf_blobs() that show those diffs.
+ *
+ * xdi_start_prefetch() starts nr_threads workers and returns how many
+ * could be started; nothing is prefetched with fewer than two.
+ *
+ * xdi_prefetch_blobs() takes over the buffers of mf1 and mf2, the
+ * contents of oid1 and oid2, and queues their diff with the xpparam_t
+ * flags "flags"; "trim" is whether the diff is shown without context
+ * lines (see xdi_diff()).  It returns NULL if the diff is not queued.
+ *
+ * xdi_release_prefetch() frees a queued diff, whether it was used or
+ * not, once the diffs it was queued for are shown.
+ */
+struct xdiff_prefetch;
+int xdi_start_prefetch(int nr_threads);
+void xdi_stop_prefetch(void);
+struct xdiff_prefetch *xdi_prefetch_blobs(mmfile_t *mf1, const struct object_id *oid1,
+					  mmfile_t *mf2, const struct object_id *oid2,
+					  unsigned long flags, int trim);
+void xdi_release_prefetch(struct xdiff_prefetch *p);
+/*
+ * Return a copy of the contents of the blob if it was read for a diff
+ * that is still queued, or NULL.
+ */
+void *xdi_prefetched_blob(const struct object_id *oid, unsigned long *size);
+
 int read_mmfile(mmfile_t *ptr, const char *filename);
 void read_mmblob(mmfile_t *ptr, const struct object_id *oid);
 int buffer_is_binary(const char *ptr, unsigned long size);
@@ -32,6 +80,18 @@ extern void xdiff_clear_find_func(xdemitconf_t *xecfg);
 extern int git_xmerge_config(const char *var, const char *value, void *cb);
 extern int git_xmerge_style;
 
+/*
+ * The default for xpparam_t.max_cost in xdi_diff() (diff.maxCost);
+ * 0 means no limit.
+ */
+extern long git_xdiff_max_cost;
+
+/*
+ * The number of blobs whose line hashes xdi_diff_blobs() keeps around
+ * (diff.lineHashCache); 0 disables the cache.
+ */
+extern int git_xdiff_line_cache_size;
+
 /*
  * Can be used as a no-op hunk_fn for xdi_diff_outf(), since a NULL
  * one just sends the hunk line to the line_fn callback).
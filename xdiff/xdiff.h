@@ -76,12 +76,45 @@ typedef struct s_mmbuffer {
 	long size;
 } mmbuffer_t;
 
+/*
+ * The lines of a file and their hashes, as computed by xdl_hash_lines():
+ * line i starts at offsets[i] and ends at offsets[i + 1], and hashes
+ * to ha[i].
+ */
+typedef struct s_xdlines {
+	long nrec;
+	long *offsets;
+	unsigned long *ha;
+} xdlines_t;
+
+typedef struct s_xdcost {
+	long spent;
+	int capped;
+} xdcost_t;
+
 typedef struct s_xpparam {
 	unsigned long flags;
 
 	/* See Documentation/diff-options.txt. */
 	char **anchors;
 	size_t anchors_nr;
+
+	/*
+	 * Stop refining the diff once this many steps were spent on it
+	 * and mark the lines that are not matched yet as changed (0 for
+	 * no limit).  If "cost" is not NULL, the steps are counted from
+	 * cost->spent, and cost->spent and cost->capped are updated.
+	 */
+	long max_cost;
+	xdcost_t *cost;
+
+	/*
+	 * The lines of mf1 and mf2, if they were already computed with
+	 * the same whitespace flags.  They may describe more lines than
+	 * the file passed in, as long as the file is a prefix of the one
+	 * they were computed from.
+	 */
+	xdlines_t const *lines1, *lines2;
 } xpparam_t;
 
 typedef struct s_xdemitcb {
@@ -123,6 +156,9 @@ long xdl_mmfile_size(mmfile_t *mmf);
 int xdl_diff(mmfile_t *mf1, mmfile_t *mf2, xpparam_t const *xpp,
 	     xdemitconf_t const *xecfg, xdemitcb_t *ecb);
 
+int xdl_hash_lines(mmfile_t *mf, long flags, xdlines_t *lines);
+void xdl_free_lines(xdlines_t *lines);
+
 typedef struct s_xmparam {
 	xpparam_t xpp;
 	int marker_size;
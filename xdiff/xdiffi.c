@@ -28,6 +28,13 @@
 #define XDL_SNAKE_CNT 20
 #define XDL_K_HEUR 4
 
+/*
+ * Whether the diff spent all of the steps it was given (see max_cost in
+ * xpparam_t).  A "step" is one diagonal looked at, or one line walked
+ * along a snake, in xdl_split().
+ */
+#define XDL_OVER_COST(xenv) ((xenv)->max_cost > 0 && (xenv)->cost > (xenv)->max_cost)
+
 typedef struct s_xdpsplit {
 	long i1, i2;
 	int min_lo, min_hi;
@@ -88,6 +95,7 @@ static long xdl_split(unsigned long const *ha1, long off1, long lim1,
 			for (; i1 < lim1 && i2 < lim2 && ha1[i1] == ha2[i2]; i1++, i2++);
 			if (i1 - prev1 > xenv->snake_cnt)
 				got_snake = 1;
+			xenv->cost += 1 + i1 - prev1;
 			kvdf[d] = i1;
 			if (odd && bmin <= d && d <= bmax && kvdb[d] <= i1) {
 				spl->i1 = i1;
@@ -123,6 +131,7 @@ static long xdl_split(unsigned long const *ha1, long off1, long lim1,
 			for (; i1 > off1 && i2 > off2 && ha1[i1 - 1] == ha2[i2 - 1]; i1--, i2--);
 			if (prev1 - i1 > xenv->snake_cnt)
 				got_snake = 1;
+			xenv->cost += 1 + prev1 - i1;
 			kvdb[d] = i1;
 			if (!odd && fmin <= d && d <= fmax && i1 <= kvdf[d]) {
 				spl->i1 = i1;
@@ -132,7 +141,7 @@ static long xdl_split(unsigned long const *ha1, long off1, long lim1,
 			}
 		}
 
-		if (need_min)
+		if (need_min && !XDL_OVER_COST(xenv))
 			continue;
 
 		/*
@@ -199,7 +208,7 @@ static long xdl_split(unsigned long const *ha1, long off1, long lim1,
 		 * Enough is enough. We spent too much time here and now we collect
 		 * the furthest reaching path using the (i1 + i2) measure.
 		 */
-		if (ec >= xenv->mxcost) {
+		if (ec >= xenv->mxcost || XDL_OVER_COST(xenv)) {
 			long fbest, fbest1, bbest, bbest1;
 
 			fbest = fbest1 = -1;
@@ -261,9 +270,20 @@ int xdl_recs_cmp(diffdata_t *dd1, long off1, long lim1,
 
 	/*
 	 * If one dimension is empty, then all records on the other one must
-	 * be obviously changed.
+	 * be obviously changed.  The same goes for both of them once we ran
+	 * out of steps: the box stays between the snakes we found so far,
+	 * but we do not look for more inside it.
 	 */
-	if (off1 == lim1) {
+	if (off1 < lim1 && off2 < lim2 && XDL_OVER_COST(xenv)) {
+		char *rchg1 = dd1->rchg, *rchg2 = dd2->rchg;
+		long *rindex1 = dd1->rindex, *rindex2 = dd2->rindex;
+
+		xenv->capped = 1;
+		for (; off1 < lim1; off1++)
+			rchg1[rindex1[off1]] = 1;
+		for (; off2 < lim2; off2++)
+			rchg2[rindex2[off2]] = 1;
+	} else if (off1 == lim1) {
 		char *rchg2 = dd2->rchg;
 		long *rindex2 = dd2->rindex;
 
@@ -342,6 +362,9 @@ int xdl_do_diff(mmfile_t *mf1, mmfile_t *mf2, xpparam_t const *xpp,
 		xenv.mxcost = XDL_MAX_COST_MIN;
 	xenv.snake_cnt = XDL_SNAKE_CNT;
 	xenv.heur_min = XDL_HEUR_MIN_COST;
+	xenv.cost = xpp->cost ? xpp->cost->spent : 0;
+	xenv.max_cost = xpp->max_cost;
+	xenv.capped = 0;
 
 	dd1.nrec = xe->xdf1.nreff;
 	dd1.ha = xe->xdf1.ha;
@@ -362,6 +385,11 @@ int xdl_do_diff(mmfile_t *mf1, mmfile_t *mf2, xpparam_t const *xpp,
 
 	xdl_free(kvd);
 
+	if (xpp->cost) {
+		xpp->cost->spent = xenv.cost;
+		xpp->cost->capped |= xenv.capped;
+	}
+
 	return 0;
 }
 
@@ -1008,36 +1036,46 @@ static void xdl_mark_ignorable(xdchange_t *xscr, xdfenv_t *xe, long flags)
 	}
 }
 
-int xdl_diff(mmfile_t *mf1, mmfile_t *mf2, xpparam_t const *xpp,
-	     xdemitconf_t const *xecfg, xdemitcb_t *ecb) {
-	xdchange_t *xscr;
-	xdfenv_t xe;
-	emit_func_t ef = xecfg->hunk_func ? xdl_call_hunk_func : xdl_emit_diff;
+int xdl_diff_prepare(mmfile_t *mf1, mmfile_t *mf2, xpparam_t const *xpp,
+		     xdfenv_t *xe, xdchange_t **xscr) {
 
-	if (xdl_do_diff(mf1, mf2, xpp, &xe) < 0) {
+	if (xdl_do_diff(mf1, mf2, xpp, xe) < 0) {
 
 		return -1;
 	}
-	if (xdl_change_compact(&xe.xdf1, &xe.xdf2, xpp->flags) < 0 ||
-	    xdl_change_compact(&xe.xdf2, &xe.xdf1, xpp->flags) < 0 ||
-	    xdl_build_script(&xe, &xscr) < 0) {
+	if (xdl_change_compact(&xe->xdf1, &xe->xdf2, xpp->flags) < 0 ||
+	    xdl_change_compact(&xe->xdf2, &xe->xdf1, xpp->flags) < 0 ||
+	    xdl_build_script(xe, xscr) < 0) {
 
-		xdl_free_env(&xe);
+		xdl_free_env(xe);
 		return -1;
 	}
-	if (xscr) {
-		if (xpp->flags & XDF_IGNORE_BLANK_LINES)
-			xdl_mark_ignorable(xscr, &xe, xpp->flags);
+	if (*xscr && (xpp->flags & XDF_IGNORE_BLANK_LINES))
+		xdl_mark_ignorable(*xscr, xe, xpp->flags);
 
-		if (ef(&xe, xscr, ecb, xecfg) < 0) {
+	return 0;
+}
 
-			xdl_free_script(xscr);
-			xdl_free_env(&xe);
-			return -1;
-		}
-		xdl_free_script(xscr);
-	}
+int xdl_diff_emit(xdfenv_t *xe, xdchange_t *xscr, xdemitcb_t *ecb,
+		  xdemitconf_t const *xecfg) {
+	emit_func_t ef = xecfg->hunk_func ? xdl_call_hunk_func : xdl_emit_diff;
+
+	if (!xscr)
+		return 0;
+	return ef(xe, xscr, ecb, xecfg);
+}
+
+int xdl_diff(mmfile_t *mf1, mmfile_t *mf2, xpparam_t const *xpp,
+	     xdemitconf_t const *xecfg, xdemitcb_t *ecb) {
+	xdchange_t *xscr;
+	xdfenv_t xe;
+	int ret;
+
+	if (xdl_diff_prepare(mf1, mf2, xpp, &xe, &xscr) < 0)
+		return -1;
+	ret = xdl_diff_emit(&xe, xscr, ecb, xecfg);
+	xdl_free_script(xscr);
 	xdl_free_env(&xe);
 
-	return 0;
+	return ret < 0 ? -1 : 0;
 }
@@ -35,6 +35,9 @@ typedef struct s_xdalgoenv {
 	long mxcost;
 	long snake_cnt;
 	long heur_min;
+	long cost;
+	long max_cost;
+	int capped;
 } xdalgoenv_t;
 
 typedef struct s_xdchange {
@@ -56,6 +59,16 @@ int xdl_build_script(xdfenv_t *xe, xdchange_t **xscr);
 void xdl_free_script(xdchange_t *xscr);
 int xdl_emit_diff(xdfenv_t *xe, xdchange_t *xscr, xdemitcb_t *ecb,
 		  xdemitconf_t const *xecfg);
+/*
+ * xdl_diff() in two steps: computing the edit script of mf1 and mf2,
+ * and emitting it, so that the two can happen at different times.
+ * The script and env refer to the contents of mf1 and mf2, and are
+ * freed with xdl_free_script() and xdl_free_env().
+ */
+int xdl_diff_prepare(mmfile_t *mf1, mmfile_t *mf2, xpparam_t const *xpp,
+		     xdfenv_t *xe, xdchange_t **xscr);
+int xdl_diff_emit(xdfenv_t *xe, xdchange_t *xscr, xdemitcb_t *ecb,
+		  xdemitconf_t const *xecfg);
 int xdl_do_patience_diff(mmfile_t *mf1, mmfile_t *mf2, xpparam_t const *xpp,
 		xdfenv_t *env);
 int xdl_do_histogram_diff(mmfile_t *mf1, mmfile_t *mf2, xpparam_t const *xpp,
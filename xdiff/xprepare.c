@@ -169,6 +169,7 @@ static int xdl_prepare_ctx(unsigned int pass, mmfile_t *mf, long narec, xpparam_
 	unsigned long *ha;
 	char *rchg;
 	long *rindex;
+	xdlines_t const *lines = pass == 1 ? xpp->lines1 : xpp->lines2;
 
 	ha = NULL;
 	rindex = NULL;
@@ -195,7 +196,12 @@ static int xdl_prepare_ctx(unsigned int pass, mmfile_t *mf, long narec, xpparam_
 	if ((cur = blk = xdl_mmfile_first(mf, &bsize)) != NULL) {
 		for (top = blk + bsize; cur < top; ) {
 			prev = cur;
-			hav = xdl_hash_record(&cur, top, xpp->flags);
+			if (lines && nrec < lines->nrec &&
+			    lines->offsets[nrec + 1] <= bsize) {
+				cur = blk + lines->offsets[nrec + 1];
+				hav = lines->ha[nrec];
+			} else
+				hav = xdl_hash_record(&cur, top, xpp->flags);
 			if (nrec >= narec) {
 				narec *= 2;
 				if (!(rrecs = (xrecord_t **) xdl_realloc(recs, narec * sizeof(xrecord_t *))))
@@ -248,6 +254,61 @@ static int xdl_prepare_ctx(unsigned int pass, mmfile_t *mf, long narec, xpparam_
 }
 
 
+int xdl_hash_lines(mmfile_t *mf, long flags, xdlines_t *lines) {
+	long nrec, alloc, bsize;
+	char const *blk, *cur, *top;
+	long *offsets;
+	unsigned long *ha;
+
+	alloc = xdl_guess_lines(mf, XDL_GUESS_NLINES1) + 1;
+	offsets = (long *) xdl_malloc((alloc + 1) * sizeof(long));
+	ha = (unsigned long *) xdl_malloc(alloc * sizeof(unsigned long));
+	if (!offsets || !ha)
+		goto abort;
+
+	nrec = 0;
+	offsets[0] = 0;
+	if ((cur = blk = xdl_mmfile_first(mf, &bsize)) != NULL) {
+		for (top = blk + bsize; cur < top; ) {
+			if (nrec >= alloc) {
+				long *roffsets;
+				unsigned long *rha;
+
+				alloc *= 2;
+				if (!(roffsets = (long *) xdl_realloc(offsets, (alloc + 1) * sizeof(long))))
+					goto abort;
+				offsets = roffsets;
+				if (!(rha = (unsigned long *) xdl_realloc(ha, alloc * sizeof(unsigned long))))
+					goto abort;
+				ha = rha;
+			}
+			ha[nrec] = xdl_hash_record(&cur, top, flags);
+			offsets[++nrec] = (long) (cur - blk);
+		}
+	}
+
+	lines->nrec = nrec;
+	lines->offsets = offsets;
+	lines->ha = ha;
+	return 0;
+
+abort:
+	xdl_free(offsets);
+	xdl_free(ha);
+	return -1;
+}
+
+
+void xdl_free_lines(xdlines_t *lines) {
+
+	xdl_free(lines->offsets);
+	xdl_free(lines->ha);
+	lines->offsets = NULL;
+	lines->ha = NULL;
+	lines->nrec = 0;
+}
+
+
 static void xdl_free_ctx(xdfile_t *xdf) {
 
 	xdl_free(xdf->rhash);
@@ -276,8 +337,8 @@ int xdl_prepare_env(mmfile_t *mf1, mmfile_t *mf2, xpparam_t const *xpp,
 	sample = (XDF_DIFF_ALG(xpp->flags) == XDF_HISTOGRAM_DIFF
 		  ? XDL_GUESS_NLINES2 : XDL_GUESS_NLINES1);
 
-	enl1 = xdl_guess_lines(mf1, sample) + 1;
-	enl2 = xdl_guess_lines(mf2, sample) + 1;
+	enl1 = xpp->lines1 ? xpp->lines1->nrec + 1 : xdl_guess_lines(mf1, sample) + 1;
+	enl2 = xpp->lines2 ? xpp->lines2->nrec + 1 : xdl_guess_lines(mf2, sample) + 1;
 
 	if (XDF_DIFF_ALG(xpp->flags) != XDF_HISTOGRAM_DIFF &&
 	    xdl_init_classifier(&cf, enl1 + enl2 + 1, xpp->flags) < 0)
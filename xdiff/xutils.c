@@ -253,20 +253,54 @@ int xdl_recmatch(const char *l1, long s1, const char *l2, long s2, long flags)
 	return 1;
 }
 
+/*
+ * Unless whitespace has to be ignored, lines are hashed a word at a
+ * time rather than a byte at a time: each word is mixed into the hash
+ * with a rotate, an xor and a multiply.  The bytes at the end of the
+ * line that do not fill a whole word are copied into a zeroed word,
+ * and the length of the line is mixed in last so that lines that only
+ * differ by trailing NULs still hash differently.
+ *
+ * Hashes are only ever compared with hashes computed with the same
+ * flags in the same process, so they are free to differ between
+ * platforms and from the whitespace-ignoring hash below.
+ */
+#define XDL_HASH_BITS (sizeof(unsigned long) * CHAR_BIT)
+#define XDL_HASH_MUL ((unsigned long) 0x9e3779b97f4a7c15ULL)
+
+static inline unsigned long xdl_hash_mix(unsigned long ha, unsigned long word) {
+	return (((ha << 5) | (ha >> (XDL_HASH_BITS - 5))) ^ word) * XDL_HASH_MUL;
+}
+
+static inline unsigned long xdl_hash_final(unsigned long ha, long size) {
+	ha = xdl_hash_mix(ha, (unsigned long) size);
+	return ha ^ (ha >> (XDL_HASH_BITS / 2));
+}
+
+static unsigned long xdl_hash_bytes(char const *ptr, long size) {
+	unsigned long ha = 5381, word;
+	long left;
+
+	for (left = size; left >= (long) sizeof(word); left -= sizeof(word)) {
+		memcpy(&word, ptr, sizeof(word));
+		ha = xdl_hash_mix(ha, word);
+		ptr += sizeof(word);
+	}
+	if (left) {
+		word = 0;
+		memcpy(&word, ptr, left);
+		ha = xdl_hash_mix(ha, word);
+	}
+	return xdl_hash_final(ha, size);
+}
+
 static unsigned long xdl_hash_record_with_whitespace(char const **data,
 		char const *top, long flags) {
 	unsigned long ha = 5381;
 	char const *ptr = *data;
-	int cr_at_eol_only = (flags & XDF_WHITESPACE_FLAGS) == XDF_IGNORE_CR_AT_EOL;
 
 	for (; ptr < top && *ptr != '\n'; ptr++) {
-		if (cr_at_eol_only) {
-			/* do not ignore CR at the end of an incomplete line */
-			if (*ptr == '\r' &&
-			    (ptr + 1 < top && ptr[1] == '\n'))
-				continue;
-		}
-		else if (XDL_ISSPACE(*ptr)) {
+		if (XDL_ISSPACE(*ptr)) {
 			const char *ptr2 = ptr;
 			int at_eol;
 			while (ptr + 1 < top && XDL_ISSPACE(ptr[1])
@@ -299,19 +333,26 @@ static unsigned long xdl_hash_record_with_whitespace(char const **data,
 }
 
 unsigned long xdl_hash_record(char const **data, char const *top, long flags) {
-	unsigned long ha = 5381;
 	char const *ptr = *data;
+	char const *eol;
+	long size;
 
-	if (flags & XDF_WHITESPACE_FLAGS)
+	if ((flags & XDF_WHITESPACE_FLAGS) &&
+	    (flags & XDF_WHITESPACE_FLAGS) != XDF_IGNORE_CR_AT_EOL)
 		return xdl_hash_record_with_whitespace(data, top, flags);
 
-	for (; ptr < top && *ptr != '\n'; ptr++) {
-		ha += (ha << 5);
-		ha ^= (unsigned long) *ptr;
+	eol = memchr(ptr, '\n', top - ptr);
+	if (!eol) {
+		*data = top;
+		return xdl_hash_bytes(ptr, top - ptr);
 	}
-	*data = ptr < top ? ptr + 1: ptr;
+	*data = eol + 1;
 
-	return ha;
+	size = eol - ptr;
+	/* do not ignore CR at the end of an incomplete line */
+	if ((flags & XDF_IGNORE_CR_AT_EOL) && size && ptr[size - 1] == '\r')
+		size--;
+	return xdl_hash_bytes(ptr, size);
 }
 
 unsigned int xdl_hashbits(unsigned int size) {